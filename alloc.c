@@ -0,0 +1,175 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "alloc.h"
+
+// tracked pointers are kept in a table instead of a header before each block,
+// so memory libc allocated (getline, open_memstream, realpath) can still go to alloc_free
+// and blocks freed with plain free just look live until their address comes back
+
+typedef struct {
+    void *ptr; // NULL if empty
+    size_t size;
+    AllocSubsystem subsystem;
+    bool removed;
+} AllocEntry;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static AllocEntry *entries;
+static size_t entries_cap; // power of two
+static size_t entries_used; // including removed ones
+static size_t entries_live;
+static AllocStats stats[ALLOC_SUBSYSTEMS];
+
+static const char *subsystem_names[ALLOC_SUBSYSTEMS] = {
+    [ALLOC_OTHER] = "other",
+    [ALLOC_LIST] = "list",
+    [ALLOC_STRINGS] = "strings",
+    [ALLOC_ERRORS] = "errors",
+    [ALLOC_LEXER] = "lexer",
+    [ALLOC_PARSER] = "parser",
+    [ALLOC_GRAPH] = "graph",
+    [ALLOC_LOGS] = "logs",
+    [ALLOC_LOADER] = "loader",
+    [ALLOC_EDITOR] = "editor"
+};
+
+static size_t ptr_slot (const void *ptr) {
+    uintptr_t key = (uintptr_t) ptr;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key & (entries_cap - 1);
+}
+
+// the entry for ptr, or NULL
+static AllocEntry *find_entry (const void *ptr) {
+    if (entries_cap == 0) return NULL;
+    for (size_t slot = ptr_slot(ptr); entries[slot].ptr != NULL || entries[slot].removed; slot = (slot + 1) & (entries_cap - 1)) {
+        if (!entries[slot].removed && entries[slot].ptr == ptr) return entries + slot;
+    }
+    return NULL;
+}
+
+static void untrack (AllocEntry *entry) {
+    stats[entry->subsystem].live -= entry->size;
+    entry->ptr = NULL;
+    entry->removed = true;
+    --entries_live;
+}
+
+static void insert (AllocEntry entry) {
+    size_t slot = ptr_slot(entry.ptr);
+    while (entries[slot].ptr != NULL) slot = (slot + 1) & (entries_cap - 1);
+    if (!entries[slot].removed) ++entries_used;
+    entries[slot] = entry;
+    ++entries_live;
+}
+
+// rehashes without the removed entries
+static void rehash (void) {
+    AllocEntry *old = entries;
+    size_t old_cap = entries_cap;
+    entries_cap = 1024;
+    while (entries_cap < 4 * (entries_live + 1)) entries_cap *= 2;
+    entries = calloc(entries_cap, sizeof(AllocEntry));
+    entries_used = 0;
+    entries_live = 0;
+    for (size_t i = 0; i < old_cap; ++i) {
+        if (old[i].ptr != NULL) insert(old[i]);
+    }
+    free(old);
+}
+
+static void track (AllocSubsystem subsystem, void *ptr, size_t size) {
+    // the address came back, so whatever had it was freed behind our back
+    AllocEntry *stale = find_entry(ptr);
+    if (stale != NULL) untrack(stale);
+    if (2 * (entries_used + 1) > entries_cap) rehash();
+    insert((AllocEntry) { .ptr = ptr, .size = size, .subsystem = subsystem, .removed = false });
+
+    AllocStats *s = stats + subsystem;
+    ++s->count;
+    s->bytes += size;
+    s->live += size;
+    if (s->live > s->peak) s->peak = s->live;
+}
+
+#ifdef BIDET_ALLOC_TRACKING
+static void report_at_exit (void) {
+    alloc_report(stderr);
+}
+
+static pthread_once_t report_once = PTHREAD_ONCE_INIT;
+
+static void register_report (void) {
+    atexit(report_at_exit);
+}
+#endif
+
+static void *tracked (AllocSubsystem subsystem, void *ptr, size_t size) {
+#ifdef BIDET_ALLOC_TRACKING
+    pthread_once(&report_once, register_report);
+#endif
+    if (ptr == NULL) return NULL;
+    pthread_mutex_lock(&lock);
+    track(subsystem, ptr, size);
+    pthread_mutex_unlock(&lock);
+    return ptr;
+}
+
+void *alloc_tracked (AllocSubsystem subsystem, size_t size) {
+    return tracked(subsystem, malloc(size), size);
+}
+
+void *alloc_tracked_zeroed (AllocSubsystem subsystem, size_t count, size_t size) {
+    return tracked(subsystem, calloc(count, size), count * size);
+}
+
+// the block moves to subsystem
+void *alloc_tracked_resize (AllocSubsystem subsystem, void *ptr, size_t size) {
+    if (ptr != NULL) {
+        pthread_mutex_lock(&lock);
+        AllocEntry *entry = find_entry(ptr);
+        if (entry != NULL) untrack(entry);
+        pthread_mutex_unlock(&lock);
+    }
+    return tracked(subsystem, realloc(ptr, size), size);
+}
+
+char *alloc_tracked_strndup (AllocSubsystem subsystem, const char *str, size_t len) {
+    size_t str_len = 0;
+    while (str_len < len && str[str_len] != '\0') ++str_len;
+    char *dup = alloc_tracked(subsystem, str_len + 1);
+    if (dup == NULL) return NULL;
+    memcpy(dup, str, str_len);
+    dup[str_len] = '\0';
+    return dup;
+}
+
+// untracked pointers are just freed
+void alloc_tracked_free (void *ptr) {
+    if (ptr == NULL) return;
+    pthread_mutex_lock(&lock);
+    AllocEntry *entry = find_entry(ptr);
+    if (entry != NULL) untrack(entry);
+    pthread_mutex_unlock(&lock);
+    free(ptr);
+}
+
+AllocStats alloc_stats (AllocSubsystem subsystem) {
+    pthread_mutex_lock(&lock);
+    AllocStats s = stats[subsystem];
+    pthread_mutex_unlock(&lock);
+    return s;
+}
+
+// a line per subsystem that allocated anything
+void alloc_report (FILE *out) {
+    fprintf(out, "%-10s %12s %14s %14s %14s\n", "subsystem", "count", "bytes", "live", "peak");
+    for (int i = 0; i < ALLOC_SUBSYSTEMS; ++i) {
+        AllocStats s = alloc_stats(i);
+        if (s.count == 0) continue;
+        fprintf(out, "%-10s %12zu %14zu %14zu %14zu\n", subsystem_names[i], s.count, s.bytes, s.live, s.peak);
+    }
+}
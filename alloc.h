@@ -0,0 +1,63 @@
+// one allocator interface for everything
+// builds with -DBIDET_ALLOC_TRACKING count allocations per subsystem and report them at exit,
+// otherwise these are just the libc functions
+// a file says which subsystem it is by defining ALLOC_SUBSYSTEM before including this
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    ALLOC_OTHER,
+    ALLOC_LIST,
+    ALLOC_STRINGS, // slices and interning
+    ALLOC_ERRORS,
+    ALLOC_LEXER,
+    ALLOC_PARSER,
+    ALLOC_GRAPH,
+    ALLOC_LOGS, // depfiles, deps and build logs
+    ALLOC_LOADER,
+    ALLOC_EDITOR,
+    ALLOC_SUBSYSTEMS
+} AllocSubsystem;
+
+typedef struct {
+    size_t count; // allocations, resizes included
+    size_t bytes; // asked for in total
+    size_t live;
+    size_t peak; // most live at once
+} AllocStats;
+
+void *alloc_tracked (AllocSubsystem, size_t);
+void *alloc_tracked_zeroed (AllocSubsystem, size_t, size_t);
+void *alloc_tracked_resize (AllocSubsystem, void *, size_t);
+char *alloc_tracked_strndup (AllocSubsystem, const char *, size_t);
+void alloc_tracked_free (void *);
+AllocStats alloc_stats (AllocSubsystem);
+void alloc_report (FILE *);
+
+#ifndef ALLOC_SUBSYSTEM
+#define ALLOC_SUBSYSTEM ALLOC_OTHER
+#endif
+
+#ifdef BIDET_ALLOC_TRACKING
+#define alloc_bytes(size) alloc_tracked(ALLOC_SUBSYSTEM, size)
+#define alloc_zeroed(count, size) alloc_tracked_zeroed(ALLOC_SUBSYSTEM, count, size)
+#define alloc_resize(ptr, size) alloc_tracked_resize(ALLOC_SUBSYSTEM, ptr, size)
+#define alloc_strdup(str) alloc_tracked_strndup(ALLOC_SUBSYSTEM, str, strlen(str))
+#define alloc_strndup(str, len) alloc_tracked_strndup(ALLOC_SUBSYSTEM, str, len)
+#define alloc_free(ptr) alloc_tracked_free(ptr)
+#else
+#define alloc_bytes(size) malloc(size)
+#define alloc_zeroed(count, size) calloc(count, size)
+#define alloc_resize(ptr, size) realloc(ptr, size)
+#define alloc_strdup(str) strdup(str)
+#define alloc_strndup(str, len) strndup(str, len)
+#define alloc_free(ptr) free(ptr)
+#endif
+
+#endif
@@ -1,5 +1,9 @@
+#ifndef AST_H
+#define AST_H
+
 #include <stddef.h>
 #include "lexer.h"
+#include "vec.h"
 
 // type to maybe be concatted
 typedef struct {
@@ -13,13 +17,19 @@ typedef struct {
     } data;
 } ASTCatee;
 
+// the vecs in lists and concats are nested, so how much is kept inline multiplies out to the size of an action
+// most concats are one catee, most lists up to three elements
+VEC_DECLARE(ASTCatees, ast_catees, ASTCatee, 1)
+
 // ident, string, concat string
 typedef struct {
-    LList catee;
+    ASTCatees catee;
 } ASTConcat;
 
+VEC_DECLARE(ASTConcats, ast_concats, ASTConcat, 3)
+
 typedef struct {
-    LList elems;
+    ASTConcats elems;
 } ASTList;
 
 typedef struct {
@@ -27,4 +37,31 @@ typedef struct {
     StringSlice name;
     ASTList commands;
     ASTList updates;
+    ASTConcat depfile; // no catees if there isn't one
+    bool linkable; // nothing writes its updates in place, so a cache can hardlink them
 } ASTAction;
+
+// name 'value';
+typedef struct {
+    StringSlice name;
+    ASTConcat value;
+} ASTVar;
+
+// include 'path';
+typedef struct {
+    StringSlice path; // relative to the including file's directory
+    size_t offset;
+} ASTInclude;
+
+// the graph points into these, so they're never inline in the ASTProg it could be copied with
+VEC_DECLARE(ASTActions, ast_actions, ASTAction, 0)
+VEC_DECLARE(ASTVars, ast_vars, ASTVar, 0)
+VEC_DECLARE(ASTIncludes, ast_includes, ASTInclude, 0)
+
+typedef struct {
+    ASTActions actions;
+    ASTVars vars;
+    ASTIncludes includes;
+} ASTProg;
+
+#endif
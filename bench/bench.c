@@ -0,0 +1,363 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../alloc.h"
+#include "../build_log.h"
+#include "../fmt_error.h"
+#include "../graph.h"
+#include "../hash.h"
+#include "../jobserver.h"
+#include "../lexer.h"
+#include "../list.h"
+#include "../parser.h"
+#include "../try.h"
+#include "gen.h"
+
+// runs each benchmark until it's taken long enough and prints a json object per line:
+// {"commit": ..., "bench": ..., "input": ..., "iters": ..., "mean_ns": ..., "min_ns": ..., "bytes": ..., "items": ...}
+// items is how many actions, tokens or elements one iteration handles, so mean_ns / items is the cost of one
+// save the output of two commits and compare them line by line
+// usage: bench [name to run only it], commit is from $BENCH_COMMIT
+
+#define MIN_ITERS 5
+#define MIN_NS 500000000LL
+
+static int64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct {
+    const char *name;
+    // run is timed, reset undoes it untimed, either can be NULL
+    void (*run) (void *);
+    void (*reset) (void *);
+    void *arg;
+    const char *input; // what it ran on
+    size_t bytes; // of input, 0 if that doesn't mean anything
+    size_t items;
+} Bench;
+
+// gives the mean, or 0 if it was skipped
+static int64_t run_bench (Bench bench, const char *only) {
+    if (only != NULL && strcmp(only, bench.name) != 0) return 0;
+    const char *commit = getenv("BENCH_COMMIT");
+    int64_t total = 0;
+    int64_t min = INT64_MAX;
+    uint64_t iters = 0;
+    while (iters < MIN_ITERS || total < MIN_NS) {
+        int64_t start = now_ns();
+        bench.run(bench.arg);
+        int64_t elapsed = now_ns() - start;
+        if (bench.reset != NULL) bench.reset(bench.arg);
+        total += elapsed;
+        if (elapsed < min) min = elapsed;
+        ++iters;
+    }
+    printf("{\"commit\": \"%s\", \"bench\": \"%s\", \"input\": \"%s\", \"iters\": %llu, \"mean_ns\": %lld, \"min_ns\": %lld, \"bytes\": %zu, \"items\": %zu}\n",
+        commit == NULL ? "unknown" : commit, bench.name, bench.input, (unsigned long long) iters, (long long) (total / iters), (long long) min, bench.bytes, bench.items);
+    fflush(stdout);
+    return total / iters;
+}
+
+VEC_DECLARE(Ptrs, ptrs, void *, 0)
+VEC_DEFINE(Ptrs, ptrs, void *, 0)
+
+typedef struct {
+    Prog prog;
+    Tokens tokens;
+    ASTProg ast;
+    Graph graph;
+    LList list;
+    Ptrs vec;
+} State;
+
+static void lex_run (void *arg) {
+    State *s = arg;
+    lex(s->prog, &s->tokens);
+}
+
+static void lex_parallel_run (void *arg) {
+    State *s = arg;
+    lex_parallel(s->prog, 4, &s->tokens);
+}
+
+static void tokens_reset (void *arg) {
+    State *s = arg;
+    free_tokens(s->tokens);
+}
+
+static void parse_run (void *arg) {
+    State *s = arg;
+    parse(s->prog, s->tokens, &s->ast);
+}
+
+static void ast_reset (void *arg) {
+    State *s = arg;
+    free_prog(s->ast);
+}
+
+// the offset is at the end, so it walks the whole text
+static void fmt_err_run (void *arg) {
+    State *s = arg;
+    free(fmt_err(s->prog, strlen(s->prog.text) - 1, "benchmark error"));
+}
+
+static void graph_run (void *arg) {
+    State *s = arg;
+    graph_new(&s->prog, &s->ast, 1, &s->graph);
+    graph_resolve(&s->graph, "all");
+}
+
+// lexing and parsing straight into the graph, compare with lex + parse + graph
+static void graph_parse_run (void *arg) {
+    State *s = arg;
+    graph_parse(&s->prog, &s->graph);
+    graph_resolve(&s->graph, "all");
+}
+
+static void graph_reset (void *arg) {
+    State *s = arg;
+    graph_free(s->graph);
+}
+
+#define LIST_LEN 1000000
+
+static void list_run (void *arg) {
+    State *s = arg;
+    s->list = list_new();
+    for (size_t i = 0; i < LIST_LEN; ++i) list_push(&s->list, NULL);
+    if (list_len(s->list) != LIST_LEN) abort();
+}
+
+static void list_reset (void *arg) {
+    State *s = arg;
+    list_free(s->list);
+}
+
+// the same as list_run, to compare with
+static void vec_run (void *arg) {
+    State *s = arg;
+    s->vec = (Ptrs) VEC_EMPTY;
+    for (size_t i = 0; i < LIST_LEN; ++i) *ptrs_push(&s->vec) = NULL;
+    if (s->vec.len != LIST_LEN) abort();
+}
+
+static void vec_reset (void *arg) {
+    State *s = arg;
+    ptrs_free(s->vec);
+}
+
+#define HASH_LEN (64 << 20)
+
+static void hash_bytes_run (void *arg) {
+    volatile uint64_t hash = hash_bytes(arg, HASH_LEN);
+    (void) hash;
+}
+
+// the same input as hash_bytes_run, to compare with
+static void hash_content_run (void *arg) {
+    volatile uint64_t hash = hash_content(arg, HASH_LEN).lo;
+    (void) hash;
+}
+
+// on the hashing pool, started by the first run
+static void hash_content_chunks_run (void *arg) {
+    volatile uint64_t hash = hash_content_chunks(arg, HASH_LEN, 4).lo;
+    (void) hash;
+}
+
+// every benchmark that takes a build file, on opts' file
+// just graph building without front_end
+static void bench_file (GenOptions opts, bool front_end, const char *only) {
+    char input[256];
+    gen_describe(opts, input, sizeof(input));
+    char *text = gen_build_file(opts);
+    size_t bytes = strlen(text);
+    State s;
+    s.prog = (Prog) { .filename = "bench", .text = text };
+
+    size_t tokens = 0;
+    if (front_end) {
+        run_bench((Bench) { "lex", lex_run, tokens_reset, &s, input, bytes, 0 }, only);
+        run_bench((Bench) { "lex_parallel", lex_parallel_run, tokens_reset, &s, input, bytes, 0 }, only);
+    }
+    lex(s.prog, &s.tokens);
+    tokens = s.tokens.len;
+    if (front_end) {
+        run_bench((Bench) { "parse", parse_run, ast_reset, &s, input, bytes, tokens }, only);
+        run_bench((Bench) { "fmt_err", fmt_err_run, NULL, &s, input, bytes, 0 }, only);
+    }
+    parse(s.prog, s.tokens, &s.ast);
+    run_bench((Bench) { "graph", graph_run, graph_reset, &s, input, bytes, opts.actions + 1 }, only);
+    if (front_end) run_bench((Bench) { "graph_parse", graph_parse_run, graph_reset, &s, input, bytes, opts.actions + 1 }, only);
+    free_prog(s.ast);
+    free_tokens(s.tokens);
+    free(text);
+}
+
+#define LOG_ACTIONS 1000000
+// opening a log of LOG_ACTIONS has to stay under this, bench fails otherwise
+#define LOG_OPEN_BUDGET_NS 10000000
+
+typedef struct {
+    char path[64];
+    BuildLog log;
+} LogBench;
+
+// a compacted log of LOG_ACTIONS actions with an output each
+static bool gen_log (const char *path) {
+    BuildLog log;
+    TRYBOOL(build_log_open(path, &log));
+    char name[32];
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < LOG_ACTIONS; ++i) {
+        BuildLogOutput out = { .mtime = i };
+        BuildLogEntry entry = { .start = i, .end = i + 1000 + i % 997, .command_hash = i, .outputs_len = 1, .outputs = &out };
+        sprintf(name, "action%u", i);
+        ok = build_log_name(&log, name, &entry.name);
+        sprintf(name, "out/action%u.o", i);
+        ok = ok && build_log_name(&log, name, &out.path) && build_log_record(&log, entry);
+    }
+    ok = ok && build_log_compact(&log);
+    build_log_close(log);
+    return ok;
+}
+
+static void log_open_run (void *arg) {
+    LogBench *bench = arg;
+    if (!build_log_open(bench->path, &bench->log)) abort();
+}
+
+static void log_open_reset (void *arg) {
+    LogBench *bench = arg;
+    build_log_close(bench->log);
+}
+
+// there's no scheduler yet, so these time what one would sit on:
+// passing jobserver tokens around between threads, and spawning commands
+
+#define JOBSERVER_ROUNDS 10000
+
+typedef struct {
+    Jobserver js;
+    unsigned jobs;
+} JobserverBench;
+
+// a job slot, taking a token for each of its in-process no-op actions
+static void *jobserver_thread (void *arg) {
+    const JobserverBench *bench = arg;
+    for (size_t i = 0; i < JOBSERVER_ROUNDS; ++i) {
+        char token;
+        if (!jobserver_acquire(&bench->js, &token) || !jobserver_release(&bench->js, token)) abort();
+    }
+    return NULL;
+}
+
+static void jobserver_run (void *arg) {
+    JobserverBench *bench = arg;
+    pthread_t threads[64];
+    for (unsigned i = 0; i < bench->jobs; ++i) pthread_create(threads + i, NULL, jobserver_thread, bench);
+    for (unsigned i = 0; i < bench->jobs; ++i) pthread_join(threads[i], NULL);
+}
+
+#define SPAWNS 200
+
+extern char **environ;
+
+// keeps up to jobs `true`s running until SPAWNS have finished
+static void spawn_run (void *arg) {
+    unsigned jobs = *(unsigned *) arg;
+    char *argv[] = { "true", NULL };
+    unsigned running = 0;
+    for (unsigned started = 0; started < SPAWNS || running > 0;) {
+        if (started < SPAWNS && running < jobs) {
+            pid_t pid;
+            if (posix_spawnp(&pid, "true", NULL, NULL, argv, environ) != 0) abort();
+            ++started;
+            ++running;
+        } else {
+            wait(NULL);
+            --running;
+        }
+    }
+}
+
+int main (int argc, char *argv[]) {
+    const char *only = argc > 1 ? argv[1] : NULL;
+
+    GenOptions small = GEN_DEFAULTS;
+    small.actions = 1000;
+    bench_file(small, true, only);
+    bench_file(GEN_DEFAULTS, true, only);
+    GenOptions wide = GEN_DEFAULTS;
+    wide.width = 32;
+    wide.string_len = 64;
+    wide.interpol_percent = 100;
+    bench_file(wide, true, only);
+
+    // graph cost per action for each shape, at a size closer to big builds
+    GenShape shapes[] = { GEN_RANDOM, GEN_WIDE, GEN_DEEP, GEN_DIAMOND };
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i) {
+        GenOptions shaped = GEN_DEFAULTS;
+        shaped.actions = 50000;
+        shaped.width = 1;
+        shaped.shape = shapes[i];
+        bench_file(shaped, false, only);
+    }
+
+    State s;
+    char input[64];
+    run_bench((Bench) { "list_push_len", list_run, list_reset, &s, "len=1000000", 0, LIST_LEN }, only);
+    run_bench((Bench) { "vec_push_len", vec_run, vec_reset, &s, "len=1000000", 0, LIST_LEN }, only);
+
+    char *hash_input = malloc(HASH_LEN);
+    for (size_t i = 0; i < HASH_LEN; ++i) hash_input[i] = (char) i;
+    run_bench((Bench) { "hash_bytes", hash_bytes_run, NULL, hash_input, "len=64MiB", HASH_LEN, HASH_LEN }, only);
+    run_bench((Bench) { "hash_content", hash_content_run, NULL, hash_input, "len=64MiB", HASH_LEN, HASH_LEN }, only);
+    run_bench((Bench) { "hash_content_chunks", hash_content_chunks_run, NULL, hash_input, "len=64MiB threads=4", HASH_LEN, HASH_LEN }, only);
+    free(hash_input);
+
+    int status = 0;
+    if (only == NULL || strcmp(only, "build_log_open") == 0) {
+        char dir[] = "/tmp/bidet_benchXXXXXX";
+        if (mkdtemp(dir) == NULL) return 1;
+        LogBench bench;
+        sprintf(bench.path, "%s/log", dir);
+        if (!gen_log(bench.path)) return 1;
+        struct stat st;
+        stat(bench.path, &st);
+        sprintf(input, "actions=%u", LOG_ACTIONS);
+        int64_t mean = run_bench((Bench) { "build_log_open", log_open_run, log_open_reset, &bench, input, st.st_size, LOG_ACTIONS }, only);
+        if (mean > LOG_OPEN_BUDGET_NS) {
+            fprintf(stderr, "build_log_open took %lldns, over its %dns budget\n", (long long) mean, LOG_OPEN_BUDGET_NS);
+            status = 1;
+        }
+        remove(bench.path);
+        rmdir(dir);
+    }
+
+    unsigned jobs[] = { 1, 4, 16, 64 };
+    for (size_t i = 0; i < sizeof(jobs) / sizeof(jobs[0]); ++i) {
+        // one token per thread, they all go through the same pipe
+        JobserverBench bench = { .jobs = jobs[i] };
+        if (!jobserver_create(JOBSERVER_PIPE, jobs[i] + 1, &bench.js)) return 1;
+        sprintf(input, "j=%u rounds=%u", jobs[i], JOBSERVER_ROUNDS);
+        run_bench((Bench) { "jobserver_tokens", jobserver_run, NULL, &bench, input, 0, jobs[i] * JOBSERVER_ROUNDS }, only);
+        jobserver_free(bench.js);
+
+        sprintf(input, "j=%u spawns=%u", jobs[i], SPAWNS);
+        run_bench((Bench) { "spawn_true", spawn_run, NULL, jobs + i, input, 0, SPAWNS }, only);
+    }
+    return status;
+}
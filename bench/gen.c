@@ -0,0 +1,150 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gen.h"
+
+// actions are a0, a1, ... and only depend on ones before them, ending with an all that depends on everything
+// so resolving all covers the whole file
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Out;
+
+static void out_printf (Out *out, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    while (out->len + len + 1 > out->cap) {
+        out->cap = out->cap == 0 ? 4096 : out->cap * 2;
+        out->data = realloc(out->data, out->cap);
+    }
+    va_start(args, format);
+    vsprintf(out->data + out->len, format, args);
+    va_end(args);
+    out->len += len;
+}
+
+// xorshift, same output everywhere for the same seed
+static uint64_t next_rand (uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// prefix padded out to len characters
+static void out_string (Out *out, const char *prefix, uint32_t len) {
+    out_printf(out, "%s", prefix);
+    for (size_t i = strlen(prefix); i < len; ++i) out_printf(out, "%c", 'a' + (char) (i % 26));
+}
+
+// real builds mostly depend on what's near them, like objects on their sources' generated headers
+#define RECENT_WINDOW 64
+
+static void out_dep (Out *out, uint32_t dep, uint32_t *count) {
+    out_printf(out, "%sa%u", *count == 0 ? "" : ", ", dep);
+    ++*count;
+}
+
+// a's action dependencies, returns how many
+static uint32_t out_deps (Out *out, GenOptions opts, uint32_t a, uint64_t *state) {
+    uint32_t count = 0;
+    switch (opts.shape) {
+        case GEN_RANDOM:
+            if (a == 0) break;
+            // between none and twice fan_in, so fan_in on average
+            for (uint32_t i = next_rand(state) % (2 * opts.fan_in + 1); i > 0; --i) {
+                uint32_t window = a < RECENT_WINDOW || next_rand(state) % 2 ? a : RECENT_WINDOW;
+                out_dep(out, a - 1 - (uint32_t) (next_rand(state) % window), &count);
+            }
+            break;
+        case GEN_WIDE:
+            break;
+        case GEN_DEEP:
+            if (a > 0) out_dep(out, a - 1, &count);
+            break;
+        case GEN_DIAMOND:
+            switch (a % 4) {
+                case 0:
+                    if (a > 0) out_dep(out, a - 1, &count);
+                    break;
+                case 1:
+                case 2:
+                    out_dep(out, a - a % 4, &count);
+                    break;
+                case 3:
+                    out_dep(out, a - 2, &count);
+                    out_dep(out, a - 1, &count);
+                    break;
+            }
+            break;
+    }
+    return count;
+}
+
+static const char *shape_name (GenShape shape) {
+    switch (shape) {
+        case GEN_RANDOM: return "random";
+        case GEN_WIDE: return "wide";
+        case GEN_DEEP: return "deep";
+        case GEN_DIAMOND: return "diamond";
+        default: return "unknown";
+    }
+}
+
+// the text is alloced in here
+char *gen_build_file (GenOptions opts) {
+    Out out = { 0 };
+    uint64_t state = opts.seed == 0 ? 1 : opts.seed;
+    char prefix[64];
+
+    for (uint32_t v = 0; v < opts.vars; ++v) {
+        out_printf(&out, "v%u '", v);
+        out_string(&out, "-O2 ", opts.string_len);
+        out_printf(&out, "';\n");
+    }
+
+    for (uint32_t a = 0; a < opts.actions; ++a) {
+        out_printf(&out, "[");
+        for (uint32_t i = 0; i < opts.width; ++i) {
+            sprintf(prefix, "src/a%u_%u.c", a, i);
+            out_printf(&out, "%s'", i == 0 ? "" : ", ");
+            out_string(&out, prefix, opts.string_len);
+            out_printf(&out, "'");
+        }
+        out_printf(&out, "] > a%u [", a);
+        uint32_t deps = out_deps(&out, opts, a, &state);
+        for (uint32_t i = 0; i < opts.width; ++i) {
+            out_printf(&out, "%s'", deps + i == 0 ? "" : ", ");
+            out_string(&out, "cc -c ", opts.string_len);
+            if (opts.vars > 0 && next_rand(&state) % 100 < opts.interpol_percent) {
+                out_printf(&out, " $(v%u)", (uint32_t) (next_rand(&state) % opts.vars));
+            }
+            out_printf(&out, "'");
+        }
+        out_printf(&out, "] > [");
+        for (uint32_t i = 0; i < opts.width; ++i) {
+            sprintf(prefix, "out/a%u_%u.o", a, i);
+            out_printf(&out, "%s'", i == 0 ? "" : ", ");
+            out_string(&out, prefix, opts.string_len);
+            out_printf(&out, "'");
+        }
+        out_printf(&out, "];\n");
+    }
+
+    out_printf(&out, "[] > all [");
+    for (uint32_t a = 0; a < opts.actions; ++a) out_printf(&out, "%sa%u", a == 0 ? "" : ", ", a);
+    out_printf(&out, "] > [];\n");
+    return out.data;
+}
+
+// e.g. "actions=10000 shape=random fan_in=4 vars=16 width=4 string_len=24 interpol_percent=50 seed=1"
+void gen_describe (GenOptions opts, char *buf, size_t len) {
+    snprintf(buf, len, "actions=%u shape=%s fan_in=%u vars=%u width=%u string_len=%u interpol_percent=%u seed=%llu",
+        opts.actions, shape_name(opts.shape), opts.fan_in, opts.vars, opts.width, opts.string_len, opts.interpol_percent,
+        (unsigned long long) opts.seed);
+}
@@ -0,0 +1,41 @@
+// synthetic build files for benchmarks
+
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdint.h>
+
+// how actions depend on each other
+typedef enum {
+    GEN_RANDOM, // fan_in on average, mostly on recent actions like real builds
+    GEN_WIDE, // none, only all depends on them
+    GEN_DEEP, // each on the one before
+    GEN_DIAMOND // chained diamonds, a top, two sides on it and a bottom on both
+} GenShape;
+
+typedef struct {
+    uint32_t actions;
+    GenShape shape;
+    uint32_t fan_in; // for GEN_RANDOM
+    uint32_t vars;
+    uint32_t width; // elements in every reqs and updates list, and shell commands per action
+    uint32_t string_len; // characters in each string, before interpolations
+    uint32_t interpol_percent; // chance a command interpolates a variable
+    uint64_t seed;
+} GenOptions;
+
+#define GEN_DEFAULTS (GenOptions) { \
+    .actions = 10000, \
+    .shape = GEN_RANDOM, \
+    .fan_in = 4, \
+    .vars = 16, \
+    .width = 4, \
+    .string_len = 24, \
+    .interpol_percent = 50, \
+    .seed = 1 \
+}
+
+char *gen_build_file (GenOptions);
+void gen_describe (GenOptions, char *, size_t);
+
+#endif
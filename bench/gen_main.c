@@ -0,0 +1,55 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gen.h"
+
+static bool option_is (const char *arg, size_t len, const char *name) {
+    return len == strlen(name) && strncmp(arg, name, len) == 0;
+}
+
+// writes a synthetic build file to stdout
+// usage: bench_gen [actions=N] [shape=random|wide|deep|diamond] [fan_in=N] [vars=N] [width=N] [string_len=N] [interpol_percent=N] [seed=N]
+int main (int argc, char *argv[]) {
+    GenOptions opts = GEN_DEFAULTS;
+    for (int i = 1; i < argc; ++i) {
+        char *eq = strchr(argv[i], '=');
+        if (eq == NULL) {
+            fprintf(stderr, "expected name=value, got %s\n", argv[i]);
+            return 1;
+        }
+        unsigned long long value = strtoull(eq + 1, NULL, 10);
+        size_t name_len = eq - argv[i];
+        if (option_is(argv[i], name_len, "actions")) {
+            opts.actions = value;
+        } else if (option_is(argv[i], name_len, "shape")) {
+            const char *shapes[] = { [GEN_RANDOM] = "random", [GEN_WIDE] = "wide", [GEN_DEEP] = "deep", [GEN_DIAMOND] = "diamond" };
+            size_t shape = 0;
+            while (shape < sizeof(shapes) / sizeof(shapes[0]) && strcmp(eq + 1, shapes[shape]) != 0) ++shape;
+            if (shape == sizeof(shapes) / sizeof(shapes[0])) {
+                fprintf(stderr, "unknown shape %s\n", eq + 1);
+                return 1;
+            }
+            opts.shape = shape;
+        } else if (option_is(argv[i], name_len, "fan_in")) {
+            opts.fan_in = value;
+        } else if (option_is(argv[i], name_len, "vars")) {
+            opts.vars = value;
+        } else if (option_is(argv[i], name_len, "width")) {
+            opts.width = value;
+        } else if (option_is(argv[i], name_len, "string_len")) {
+            opts.string_len = value;
+        } else if (option_is(argv[i], name_len, "interpol_percent")) {
+            opts.interpol_percent = value;
+        } else if (option_is(argv[i], name_len, "seed")) {
+            opts.seed = value;
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    char *text = gen_build_file(opts);
+    fputs(text, stdout);
+    free(text);
+    return 0;
+}
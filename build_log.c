@@ -0,0 +1,672 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_LOGS
+#include "alloc.h"
+#include "build_log.h"
+#include "hash.h"
+#include "try.h"
+
+// file layout, everything native endian and 8 aligned so it's used straight from the mapping:
+// Header
+// the compacted table (all of it can be empty):
+//   TableName per name, LogEntry per name (present is 0 for names that are only outputs),
+//   TableUsage per entry that's present, the rank values of each entry's kept runs,
+//   BuildLogOutputs the entries point into, a u32 open addressing index of name id + 1 (0 is empty),
+//   then the names themselves, nul terminated
+// appended records, each a RecordHead then its payload:
+//   name: u64 hash_bytes of the name, the name, 1 to 8 nuls of padding; extra is ~id so a torn write can't pass for a name
+//   entry: LogEntry, its BuildLogUsage then its BuildLogOutputs; extra is the name id
+//   only the run's own usage is appended, the window of recent runs is rebuilt from them on opening
+// a name's record always comes before any entry using its id
+// entries for the same name override earlier ones, and the table's
+
+#define BUILD_LOG_MAGIC "bidetlog\0\0\0"
+#define BUILD_LOG_MAGIC_LEN 12
+#define BUILD_LOG_VERSION 5
+#define ENTRY_RECORD_BIT 0x80000000u
+// anything bigger is garbage
+#define MAX_RECORD_SIZE (1u << 20)
+// compact once the appended records are worth more than a sixteenth of the table
+// keeps the part of the file that has to be walked on open small
+#define COMPACT_MIN_RECORDS 1000
+#define COMPACT_RATIO 16
+
+typedef struct {
+    char magic[BUILD_LOG_MAGIC_LEN];
+    uint32_t version;
+    uint64_t table_end; // appended records start here
+    uint32_t names_len;
+    uint32_t index_cap; // power of two, or 0 if there's no table
+    uint64_t live;
+    uint64_t names_off;
+    uint64_t entries_off;
+    uint64_t usages_off;
+    uint64_t usages_len;
+    uint64_t recent_off;
+    uint64_t recent_len; // rows of BUILD_LOG_RANKS values
+    uint64_t outputs_off;
+    uint64_t outputs_len;
+    uint64_t index_off;
+    uint64_t strings_off;
+} Header;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset; // into the strings
+    uint64_t length;
+} TableName;
+
+typedef struct {
+    int64_t start;
+    int64_t end;
+    uint64_t command_hash;
+    int32_t exit_status;
+    uint32_t runs;
+    uint32_t outputs_len;
+    uint32_t outputs_start; // index into the table's outputs, unused when appended
+    uint32_t usage; // index into the table's usages, unused when appended
+    uint32_t present;
+} LogEntry;
+
+typedef struct {
+    BuildLogUsage usage; // the newest run's
+    uint64_t recent_start; // first of the entry's kept runs' rows, newest first
+} TableUsage;
+
+typedef struct {
+    uint32_t head; // top bit set for entries, the rest is the payload size (a multiple of 8)
+    uint32_t extra;
+} RecordHead;
+
+static size_t align8 (size_t n) {
+    return (n + 7) & ~(size_t) 7;
+}
+
+// the table's header, NULL if there's no table
+static const Header *table (const BuildLog *log) {
+    return log->map;
+}
+
+// how many of runs runs have their rank values kept
+static uint32_t recent_kept (uint32_t runs) {
+    return runs < BUILD_LOG_RECENT_RUNS ? runs : BUILD_LOG_RECENT_RUNS;
+}
+
+// recent is left zeroed
+static BuildLogEntry to_entry (uint32_t name, const LogEntry *entry, BuildLogUsage usage, const BuildLogOutput *outputs) {
+    return (BuildLogEntry) {
+        .name = name,
+        .exit_status = entry->exit_status,
+        .start = entry->start,
+        .end = entry->end,
+        .command_hash = entry->command_hash,
+        .usage = usage,
+        .runs = entry->runs,
+        .outputs_len = entry->outputs_len,
+        .outputs = outputs
+    };
+}
+
+static BuildLogEntry appended_entry (uint32_t name, const LogEntry *entry) {
+    const BuildLogUsage *usage = (const BuildLogUsage *) (entry + 1);
+    return to_entry(name, entry, *usage, (const BuildLogOutput *) (usage + 1));
+}
+
+// only bounds the table's sections, so checking stays o(1)
+static bool table_valid (const void *map, size_t map_len) {
+    TRYBOOL(map_len >= sizeof(Header));
+    const Header *h = map;
+    TRYBOOL(memcmp(h->magic, BUILD_LOG_MAGIC, BUILD_LOG_MAGIC_LEN) == 0 && h->version == BUILD_LOG_VERSION);
+    TRYBOOL(h->table_end <= map_len && h->table_end % 8 == 0);
+    TRYBOOL(h->index_cap == 0 || (h->index_cap & (h->index_cap - 1)) == 0);
+    TRYBOOL(h->names_off >= sizeof(Header) && h->names_off % 8 == 0
+        && h->names_off + h->names_len * sizeof(TableName) <= h->entries_off);
+    TRYBOOL(h->entries_off % 8 == 0 && h->entries_off + h->names_len * sizeof(LogEntry) <= h->usages_off);
+    TRYBOOL(h->usages_off % 8 == 0 && h->usages_off + h->usages_len * sizeof(TableUsage) <= h->recent_off);
+    TRYBOOL(h->recent_off % 8 == 0 && h->recent_off + h->recent_len * sizeof(int64_t[BUILD_LOG_RANKS]) <= h->outputs_off);
+    TRYBOOL(h->outputs_off % 8 == 0 && h->outputs_off + h->outputs_len * sizeof(BuildLogOutput) <= h->index_off);
+    TRYBOOL(h->index_off % 8 == 0 && h->index_off + h->index_cap * sizeof(uint32_t) <= h->strings_off);
+    TRYBOOL(h->strings_off <= h->table_end);
+    return true;
+}
+
+static bool table_lookup (const BuildLog *log, StringSlice name, uint64_t hash, uint32_t *id) {
+    const Header *h = table(log);
+    TRYBOOL(h != NULL && h->index_cap > 0);
+    const char *map = log->map;
+    const TableName *names = (const TableName *) (map + h->names_off);
+    const uint32_t *index = (const uint32_t *) (map + h->index_off);
+    const char *strings = map + h->strings_off;
+    size_t strings_len = h->table_end - h->strings_off;
+
+    size_t mask = h->index_cap - 1;
+    for (size_t slot = hash & mask; index[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t cand = index[slot] - 1;
+        TRYBOOL(cand < h->names_len);
+        const TableName *cand_name = names + cand;
+        if (cand_name->hash == hash && cand_name->length == name.length && cand_name->offset <= strings_len
+                && name.length <= strings_len - cand_name->offset
+                && memcmp(strings + cand_name->offset, name.back + name.start, name.length) == 0) {
+            *id = cand;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ensure_latest (BuildLog *log, uint32_t len) {
+    if (len <= log->latest_cap) return;
+    uint32_t old_cap = log->latest_cap;
+    log->latest_cap = old_cap == 0 ? 64 : old_cap;
+    while (len > log->latest_cap) log->latest_cap *= 2;
+    if (log->latest == NULL) {
+        // big tables get fresh zeroed pages here instead of a memset touching all of them
+        log->latest = alloc_zeroed(log->latest_cap, sizeof(void *));
+    } else {
+        log->latest = alloc_resize(log->latest, log->latest_cap * sizeof(void *));
+        memset(log->latest + old_cap, 0, (log->latest_cap - old_cap) * sizeof(void *));
+    }
+    // recent is only made by the first appended entry
+    if (log->recent != NULL) {
+        log->recent = alloc_resize(log->recent, log->latest_cap * sizeof(*log->recent));
+        memset(log->recent + old_cap, 0, (log->latest_cap - old_cap) * sizeof(*log->recent));
+    }
+}
+
+static void push_name (BuildLog *log, StringSlice name, uint64_t hash) {
+    if (log->names_len == log->names_cap) {
+        log->names_cap = log->names_cap == 0 ? 64 : log->names_cap * 2;
+        log->names = alloc_resize(log->names, log->names_cap * sizeof(StringSlice));
+    }
+    log->names[log->names_len++] = name;
+    interner_add_hashed(&log->index, name, hash);
+    ensure_latest(log, log->table_names_len + log->names_len);
+}
+
+static bool has_table_entry (const BuildLog *log, uint32_t id) {
+    const Header *h = table(log);
+    TRYBOOL(h != NULL && id < h->names_len);
+    return ((const LogEntry *) ((const char *) log->map + h->entries_off))[id].present;
+}
+
+static bool table_find (const BuildLog *log, uint32_t id, BuildLogEntry *entry) {
+    TRYBOOL(has_table_entry(log, id));
+    const Header *h = table(log);
+    const char *map = log->map;
+    const LogEntry *tabled = (const LogEntry *) (map + h->entries_off) + id;
+    TRYBOOL(tabled->outputs_start + (uint64_t) tabled->outputs_len <= h->outputs_len && tabled->usage < h->usages_len);
+    const TableUsage *usage = (const TableUsage *) (map + h->usages_off) + tabled->usage;
+    uint32_t kept = recent_kept(tabled->runs);
+    TRYBOOL(usage->recent_start <= h->recent_len && kept <= h->recent_len - usage->recent_start);
+    const BuildLogOutput *outputs = (const BuildLogOutput *) (map + h->outputs_off);
+    const int64_t (*recent)[BUILD_LOG_RANKS] = (const int64_t (*)[BUILD_LOG_RANKS]) (map + h->recent_off);
+    *entry = to_entry(id, tabled, usage->usage, outputs + tabled->outputs_start);
+    memcpy(entry->recent, recent + usage->recent_start, kept * sizeof(*recent));
+    return true;
+}
+
+// entry is an appended one, its run goes to the front of the name's window, pushing the oldest kept one out
+static void set_latest (BuildLog *log, uint32_t name, const LogEntry *entry) {
+    if (log->latest[name] == NULL && !has_table_entry(log, name)) ++log->live;
+    // so opening a compacted log doesn't pay for it
+    if (log->recent == NULL) log->recent = alloc_zeroed(log->latest_cap, sizeof(*log->recent));
+    int64_t (*window)[BUILD_LOG_RANKS] = log->recent[name];
+    if (window == NULL) {
+        window = alloc_zeroed(BUILD_LOG_RECENT_RUNS, sizeof(*window));
+        list_push(&log->owned_recent, window);
+        log->recent[name] = window;
+        BuildLogEntry tabled;
+        if (table_find(log, name, &tabled)) memcpy(window, tabled.recent, sizeof(tabled.recent));
+    }
+    memmove(window + 1, window, (BUILD_LOG_RECENT_RUNS - 1) * sizeof(*window));
+    BuildLogEntry run = appended_entry(name, entry);
+    for (int i = 0; i < BUILD_LOG_RANKS; ++i) window[0][i] = build_log_rank_value(run, i);
+    log->latest[name] = entry;
+    ++log->appended;
+}
+
+// an empty table, for new logs
+static bool write_header (FILE *file) {
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BUILD_LOG_MAGIC, BUILD_LOG_MAGIC_LEN);
+    h.version = BUILD_LOG_VERSION;
+    h.table_end = h.names_off = h.entries_off = h.usages_off = h.recent_off = h.outputs_off = h.index_off = h.strings_off = sizeof(Header);
+    return fwrite(&h, sizeof(h), 1, file) == 1;
+}
+
+static bool write_name_record (FILE *file, StringSlice name, uint64_t hash, uint32_t id) {
+    // at least one nul so the mapped name is a valid c string
+    size_t padded_len = align8(name.length + 1);
+    RecordHead head = { .head = 8 + padded_len, .extra = ~id };
+    char padding[8] = { 0 };
+    TRYBOOL(fwrite(&head, sizeof(head), 1, file) == 1);
+    TRYBOOL(fwrite(&hash, sizeof(hash), 1, file) == 1);
+    TRYBOOL(fwrite(name.back + name.start, 1, name.length, file) == name.length);
+    TRYBOOL(fwrite(padding, 1, padded_len - name.length, file) == padded_len - name.length);
+    return true;
+}
+
+// walks the records appended after the table, stopping at the first bad or torn one
+// returns how many bytes were valid
+static size_t load_records (BuildLog *log) {
+    const char *map = log->map;
+    size_t offset = table(log)->table_end;
+    while (log->map_len - offset >= sizeof(RecordHead)) {
+        const RecordHead *head = (const RecordHead *) (map + offset);
+        uint32_t size = head->head & ~ENTRY_RECORD_BIT;
+        if (size % 8 != 0 || size > MAX_RECORD_SIZE || size > log->map_len - offset - sizeof(RecordHead)) break;
+
+        const char *payload = map + offset + sizeof(RecordHead);
+        uint32_t names_len = log->table_names_len + log->names_len;
+        if (head->head & ENTRY_RECORD_BIT) {
+            size_t fixed = sizeof(LogEntry) + sizeof(BuildLogUsage);
+            if (size < fixed || head->extra >= names_len) break;
+            const LogEntry *entry = (const LogEntry *) payload;
+            if ((size - fixed) / sizeof(BuildLogOutput) != entry->outputs_len || (size - fixed) % sizeof(BuildLogOutput) != 0) break;
+            const BuildLogOutput *outputs = appended_entry(head->extra, entry).outputs;
+            bool valid = true;
+            for (uint32_t i = 0; valid && i < entry->outputs_len; ++i) valid = outputs[i].path < names_len;
+            if (!valid) break;
+            set_latest(log, head->extra, entry);
+        } else {
+            if (size < 16 || head->extra != ~names_len) break;
+            uint64_t hash = *(const uint64_t *) payload;
+            const char *name = payload + 8;
+            size_t name_len = strnlen(name, size - 8);
+            if (name_len == size - 8) break;
+            push_name(log, (StringSlice) { .start = 0, .length = name_len, .back = name }, hash);
+        }
+        offset += sizeof(RecordHead) + size;
+    }
+    return offset;
+}
+
+// opens (or makes) the log at path
+// torn records at the end are cut off, and the log is compacted once enough has been appended
+bool build_log_open (const char *path, BuildLog *log) {
+    *log = (BuildLog) {
+        .path = alloc_strdup(path),
+        .file = NULL,
+        .map = NULL,
+        .map_len = 0,
+        .table_names_len = 0,
+        .names = NULL,
+        .names_len = 0,
+        .names_cap = 0,
+        .index = interner_new(),
+        .owned_names = list_new(),
+        .owned_records = list_new(),
+        .recent = NULL,
+        .owned_recent = list_new(),
+        .latest = NULL,
+        .latest_cap = 0,
+        .appended = 0,
+        .live = 0
+    };
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            log->map = map;
+            log->map_len = st.st_size;
+        }
+    }
+    if (fd != -1) close(fd);
+
+    if (log->map != NULL && table_valid(log->map, log->map_len)) {
+        log->table_names_len = table(log)->names_len;
+        log->live = table(log)->live;
+        ensure_latest(log, log->table_names_len);
+        size_t valid_len = load_records(log);
+        if (valid_len < log->map_len) {
+            TRYBOOL_R(truncate(path, valid_len) == 0, build_log_close(*log));
+        }
+        log->file = fopen(path, "ab");
+        TRYBOOL_R(log->file != NULL, build_log_close(*log));
+    } else {
+        // missing, empty, broken or from another version: start over
+        if (log->map != NULL) munmap(log->map, log->map_len);
+        log->map = NULL;
+        log->map_len = 0;
+        log->file = fopen(path, "wb");
+        TRYBOOL_R(log->file != NULL, build_log_close(*log));
+        TRYBOOL_R(write_header(log->file) && fflush(log->file) == 0, build_log_close(*log));
+    }
+
+    if (log->appended > COMPACT_MIN_RECORDS && log->appended * COMPACT_RATIO > log->live) {
+        return build_log_compact(log);
+    }
+    return true;
+}
+
+static bool lookup_hashed (const BuildLog *log, StringSlice name, uint64_t hash, uint32_t *id) {
+    if (table_lookup(log, name, hash, id)) return true;
+    TRYBOOL(interner_find(&log->index, name, id));
+    *id += log->table_names_len;
+    return true;
+}
+
+// finds name's id without adding it
+bool build_log_lookup (const BuildLog *log, const char *name, uint32_t *id) {
+    StringSlice name_slice = str_to_slice_raw(name);
+    return lookup_hashed(log, name_slice, hash_bytes(name, name_slice.length), id);
+}
+
+// finds name's id, adding and logging it if it's new
+bool build_log_name (BuildLog *log, const char *name, uint32_t *id) {
+    StringSlice name_slice = str_to_slice_raw(name);
+    uint64_t hash = hash_bytes(name, name_slice.length);
+    if (lookup_hashed(log, name_slice, hash, id)) return true;
+
+    // only taken once it's on disk, so a failed write can't leave the ids here ahead of the file's
+    uint32_t new_id = log->table_names_len + log->names_len;
+    TRYBOOL(write_name_record(log->file, name_slice, hash, new_id) && fflush(log->file) == 0);
+    char *owned = alloc_strdup(name);
+    list_push(&log->owned_names, owned);
+    push_name(log, str_to_slice_raw(owned), hash);
+    *id = new_id;
+    return true;
+}
+
+StringSlice build_log_get_name (const BuildLog *log, uint32_t id) {
+    if (id >= log->table_names_len) return log->names[id - log->table_names_len];
+    const Header *h = table(log);
+    const TableName *name = (const TableName *) ((const char *) log->map + h->names_off) + id;
+    return (StringSlice) {
+        .start = name->offset,
+        .length = name->length,
+        .back = (const char *) log->map + h->strings_off
+    };
+}
+
+// newest entry for the name with id id, false if it never ran
+bool build_log_find (const BuildLog *log, uint32_t id, BuildLogEntry *entry) {
+    TRYBOOL(id < log->table_names_len + log->names_len);
+    if (log->latest[id] != NULL) {
+        *entry = appended_entry(id, log->latest[id]);
+        memcpy(entry->recent, log->recent[id], sizeof(entry->recent));
+        return true;
+    }
+    return table_find(log, id, entry);
+}
+
+// logs a finished action
+// entry.name and the outputs' paths are ids from build_log_name
+bool build_log_record (BuildLog *log, BuildLogEntry entry) {
+    uint32_t names_len = log->table_names_len + log->names_len;
+    TRYBOOL(entry.name < names_len);
+    size_t size = sizeof(LogEntry) + sizeof(BuildLogUsage) + entry.outputs_len * sizeof(BuildLogOutput);
+    TRYBOOL(size <= MAX_RECORD_SIZE);
+
+    // calloc so struct padding goes to disk as zeros
+    char *record = alloc_zeroed(1, sizeof(RecordHead) + size);
+    *(RecordHead *) record = (RecordHead) { .head = size | ENTRY_RECORD_BIT, .extra = entry.name };
+    LogEntry *log_entry = (LogEntry *) (record + sizeof(RecordHead));
+    log_entry->start = entry.start;
+    log_entry->end = entry.end;
+    log_entry->command_hash = entry.command_hash;
+    BuildLogEntry previous;
+    log_entry->runs = build_log_find(log, entry.name, &previous) ? previous.runs + 1 : 1;
+    log_entry->exit_status = entry.exit_status;
+    log_entry->outputs_len = entry.outputs_len;
+    log_entry->present = 1;
+    BuildLogUsage *usage = (BuildLogUsage *) (log_entry + 1);
+    *usage = entry.usage;
+    BuildLogOutput *outputs = (BuildLogOutput *) (usage + 1);
+    for (uint32_t i = 0; i < entry.outputs_len; ++i) {
+        TRYBOOL_R(entry.outputs[i].path < names_len, alloc_free(record));
+        outputs[i].path = entry.outputs[i].path;
+        outputs[i].mtime = entry.outputs[i].mtime;
+        outputs[i].hash = entry.outputs[i].hash;
+    }
+
+    TRYBOOL_R(fwrite(record, 1, sizeof(RecordHead) + size, log->file) == sizeof(RecordHead) + size
+        && fflush(log->file) == 0, alloc_free(record));
+    list_push(&log->owned_records, record);
+    set_latest(log, entry.name, log_entry);
+    return true;
+}
+
+// gives id a spot in the new table if it doesn't have one yet
+static void compact_name (uint32_t *new_ids, uint32_t *old_ids, uint32_t *next_id, uint32_t id) {
+    if (new_ids[id] != UINT32_MAX) return;
+    old_ids[*next_id] = id;
+    new_ids[id] = (*next_id)++;
+}
+
+// rewrites the log as a table of the newest entry per action and the names they use
+// ids get renumbered
+bool build_log_compact (BuildLog *log) {
+    uint32_t names_len = log->table_names_len + log->names_len;
+    size_t ids_cap = names_len > 0 ? names_len : 1;
+    uint32_t *new_ids = alloc_bytes(ids_cap * sizeof(uint32_t));
+    uint32_t *old_ids = alloc_bytes(ids_cap * sizeof(uint32_t));
+    memset(new_ids, 0xff, names_len * sizeof(uint32_t));
+    uint32_t next_id = 0;
+    uint64_t usages_len = 0;
+    uint64_t recent_len = 0;
+    uint64_t outputs_len = 0;
+    uint64_t strings_len = 0;
+
+    // number everything first so the sections' sizes are known
+    BuildLogEntry entry;
+    for (uint32_t id = 0; id < names_len; ++id) {
+        if (!build_log_find(log, id, &entry)) continue;
+        compact_name(new_ids, old_ids, &next_id, id);
+        for (uint32_t i = 0; i < entry.outputs_len; ++i) compact_name(new_ids, old_ids, &next_id, entry.outputs[i].path);
+        ++usages_len;
+        recent_len += recent_kept(entry.runs);
+        outputs_len += entry.outputs_len;
+    }
+    for (uint32_t id = 0; id < next_id; ++id) strings_len += build_log_get_name(log, old_ids[id]).length + 1;
+    uint32_t index_cap = 16;
+    while (index_cap < next_id * 2) index_cap *= 2;
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BUILD_LOG_MAGIC, BUILD_LOG_MAGIC_LEN);
+    h.version = BUILD_LOG_VERSION;
+    h.names_len = next_id;
+    h.index_cap = index_cap;
+    h.live = log->live;
+    h.names_off = sizeof(Header);
+    h.entries_off = h.names_off + next_id * sizeof(TableName);
+    h.usages_off = h.entries_off + next_id * sizeof(LogEntry);
+    h.usages_len = usages_len;
+    h.recent_off = h.usages_off + usages_len * sizeof(TableUsage);
+    h.recent_len = recent_len;
+    h.outputs_off = h.recent_off + recent_len * sizeof(int64_t[BUILD_LOG_RANKS]);
+    h.outputs_len = outputs_len;
+    h.index_off = h.outputs_off + outputs_len * sizeof(BuildLogOutput);
+    h.strings_off = align8(h.index_off + index_cap * sizeof(uint32_t));
+    h.table_end = align8(h.strings_off + strings_len);
+
+    // whole table built in memory then written at once
+    char *out = alloc_zeroed(1, h.table_end);
+    memcpy(out, &h, sizeof(h));
+    TableName *names = (TableName *) (out + h.names_off);
+    LogEntry *entries = (LogEntry *) (out + h.entries_off);
+    TableUsage *usages = (TableUsage *) (out + h.usages_off);
+    int64_t (*recent)[BUILD_LOG_RANKS] = (int64_t (*)[BUILD_LOG_RANKS]) (out + h.recent_off);
+    BuildLogOutput *outputs = (BuildLogOutput *) (out + h.outputs_off);
+    uint32_t *index = (uint32_t *) (out + h.index_off);
+    char *strings = out + h.strings_off;
+    uint32_t usages_pos = 0;
+    uint64_t recent_pos = 0;
+    uint64_t outputs_pos = 0;
+    uint64_t strings_pos = 0;
+    for (uint32_t id = 0; id < next_id; ++id) {
+        StringSlice name = build_log_get_name(log, old_ids[id]);
+        uint64_t hash = hash_bytes(name.back + name.start, name.length);
+        names[id] = (TableName) { .hash = hash, .offset = strings_pos, .length = name.length };
+        memcpy(strings + strings_pos, name.back + name.start, name.length);
+        strings_pos += name.length + 1;
+        size_t slot = hash & (index_cap - 1);
+        while (index[slot] != 0) slot = (slot + 1) & (index_cap - 1);
+        index[slot] = id + 1;
+
+        if (!build_log_find(log, old_ids[id], &entry)) continue;
+        entries[id] = (LogEntry) {
+            .start = entry.start,
+            .end = entry.end,
+            .command_hash = entry.command_hash,
+            .exit_status = entry.exit_status,
+            .runs = entry.runs,
+            .outputs_len = entry.outputs_len,
+            .outputs_start = outputs_pos,
+            .usage = usages_pos,
+            .present = 1
+        };
+        usages[usages_pos++] = (TableUsage) { .usage = entry.usage, .recent_start = recent_pos };
+        uint32_t kept = recent_kept(entry.runs);
+        memcpy(recent + recent_pos, entry.recent, kept * sizeof(*recent));
+        recent_pos += kept;
+        for (uint32_t i = 0; i < entry.outputs_len; ++i, ++outputs_pos) {
+            outputs[outputs_pos].path = new_ids[entry.outputs[i].path];
+            outputs[outputs_pos].mtime = entry.outputs[i].mtime;
+            outputs[outputs_pos].hash = entry.outputs[i].hash;
+        }
+    }
+    alloc_free(new_ids);
+    alloc_free(old_ids);
+
+    char *tmp_path = alloc_bytes(strlen(log->path) + sizeof(".tmp"));
+    sprintf(tmp_path, "%s.tmp", log->path);
+    FILE *tmp = fopen(tmp_path, "wb");
+    bool ok = tmp != NULL && fwrite(out, 1, h.table_end, tmp) == h.table_end;
+    if (tmp != NULL) ok = fclose(tmp) == 0 && ok;
+    alloc_free(out);
+
+    if (ok) ok = rename(tmp_path, log->path) == 0;
+    if (!ok) remove(tmp_path);
+    alloc_free(tmp_path);
+    TRYBOOL(ok);
+
+    // reopening is simpler than fixing every id by hand
+    char *path = alloc_strdup(log->path);
+    build_log_close(*log);
+    bool res = build_log_open(path, log);
+    alloc_free(path);
+    return res;
+}
+
+// for early cutoff, call before recording the run that gave hash
+// whether path, an output of the action with name id action, has other contents than the last time it ran
+// true if nothing says it's the same: the action never ran, didn't update path or it wasn't hashed
+bool build_log_output_changed (const BuildLog *log, uint32_t action, uint32_t path, HashContent hash) {
+    BuildLogEntry entry;
+    if (!build_log_find(log, action, &entry)) return true;
+    HashContent unhashed = { 0, 0 };
+    for (uint32_t i = 0; i < entry.outputs_len; ++i) {
+        if (entry.outputs[i].path != path) continue;
+        return hash_content_equal(entry.outputs[i].hash, unhashed) || !hash_content_equal(entry.outputs[i].hash, hash);
+    }
+    return true;
+}
+
+static int64_t timeval_ns (struct timeval tv) {
+    return (int64_t) tv.tv_sec * 1000000000 + (int64_t) tv.tv_usec * 1000;
+}
+
+// from what wait4 gave for an action's process
+BuildLogUsage build_log_usage (const struct rusage *rusage) {
+    return (BuildLogUsage) {
+        .user_ns = timeval_ns(rusage->ru_utime),
+        .sys_ns = timeval_ns(rusage->ru_stime),
+        .max_rss_kb = rusage->ru_maxrss,
+        .in_blocks = rusage->ru_inblock,
+        .out_blocks = rusage->ru_oublock,
+        .voluntary_switches = rusage->ru_nvcsw,
+        .involuntary_switches = rusage->ru_nivcsw
+    };
+}
+
+// what an entry is ranked by, durations in ns
+int64_t build_log_rank_value (BuildLogEntry entry, BuildLogRank rank) {
+    switch (rank) {
+        case BUILD_LOG_BY_DURATION: return entry.end - entry.start;
+        case BUILD_LOG_BY_CPU: return entry.usage.user_ns + entry.usage.sys_ns;
+        case BUILD_LOG_BY_MAX_RSS: return entry.usage.max_rss_kb;
+        default: return entry.usage.in_blocks + entry.usage.out_blocks;
+    }
+}
+
+// the mean of rank over the newest runs runs, as many as are kept if there are fewer
+int64_t build_log_recent_average (BuildLogEntry entry, BuildLogRank rank, uint32_t runs) {
+    uint32_t kept = recent_kept(entry.runs < runs ? entry.runs : runs);
+    if (kept == 0) return 0;
+    int64_t total = 0;
+    for (uint32_t i = 0; i < kept; ++i) total += entry.recent[i][rank];
+    return total / kept;
+}
+
+typedef struct {
+    int64_t value;
+    uint32_t id;
+} Ranked;
+
+// biggest first, then by id so it's stable
+static int ranked_cmp (const void *a, const void *b) {
+    const Ranked *ra = a;
+    const Ranked *rb = b;
+    if (ra->value != rb->value) return ra->value > rb->value ? -1 : 1;
+    return ra->id < rb->id ? -1 : ra->id > rb->id;
+}
+
+static const char *rank_names[BUILD_LOG_RANKS] = { "wall ms", "cpu ms", "max rss kb", "io blocks" };
+
+// prints the n actions with the highest average of rank over their newest runs runs, one per line,
+// with their newest run and how far it is from the average
+// runs is clamped to 1..BUILD_LOG_RECENT_RUNS, actions that ran fewer times average over what they have
+void build_log_report (const BuildLog *log, BuildLogRank rank, uint32_t runs, uint32_t n, FILE *out) {
+    if (runs == 0) runs = 1;
+    if (runs > BUILD_LOG_RECENT_RUNS) runs = BUILD_LOG_RECENT_RUNS;
+    uint32_t names_len = log->table_names_len + log->names_len;
+    Ranked *ranked = alloc_bytes((names_len > 0 ? names_len : 1) * sizeof(Ranked));
+    uint32_t ranked_len = 0;
+    BuildLogEntry entry;
+    for (uint32_t id = 0; id < names_len; ++id) {
+        if (build_log_find(log, id, &entry)) ranked[ranked_len++] = (Ranked) { build_log_recent_average(entry, rank, runs), id };
+    }
+    qsort(ranked, ranked_len, sizeof(Ranked), ranked_cmp);
+
+    // durations are kept in ns
+    int64_t scale = rank == BUILD_LOG_BY_DURATION || rank == BUILD_LOG_BY_CPU ? 1000000 : 1;
+    fprintf(out, "%-40s %14s %14s %8s %6s\n", "action", rank_names[rank], "newest", "change", "runs");
+    for (uint32_t i = 0; i < ranked_len && i < n; ++i) {
+        build_log_find(log, ranked[i].id, &entry);
+        StringSlice name = build_log_get_name(log, ranked[i].id);
+        int64_t average = ranked[i].value;
+        int64_t newest = build_log_rank_value(entry, rank);
+        fprintf(out, "%-40.*s %14lld %14lld ", (int) name.length, name.back + name.start,
+            (long long) (average / scale), (long long) (newest / scale));
+        if (average != 0) {
+            fprintf(out, "%+7.0f%%", 100.0 * (newest - average) / average);
+        } else {
+            fprintf(out, "%8s", "-");
+        }
+        fprintf(out, " %6u\n", entry.runs);
+    }
+    alloc_free(ranked);
+}
+
+void build_log_close (BuildLog log) {
+    if (log.file != NULL) fclose(log.file);
+    if (log.map != NULL) munmap(log.map, log.map_len);
+    alloc_free(log.names);
+    interner_free(log.index);
+    list_free(log.owned_names);
+    list_free(log.owned_records);
+    alloc_free(log.latest);
+    alloc_free(log.recent);
+    list_free(log.owned_recent);
+    alloc_free(log.path);
+}
@@ -0,0 +1,100 @@
+// append only binary log of every action run
+// what rebuild decisions, scheduling by duration and reports read from
+
+#ifndef BUILD_LOG_H
+#define BUILD_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include "hash.h"
+#include "intern.h"
+#include "list.h"
+
+typedef struct {
+    uint32_t path; // name id
+    int64_t mtime;
+    HashContent hash; // of its contents once the action finished, zero if they weren't hashed
+} BuildLogOutput;
+
+// what an action's processes used, from wait4's rusage
+typedef struct {
+    int64_t user_ns;
+    int64_t sys_ns;
+    int64_t max_rss_kb;
+    int64_t in_blocks;
+    int64_t out_blocks;
+    int64_t voluntary_switches;
+    int64_t involuntary_switches;
+} BuildLogUsage;
+
+// the most of an action's newest runs that build_log_report can average over
+#define BUILD_LOG_RECENT_RUNS 8
+
+// what build_log_report ranks actions by
+typedef enum {
+    BUILD_LOG_BY_DURATION,
+    BUILD_LOG_BY_CPU, // user + sys
+    BUILD_LOG_BY_MAX_RSS,
+    BUILD_LOG_BY_IO, // blocks in + out
+    BUILD_LOG_RANKS
+} BuildLogRank;
+
+typedef struct {
+    uint32_t name; // name id of the action
+    int32_t exit_status;
+    int64_t start; // ns since the epoch
+    int64_t end;
+    uint64_t command_hash; // hash_bytes of the fully expanded commands
+    BuildLogUsage usage;
+    // filled in by the log, ignored when recording
+    uint32_t runs; // how many times it's been recorded
+    // what build_log_report ranks by in the newest runs, newest first, this one included
+    // only the first min(runs, BUILD_LOG_RECENT_RUNS) are used
+    int64_t recent[BUILD_LOG_RECENT_RUNS][BUILD_LOG_RANKS];
+    uint32_t outputs_len;
+    const BuildLogOutput *outputs;
+} BuildLogEntry;
+
+// the file is a compacted table followed by records appended since
+// opening maps it and only walks the appended records, the table is used where it lies
+typedef struct {
+    char *path;
+    FILE *file; // for appending
+    void *map; // whole file as it was when opened, NULL if it was empty
+    size_t map_len;
+    uint32_t table_names_len; // names in the compacted table, they get the first ids
+    // action names and output paths added after the table, ids continue on from it
+    // ones appended before opening point into the mapping
+    StringSlice *names;
+    uint32_t names_len;
+    uint32_t names_cap;
+    Interner index;
+    LList owned_names; // backing for names added since opening
+    LList owned_records; // backing for entries added since opening
+    const void **latest; // indexed by name id, newest appended entry or NULL to use the table's
+    // indexed by name id like latest, BuildLogEntry.recent for names with appended entries
+    // rebuilt from the table's and the appended entries' own runs on opening
+    int64_t (**recent)[BUILD_LOG_RANKS];
+    LList owned_recent; // backing for recent
+    uint32_t latest_cap;
+    size_t appended; // entry records after the table
+    size_t live; // names with entries
+} BuildLog;
+
+bool build_log_open (const char *, BuildLog *);
+bool build_log_lookup (const BuildLog *, const char *, uint32_t *);
+bool build_log_name (BuildLog *, const char *, uint32_t *);
+StringSlice build_log_get_name (const BuildLog *, uint32_t);
+bool build_log_find (const BuildLog *, uint32_t, BuildLogEntry *);
+bool build_log_record (BuildLog *, BuildLogEntry);
+bool build_log_compact (BuildLog *);
+bool build_log_output_changed (const BuildLog *, uint32_t, uint32_t, HashContent);
+BuildLogUsage build_log_usage (const struct rusage *);
+int64_t build_log_rank_value (BuildLogEntry, BuildLogRank);
+int64_t build_log_recent_average (BuildLogEntry, BuildLogRank, uint32_t);
+void build_log_report (const BuildLog *, BuildLogRank, uint32_t, uint32_t, FILE *);
+void build_log_close (BuildLog);
+
+#endif
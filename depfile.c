@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define ALLOC_SUBSYSTEM ALLOC_LOGS
+#include "alloc.h"
+#include "depfile.h"
+#include "fmt_error.h"
+
+static bool is_space (char c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool is_newline (char c) {
+    return c == '\n' || c == '\r';
+}
+
+// length of a backslash continuation at text, 0 if there isn't one
+static size_t continuation_len (const char *text) {
+    if (text[0] != '\\') return 0;
+    if (text[1] == '\n') return 2;
+    if (text[1] == '\r') return text[2] == '\n' ? 3 : 2;
+    return 0;
+}
+
+// parses a makefile style depfile into the prerequisites of all its rules
+// deps gets alloced strings, targets are thrown away
+// handles the escapes gcc writes: "\ " "\#" and "$$"
+bool parse_depfile (Prog prog, LList *deps) {
+    *deps = list_new();
+    const char *text = prog.text;
+    size_t i = 0;
+    // whether this line had its colon yet
+    bool in_prereqs = false;
+    // offset of the first word on this line, for errors
+    size_t rule_start = 0;
+    bool rule_has_words = false;
+
+    char *word = alloc_bytes(strlen(text) + 1);
+    while (true) {
+        // whitespace and continuations
+        size_t cont;
+        while (is_space(text[i]) || (cont = continuation_len(text + i)) > 0) {
+            i += is_space(text[i]) ? 1 : cont;
+        }
+
+        if (text[i] == '\0' || is_newline(text[i])) {
+            if (rule_has_words && !in_prereqs) {
+                report_err(prog, rule_start, "expected ':' in depfile rule\n");
+                alloc_free(word);
+                list_free(*deps);
+                return false;
+            }
+            if (text[i] == '\0') break;
+            in_prereqs = false;
+            rule_has_words = false;
+            ++i;
+            continue;
+        }
+        if (text[i] == '#') {
+            while (text[i] != '\0' && !is_newline(text[i])) ++i;
+            continue;
+        }
+
+        if (!rule_has_words) {
+            rule_start = i;
+            rule_has_words = true;
+        }
+        size_t word_len = 0;
+        bool is_target = false;
+        while (text[i] != '\0' && !is_space(text[i]) && !is_newline(text[i]) && continuation_len(text + i) == 0) {
+            char c = text[i];
+            char c_next = text[i + 1];
+            if (c == '\\' && (c_next == ' ' || c_next == '#')) {
+                word[word_len++] = c_next;
+                i += 2;
+            } else if (c == '$' && c_next == '$') {
+                word[word_len++] = '$';
+                i += 2;
+            } else if (c == ':' && !in_prereqs
+                    && (c_next == '\0' || is_space(c_next) || is_newline(c_next) || continuation_len(text + i + 1) > 0)) {
+                // ':' without whitespace after is part of the path (like c:\)
+                is_target = true;
+                ++i;
+                break;
+            } else {
+                word[word_len++] = c;
+                ++i;
+            }
+        }
+
+        if (is_target) {
+            in_prereqs = true;
+        } else if (in_prereqs && word_len > 0) {
+            char *dep = alloc_bytes(word_len + 1);
+            memcpy(dep, word, word_len);
+            dep[word_len] = '\0';
+            list_push(deps, dep);
+        }
+    }
+    alloc_free(word);
+    return true;
+}
+
+// reads and parses the depfile at path
+// a missing depfile is an error, the action said it'd write one
+bool load_depfile (const char *path, LList *deps) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "[%s] couldn't open depfile\n", path);
+        return false;
+    }
+    size_t text_len = 0;
+    size_t text_cap = 4096;
+    char *text = alloc_bytes(text_cap);
+    size_t read;
+    while ((read = fread(text + text_len, 1, text_cap - text_len - 1, file)) > 0) {
+        text_len += read;
+        if (text_cap - text_len == 1) {
+            text_cap *= 2;
+            text = alloc_resize(text, text_cap);
+        }
+    }
+    fclose(file);
+    text[text_len] = '\0';
+
+    bool res = parse_depfile((Prog) { .filename = path, .text = text }, deps);
+    alloc_free(text);
+    return res;
+}
@@ -0,0 +1,8 @@
+// gcc/clang -MD dependency files
+
+#include <stdbool.h>
+#include "list.h"
+#include "prog.h"
+
+bool parse_depfile (Prog, LList *);
+bool load_depfile (const char *, LList *);
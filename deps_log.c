@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_LOGS
+#include "alloc.h"
+#include "deps_log.h"
+#include "try.h"
+
+// file layout, everything native endian:
+// header: magic then a u32 version
+// records: u32 head, top bit set for deps records, the rest is the payload size (always a multiple of 4)
+//   path: the path, 1 to 4 nuls of padding, then ~id so a torn write can't pass for a path
+//   deps: output id, mtime (i64 as two u32s), then an id per dependency
+// a path's record always comes before any deps record using its id
+// deps records for the same output override earlier ones
+
+#define DEPS_LOG_MAGIC "bidetdeps\0\0"
+#define DEPS_LOG_MAGIC_LEN 12
+#define DEPS_LOG_VERSION 1
+#define DEPS_LOG_HEADER_LEN (DEPS_LOG_MAGIC_LEN + 4)
+#define DEPS_RECORD_BIT 0x80000000u
+// anything bigger is garbage
+#define MAX_RECORD_SIZE (1u << 20)
+// compact once outdated records are most of the file
+#define COMPACT_MIN_RECORDS 1000
+#define COMPACT_RATIO 3
+
+static void set_entry (DepsLog *log, uint32_t out, DepsEntry entry) {
+    if (out >= log->entries_cap) {
+        uint32_t old_cap = log->entries_cap;
+        log->entries_cap = old_cap == 0 ? 64 : old_cap * 2;
+        while (out >= log->entries_cap) log->entries_cap *= 2;
+        log->entries = alloc_resize(log->entries, log->entries_cap * sizeof(DepsEntry));
+        memset(log->entries + old_cap, 0, (log->entries_cap - old_cap) * sizeof(DepsEntry));
+    }
+
+    DepsEntry *old = log->entries + out;
+    if (!old->present) {
+        ++log->live;
+    } else if (old->owned) {
+        alloc_free((uint32_t *) old->ids);
+    }
+    *old = entry;
+}
+
+static bool write_header (FILE *file) {
+    uint32_t version = DEPS_LOG_VERSION;
+    TRYBOOL(fwrite(DEPS_LOG_MAGIC, DEPS_LOG_MAGIC_LEN, 1, file) == 1);
+    TRYBOOL(fwrite(&version, sizeof(version), 1, file) == 1);
+    return true;
+}
+
+static bool write_path_record (FILE *file, StringSlice path, uint32_t id) {
+    // at least one nul so the mapped path is a valid c string
+    uint32_t padded_len = (path.length / 4 + 1) * 4;
+    uint32_t head = padded_len + 4;
+    uint32_t checksum = ~id;
+    char padding[4] = { 0 };
+    TRYBOOL(fwrite(&head, sizeof(head), 1, file) == 1);
+    TRYBOOL(fwrite(path.back + path.start, 1, path.length, file) == path.length);
+    TRYBOOL(fwrite(padding, 1, padded_len - path.length, file) == padded_len - path.length);
+    TRYBOOL(fwrite(&checksum, sizeof(checksum), 1, file) == 1);
+    return true;
+}
+
+static bool write_deps_record (FILE *file, uint32_t out, int64_t mtime, const uint32_t *ids, uint32_t count) {
+    uint32_t size = 12 + 4 * count;
+    TRYBOOL(size <= MAX_RECORD_SIZE);
+    uint32_t head = size | DEPS_RECORD_BIT;
+    TRYBOOL(fwrite(&head, sizeof(head), 1, file) == 1);
+    TRYBOOL(fwrite(&out, sizeof(out), 1, file) == 1);
+    TRYBOOL(fwrite(&mtime, sizeof(mtime), 1, file) == 1);
+    TRYBOOL(fwrite(ids, sizeof(uint32_t), count, file) == count);
+    return true;
+}
+
+// walks the mapped records, stopping at the first bad or torn one
+// returns how many bytes were valid
+static size_t load_records (DepsLog *log) {
+    const char *map = log->map;
+    size_t offset = DEPS_LOG_HEADER_LEN;
+    while (log->map_len - offset >= 4) {
+        uint32_t head;
+        memcpy(&head, map + offset, sizeof(head));
+        uint32_t size = head & ~DEPS_RECORD_BIT;
+        if (size % 4 != 0 || size > MAX_RECORD_SIZE || size > log->map_len - offset - 4) break;
+
+        // records are 4 aligned and so is the mapping
+        const uint32_t *payload = (const uint32_t *) (map + offset + 4);
+        if (head & DEPS_RECORD_BIT) {
+            if (size < 12) break;
+            uint32_t count = (size - 12) / 4;
+            bool valid = payload[0] < log->paths.len;
+            for (uint32_t i = 0; valid && i < count; ++i) valid = payload[3 + i] < log->paths.len;
+            if (!valid) break;
+
+            int64_t mtime;
+            memcpy(&mtime, payload + 1, sizeof(mtime));
+            set_entry(log, payload[0], (DepsEntry) {
+                .ids = payload + 3,
+                .count = count,
+                .mtime = mtime,
+                .owned = false,
+                .present = true
+            });
+            ++log->records;
+        } else {
+            if (size < 8 || payload[size / 4 - 1] != ~log->paths.len) break;
+            const char *path = (const char *) payload;
+            size_t path_len = strnlen(path, size - 4);
+            if (path_len == size - 4) break;
+            uint32_t id = log->paths.len;
+            // the same path twice means ids are off from here
+            if (interner_add(&log->paths, (StringSlice) { .start = 0, .length = path_len, .back = path }) != id) break;
+        }
+        offset += 4 + size;
+    }
+    return offset;
+}
+
+// opens (or makes) the log at path
+// torn records at the end are cut off, and the log is compacted if it's mostly outdated
+bool deps_log_open (const char *path, DepsLog *log) {
+    *log = (DepsLog) {
+        .path = alloc_strdup(path),
+        .file = NULL,
+        .map = NULL,
+        .map_len = 0,
+        .paths = interner_new(),
+        .owned_paths = list_new(),
+        .entries = NULL,
+        .entries_cap = 0,
+        .records = 0,
+        .live = 0
+    };
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && st.st_size >= DEPS_LOG_HEADER_LEN) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            log->map = map;
+            log->map_len = st.st_size;
+        }
+    }
+    if (fd != -1) close(fd);
+
+    uint32_t version = 0;
+    if (log->map != NULL) memcpy(&version, (char *) log->map + DEPS_LOG_MAGIC_LEN, sizeof(version));
+    if (log->map != NULL && memcmp(log->map, DEPS_LOG_MAGIC, DEPS_LOG_MAGIC_LEN) == 0 && version == DEPS_LOG_VERSION) {
+        size_t valid_len = load_records(log);
+        if (valid_len < log->map_len) {
+            TRYBOOL_R(truncate(path, valid_len) == 0, deps_log_close(*log));
+        }
+        log->file = fopen(path, "ab");
+        TRYBOOL_R(log->file != NULL, deps_log_close(*log));
+    } else {
+        // missing, empty or from another version: start over
+        if (log->map != NULL) munmap(log->map, log->map_len);
+        log->map = NULL;
+        log->map_len = 0;
+        log->file = fopen(path, "wb");
+        TRYBOOL_R(log->file != NULL, deps_log_close(*log));
+        TRYBOOL_R(write_header(log->file) && fflush(log->file) == 0, deps_log_close(*log));
+    }
+
+    if (log->records > COMPACT_MIN_RECORDS && log->records > COMPACT_RATIO * log->live) {
+        return deps_log_compact(log);
+    }
+    return true;
+}
+
+// finds path's id, adding and logging it if it's new
+static bool path_id (DepsLog *log, const char *path, uint32_t *id) {
+    if (interner_find(&log->paths, str_to_slice_raw(path), id)) return true;
+
+    // only taken once it's on disk, so a failed write can't leave the ids here ahead of the file's
+    TRYBOOL(write_path_record(log->file, str_to_slice_raw(path), log->paths.len));
+    char *owned = alloc_strdup(path);
+    list_push(&log->owned_paths, owned);
+    *id = interner_add(&log->paths, str_to_slice_raw(owned));
+    return true;
+}
+
+// records out's dependencies (a list of path strings, like from load_depfile) as of mtime
+bool deps_log_record (DepsLog *log, const char *out, int64_t mtime, LList deps) {
+    uint32_t out_id;
+    TRYBOOL(path_id(log, out, &out_id));
+
+    uint32_t count = list_len(deps);
+    uint32_t *ids = alloc_bytes((count > 0 ? count : 1) * sizeof(uint32_t));
+    uint32_t i = 0;
+    for (LLNode *node = deps.head; node != NULL; node = node->next) {
+        TRYBOOL_R(path_id(log, node->data, ids + i++), alloc_free(ids));
+    }
+
+    // nothing changed, no need for another record
+    const DepsEntry *old = out_id < log->entries_cap ? log->entries + out_id : NULL;
+    if (old != NULL && old->present && old->mtime == mtime && old->count == count
+            && memcmp(old->ids, ids, count * sizeof(uint32_t)) == 0) {
+        alloc_free(ids);
+        return true;
+    }
+
+    TRYBOOL_R(write_deps_record(log->file, out_id, mtime, ids, count) && fflush(log->file) == 0, alloc_free(ids));
+    set_entry(log, out_id, (DepsEntry) {
+        .ids = ids,
+        .count = count,
+        .mtime = mtime,
+        .owned = true,
+        .present = true
+    });
+    ++log->records;
+    return true;
+}
+
+// NULL if out has no recorded deps
+// get the dependency paths with interner_get(&log->paths, id)
+const DepsEntry *deps_log_get (const DepsLog *log, const char *out) {
+    uint32_t id;
+    TRYBOOL(interner_find(&log->paths, str_to_slice_raw(out), &id));
+    TRYBOOL(id < log->entries_cap && log->entries[id].present);
+    return log->entries + id;
+}
+
+static bool compact_path (FILE *file, const DepsLog *log, uint32_t *new_ids, uint32_t *next_id, uint32_t id) {
+    if (new_ids[id] != UINT32_MAX) return true;
+    new_ids[id] = (*next_id)++;
+    return write_path_record(file, interner_get(&log->paths, id), new_ids[id]);
+}
+
+// rewrites the log with only the latest deps record per output and the paths they use
+// ids get renumbered
+bool deps_log_compact (DepsLog *log) {
+    char *tmp_path = alloc_bytes(strlen(log->path) + sizeof(".tmp"));
+    sprintf(tmp_path, "%s.tmp", log->path);
+    FILE *tmp = fopen(tmp_path, "wb");
+    TRYBOOL_R(tmp != NULL, alloc_free(tmp_path));
+
+    uint32_t *new_ids = alloc_bytes((log->paths.len > 0 ? log->paths.len : 1) * sizeof(uint32_t));
+    memset(new_ids, 0xff, log->paths.len * sizeof(uint32_t));
+    uint32_t next_id = 0;
+    uint32_t *dep_ids = NULL;
+    uint32_t dep_ids_cap = 0;
+
+    bool ok = write_header(tmp);
+    for (uint32_t out = 0; ok && out < log->entries_cap; ++out) {
+        DepsEntry entry = log->entries[out];
+        if (!entry.present) continue;
+
+        ok = compact_path(tmp, log, new_ids, &next_id, out);
+        if (entry.count > dep_ids_cap) {
+            dep_ids_cap = entry.count;
+            dep_ids = alloc_resize(dep_ids, dep_ids_cap * sizeof(uint32_t));
+        }
+        for (uint32_t i = 0; ok && i < entry.count; ++i) {
+            ok = compact_path(tmp, log, new_ids, &next_id, entry.ids[i]);
+            dep_ids[i] = new_ids[entry.ids[i]];
+        }
+        ok = ok && write_deps_record(tmp, new_ids[out], entry.mtime, dep_ids, entry.count);
+    }
+    ok = fclose(tmp) == 0 && ok;
+    alloc_free(dep_ids);
+    alloc_free(new_ids);
+
+    if (ok) ok = rename(tmp_path, log->path) == 0;
+    if (!ok) remove(tmp_path);
+    alloc_free(tmp_path);
+    TRYBOOL(ok);
+
+    // reopening is simpler than fixing every id by hand
+    char *path = alloc_strdup(log->path);
+    deps_log_close(*log);
+    bool res = deps_log_open(path, log);
+    alloc_free(path);
+    return res;
+}
+
+void deps_log_close (DepsLog log) {
+    if (log.file != NULL) fclose(log.file);
+    for (uint32_t i = 0; i < log.entries_cap; ++i) {
+        if (log.entries[i].present && log.entries[i].owned) alloc_free((uint32_t *) log.entries[i].ids);
+    }
+    alloc_free(log.entries);
+    if (log.map != NULL) munmap(log.map, log.map_len);
+    interner_free(log.paths);
+    list_free(log.owned_paths);
+    alloc_free(log.path);
+}
@@ -0,0 +1,41 @@
+// append only binary log of dependencies found in depfiles
+// paths are interned, deps records only hold path ids
+
+#ifndef DEPS_LOG_H
+#define DEPS_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "intern.h"
+#include "list.h"
+
+// one output's discovered dependencies
+typedef struct {
+    const uint32_t *ids; // path ids, point into the log's mapping unless owned
+    uint32_t count;
+    int64_t mtime; // output's mtime when they were recorded
+    bool owned;
+    bool present;
+} DepsEntry;
+
+typedef struct {
+    char *path;
+    FILE *file; // for appending
+    void *map; // whole file as it was when opened
+    size_t map_len;
+    Interner paths; // paths from the mapping point into it
+    LList owned_paths; // backing for paths added since opening
+    DepsEntry *entries; // indexed by path id
+    uint32_t entries_cap;
+    size_t records; // deps records in the file, including outdated ones
+    size_t live; // outputs with deps
+} DepsLog;
+
+bool deps_log_open (const char *, DepsLog *);
+bool deps_log_record (DepsLog *, const char *, int64_t, LList);
+const DepsEntry *deps_log_get (const DepsLog *, const char *);
+bool deps_log_compact (DepsLog *);
+void deps_log_close (DepsLog);
+
+#endif
@@ -0,0 +1,316 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_GRAPH
+#include "alloc.h"
+#include "dir_cache.h"
+#include "try.h"
+
+// file layout, everything native endian:
+// magic then a u32 version
+// per directory: u32 path length, the path, i64 mtime, u32 entry count,
+//   then per entry: u8 is_dir, u32 name length, the name
+// it's only a cache, so anything malformed just drops the rest
+
+#define DIR_CACHE_MAGIC "bidetdirs\0\0"
+#define DIR_CACHE_MAGIC_LEN 12
+#define DIR_CACHE_VERSION 1
+// anything bigger is garbage
+#define MAX_NAME_LEN (1u << 16)
+#define MAX_ENTRIES (1u << 24)
+// listings that were never read or couldn't be
+#define MTIME_UNKNOWN -1
+
+// what getdents64 fills its buffer with
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+bool is_glob (const char *str) {
+    return strpbrk(str, "*?[") != NULL;
+}
+
+DirCache dir_cache_new () {
+    return (DirCache) {
+        .index = interner_new(),
+        .owned_paths = list_new(),
+        .listings = NULL,
+        .listings_cap = 0,
+        .read = 0,
+        .dirty = false
+    };
+}
+
+static void free_entries (DirListing *listing) {
+    for (uint32_t i = 0; i < listing->len; ++i) alloc_free(listing->entries[i].name);
+    alloc_free(listing->entries);
+    listing->entries = NULL;
+    listing->len = 0;
+}
+
+// finds or adds path's listing, new ones are empty
+static DirListing *listing_for (DirCache *cache, const char *path) {
+    uint32_t id;
+    if (interner_find(&cache->index, str_to_slice_raw(path), &id)) return cache->listings + id;
+
+    char *owned = alloc_strdup(path);
+    list_push(&cache->owned_paths, owned);
+    id = interner_add(&cache->index, str_to_slice_raw(owned));
+    if (id >= cache->listings_cap) {
+        cache->listings_cap = cache->listings_cap == 0 ? 64 : cache->listings_cap * 2;
+        cache->listings = alloc_resize(cache->listings, cache->listings_cap * sizeof(DirListing));
+    }
+    cache->listings[id] = (DirListing) {
+        .mtime = MTIME_UNKNOWN,
+        .entries = NULL,
+        .len = 0,
+        .checked = false
+    };
+    return cache->listings + id;
+}
+
+static void push_entry (DirListing *listing, uint32_t *cap, DirEntry entry) {
+    if (listing->len == *cap) {
+        *cap = *cap == 0 ? 16 : *cap * 2;
+        listing->entries = alloc_resize(listing->entries, *cap * sizeof(DirEntry));
+    }
+    listing->entries[listing->len++] = entry;
+}
+
+static int compare_entries (const void *a, const void *b) {
+    return strcmp(((const DirEntry *) a)->name, ((const DirEntry *) b)->name);
+}
+
+// reads the directory open at fd straight with getdents64, no DIR * buffering on top
+static bool read_dir (int fd, DirListing *listing) {
+    uint64_t buf[4096]; // 8 aligned like the records in it
+    uint32_t cap = 0;
+    long read_len;
+    while ((read_len = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long offset = 0; offset < read_len;) {
+            const struct linux_dirent64 *ent = (const struct linux_dirent64 *) ((const char *) buf + offset);
+            offset += ent->d_reclen;
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+            bool is_dir = ent->d_type == DT_DIR;
+            // not every filesystem fills in the type, and links can be to directories
+            if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+                struct stat st;
+                is_dir = fstatat(fd, ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+            }
+            push_entry(listing, &cap, (DirEntry) { .name = alloc_strdup(ent->d_name), .is_dir = is_dir });
+        }
+    }
+    TRYBOOL(read_len == 0);
+    qsort(listing->entries, listing->len, sizeof(DirEntry), compare_entries);
+    return true;
+}
+
+// path's listing as of now, empty if it can't be read
+// only rereads the directory if its mtime changed since the listing was made
+static DirListing *get_listing (DirCache *cache, const char *path) {
+    DirListing *listing = listing_for(cache, path);
+    if (listing->checked) return listing;
+    listing->checked = true;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    int64_t mtime = MTIME_UNKNOWN;
+    if (fd != -1 && fstat(fd, &st) == 0) mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    if (mtime == MTIME_UNKNOWN || mtime != listing->mtime) {
+        free_entries(listing);
+        listing->mtime = mtime;
+        cache->dirty = true;
+        if (mtime != MTIME_UNKNOWN) {
+            ++cache->read;
+            if (!read_dir(fd, listing)) {
+                free_entries(listing);
+                listing->mtime = MTIME_UNKNOWN;
+            }
+        }
+    }
+    if (fd != -1) close(fd);
+    return listing;
+}
+
+static char *join_path (const char *dir, const char *name) {
+    if (dir[0] == '\0') return alloc_strdup(name);
+    size_t dir_len = strlen(dir);
+    bool slash = dir[dir_len - 1] != '/';
+    char *path = alloc_bytes(dir_len + slash + strlen(name) + 1);
+    sprintf(path, "%s%s%s", dir, slash ? "/" : "", name);
+    return path;
+}
+
+// matches the rest of the pattern's components against what's under dir ("" for the working directory)
+static void glob_in (DirCache *cache, const char *dir, char **parts, size_t parts_len, LList *matches) {
+    if (parts_len == 0) {
+        list_push(matches, alloc_strdup(dir));
+        return;
+    }
+
+    // never in listings
+    if (strcmp(parts[0], ".") == 0 || strcmp(parts[0], "..") == 0) {
+        char *sub = join_path(dir, parts[0]);
+        glob_in(cache, sub, parts + 1, parts_len - 1, matches);
+        alloc_free(sub);
+        return;
+    }
+
+    // copied since globbing subdirectories can move the listings, the entries themselves stay put
+    DirListing listing = *get_listing(cache, dir[0] == '\0' ? "." : dir);
+    bool wild = is_glob(parts[0]);
+    for (uint32_t i = 0; i < listing.len; ++i) {
+        DirEntry entry = listing.entries[i];
+        if (wild ? fnmatch(parts[0], entry.name, FNM_PERIOD) != 0 : strcmp(parts[0], entry.name) != 0) continue;
+        if (parts_len > 1 && !entry.is_dir) continue;
+        char *sub = join_path(dir, entry.name);
+        glob_in(cache, sub, parts + 1, parts_len - 1, matches);
+        alloc_free(sub);
+    }
+}
+
+// pushes the paths matching pattern onto matches, sorted
+// *, ? and [...] work within a path component, like the shell's
+// a pattern without any is its own match, otherwise false if nothing matched
+bool dir_cache_glob (DirCache *cache, const char *pattern, LList *matches) {
+    char *copy = alloc_strdup(pattern);
+    size_t parts_cap = 1;
+    for (const char *c = pattern; *c != '\0'; ++c) parts_cap += *c == '/';
+    char **parts = alloc_bytes(parts_cap * sizeof(char *));
+    size_t parts_len = 0;
+    char *save;
+    for (char *part = strtok_r(copy, "/", &save); part != NULL; part = strtok_r(NULL, "/", &save)) {
+        parts[parts_len++] = part;
+    }
+
+    // the components before the first wildcard don't need listing
+    size_t first_wild = 0;
+    while (first_wild < parts_len && !is_glob(parts[first_wild])) ++first_wild;
+    char *dir = alloc_strdup(pattern[0] == '/' ? "/" : "");
+    for (size_t i = 0; i < first_wild && first_wild < parts_len; ++i) {
+        char *sub = join_path(dir, parts[i]);
+        alloc_free(dir);
+        dir = sub;
+    }
+
+    size_t before = list_len(*matches);
+    if (first_wild < parts_len) {
+        glob_in(cache, dir, parts + first_wild, parts_len - first_wild, matches);
+    } else {
+        list_push(matches, alloc_strdup(pattern));
+    }
+    alloc_free(dir);
+    alloc_free(parts);
+    alloc_free(copy);
+    return list_len(*matches) > before;
+}
+
+static bool read_u32 (FILE *file, uint32_t *n) {
+    return fread(n, sizeof(*n), 1, file) == 1;
+}
+
+// a missing file is an empty cache
+bool dir_cache_load (DirCache *cache, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return true;
+
+    char magic[DIR_CACHE_MAGIC_LEN];
+    uint32_t version;
+    bool ok = fread(magic, DIR_CACHE_MAGIC_LEN, 1, file) == 1 && read_u32(file, &version)
+        && memcmp(magic, DIR_CACHE_MAGIC, DIR_CACHE_MAGIC_LEN) == 0 && version == DIR_CACHE_VERSION;
+    char name[MAX_NAME_LEN + 1];
+    uint32_t len;
+    while (ok && read_u32(file, &len)) {
+        int64_t mtime;
+        uint32_t count;
+        ok = len <= MAX_NAME_LEN && fread(name, 1, len, file) == len && memchr(name, '\0', len) == NULL
+            && fread(&mtime, sizeof(mtime), 1, file) == 1 && read_u32(file, &count) && count <= MAX_ENTRIES;
+        if (!ok) break;
+        name[len] = '\0';
+
+        DirListing listing = { .mtime = mtime, .entries = NULL, .len = 0, .checked = false };
+        uint32_t cap = 0;
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            uint8_t is_dir;
+            uint32_t entry_len;
+            char *entry_name = NULL;
+            ok = fread(&is_dir, 1, 1, file) == 1 && read_u32(file, &entry_len) && entry_len <= MAX_NAME_LEN
+                && (entry_name = alloc_bytes(entry_len + 1)) != NULL && fread(entry_name, 1, entry_len, file) == entry_len;
+            if (ok) {
+                entry_name[entry_len] = '\0';
+                push_entry(&listing, &cap, (DirEntry) { .name = entry_name, .is_dir = is_dir });
+            } else {
+                alloc_free(entry_name);
+            }
+        }
+        if (!ok) {
+            free_entries(&listing);
+            break;
+        }
+
+        // this run's listings win over loaded ones
+        DirListing *old = listing_for(cache, name);
+        if (old->checked) {
+            free_entries(&listing);
+        } else {
+            free_entries(old);
+            *old = listing;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool write_u32 (FILE *file, uint32_t n) {
+    return fwrite(&n, sizeof(n), 1, file) == 1;
+}
+
+// writes the cache out if anything changed since it was loaded, replacing path all at once
+bool dir_cache_save (const DirCache *cache, const char *path) {
+    if (!cache->dirty) return true;
+
+    char *tmp_path = alloc_bytes(strlen(path) + sizeof(".tmp"));
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    TRYBOOL_R(file != NULL, alloc_free(tmp_path));
+
+    bool ok = fwrite(DIR_CACHE_MAGIC, DIR_CACHE_MAGIC_LEN, 1, file) == 1 && write_u32(file, DIR_CACHE_VERSION);
+    for (uint32_t id = 0; ok && id < cache->index.len; ++id) {
+        const DirListing *listing = cache->listings + id;
+        if (listing->mtime == MTIME_UNKNOWN) continue;
+        StringSlice dir = interner_get(&cache->index, id);
+        ok = write_u32(file, dir.length) && fwrite(dir.back + dir.start, 1, dir.length, file) == dir.length
+            && fwrite(&listing->mtime, sizeof(listing->mtime), 1, file) == 1 && write_u32(file, listing->len);
+        for (uint32_t i = 0; ok && i < listing->len; ++i) {
+            uint8_t is_dir = listing->entries[i].is_dir;
+            uint32_t len = strlen(listing->entries[i].name);
+            ok = fwrite(&is_dir, 1, 1, file) == 1 && write_u32(file, len)
+                && fwrite(listing->entries[i].name, 1, len, file) == len;
+        }
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if (ok) ok = rename(tmp_path, path) == 0;
+    if (!ok) remove(tmp_path);
+    alloc_free(tmp_path);
+    return ok;
+}
+
+void dir_cache_free (DirCache cache) {
+    for (uint32_t id = 0; id < cache.index.len; ++id) free_entries(cache.listings + id);
+    alloc_free(cache.listings);
+    interner_free(cache.index);
+    list_free(cache.owned_paths);
+}
@@ -0,0 +1,42 @@
+// directory listings for expanding globs, shared by everything that globs
+// each directory is read at most once a run, and not at all if its mtime matches the saved listing
+
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "intern.h"
+#include "list.h"
+
+typedef struct {
+    char *name;
+    bool is_dir;
+} DirEntry;
+
+typedef struct {
+    int64_t mtime; // the directory's, ns since the epoch
+    DirEntry *entries; // sorted by name, no . or ..
+    uint32_t len;
+    bool checked; // mtime compared against the directory this run
+} DirListing;
+
+typedef struct {
+    Interner index; // directory paths as globbing builds them
+    LList owned_paths; // backing for index
+    DirListing *listings; // by directory id
+    uint32_t listings_cap;
+    uint32_t read; // directories actually read this run
+    bool dirty; // listings changed since loading
+} DirCache;
+
+// true if the string has anything dir_cache_glob would expand
+bool is_glob (const char *);
+
+DirCache dir_cache_new ();
+bool dir_cache_load (DirCache *, const char *);
+bool dir_cache_save (const DirCache *, const char *);
+bool dir_cache_glob (DirCache *, const char *, LList *);
+void dir_cache_free (DirCache);
+
+#endif
@@ -0,0 +1,422 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#define ALLOC_SUBSYSTEM ALLOC_EDITOR
+#include "alloc.h"
+#include "document.h"
+#include "hash.h"
+#include "lexer.h"
+#include "list.h"
+#include "parser.h"
+#include "try.h"
+
+// lexing only carries an offset between tokens, so a span lexes the same alone as it does in the whole text
+// as long as the whole text's lexing would've started a token where the span starts
+// that holds right after a semicolon and its whitespace, except when a string before it never ended:
+// those fail at the quote, and an edit anywhere later could end them
+
+static bool is_quote (char c) {
+    return c == '\'' || c == '`';
+}
+
+static bool is_whitespace (char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool slices_equal (StringSlice a, StringSlice b) {
+    return a.length == b.length && memcmp(a.back + a.start, b.back + b.start, a.length) == 0;
+}
+
+static void add_diagnostic (DocSpan *span, size_t offset, const char *message) {
+    if (span->diagnostics_len == span->diagnostics_cap) {
+        span->diagnostics_cap = span->diagnostics_cap == 0 ? 4 : span->diagnostics_cap * 2;
+        span->diagnostics = alloc_resize(span->diagnostics, span->diagnostics_cap * sizeof(DocDiagnostic));
+    }
+    size_t len = strlen(message);
+    if (len > 0 && message[len - 1] == '\n') --len;
+    span->diagnostics[span->diagnostics_len++] = (DocDiagnostic) { .offset = offset, .message = alloc_strndup(message, len) };
+}
+
+static void lex_report (void *ctx, size_t offset, const char *message) {
+    DocSpan *span = ctx;
+    if (is_quote(span->text[offset])) span->open_quote = true;
+    add_diagnostic(span, offset, message);
+}
+
+static void parse_report (void *ctx, size_t offset, const char *message) {
+    add_diagnostic(ctx, offset, message);
+}
+
+static DocSpan *new_span (const Document *doc, const char *text, size_t len, size_t start) {
+    DocSpan *span = alloc_bytes(sizeof(DocSpan));
+    *span = (DocSpan) {
+        .start = start,
+        .len = len,
+        .text = alloc_strndup(text, len),
+        .diagnostics = NULL,
+        .diagnostics_len = 0,
+        .diagnostics_cap = 0,
+        .open_quote = false
+    };
+    Prog prog = (Prog) { .filename = doc->filename, .text = span->text, .report = lex_report, .report_ctx = span };
+    lex(prog, &span->tokens);
+    // parsed even when lexing failed, an editor wants every error it can get
+    prog.report = parse_report;
+    parse(prog, span->tokens, &span->ast);
+    return span;
+}
+
+static void free_span (DocSpan *span) {
+    for (uint32_t i = 0; i < span->diagnostics_len; ++i) alloc_free(span->diagnostics[i].message);
+    alloc_free(span->diagnostics);
+    free_prog(span->ast);
+    free_tokens(span->tokens);
+    alloc_free(span->text);
+    alloc_free(span);
+}
+
+static uint64_t name_hash (StringSlice name) {
+    return hash_bytes(name.back + name.start, name.length);
+}
+
+static void add_name (Document *doc, uint64_t hash, DocSpan *span);
+
+// rehashes without the removed names
+static void grow_names (Document *doc) {
+    DocName *old = doc->names;
+    uint32_t old_cap = doc->names_cap;
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < old_cap; ++i) live += old[i].span != NULL && !old[i].removed;
+    doc->names_cap = 64;
+    while (doc->names_cap < 4 * live) doc->names_cap *= 2;
+    doc->names = alloc_zeroed(doc->names_cap, sizeof(DocName));
+    doc->names_used = 0;
+    for (uint32_t i = 0; i < old_cap; ++i) {
+        if (old[i].span != NULL && !old[i].removed) add_name(doc, old[i].hash, old[i].span);
+    }
+    alloc_free(old);
+}
+
+static void add_name (Document *doc, uint64_t hash, DocSpan *span) {
+    if (4 * (doc->names_used + 1) > 3 * doc->names_cap) grow_names(doc);
+    uint32_t mask = doc->names_cap - 1;
+    uint32_t slot = hash & mask;
+    while (doc->names[slot].span != NULL) slot = (slot + 1) & mask;
+    doc->names[slot] = (DocName) { .hash = hash, .span = span, .removed = false };
+    ++doc->names_used;
+}
+
+static void remove_name (Document *doc, uint64_t hash, const DocSpan *span) {
+    uint32_t mask = doc->names_cap - 1;
+    for (uint32_t slot = hash & mask; doc->names[slot].span != NULL; slot = (slot + 1) & mask) {
+        DocName *name = doc->names + slot;
+        if (name->span == span && name->hash == hash && !name->removed) {
+            name->removed = true;
+            return;
+        }
+    }
+}
+
+// every action and variable span defines, added or removed
+static void index_span (Document *doc, DocSpan *span, bool add) {
+    VEC_FOREACH(const ASTAction, action, span->ast.actions) {
+        if (add) {
+            add_name(doc, name_hash(action->name), span);
+        } else {
+            remove_name(doc, name_hash(action->name), span);
+        }
+    }
+    VEC_FOREACH(const ASTVar, var, span->ast.vars) {
+        if (add) {
+            add_name(doc, name_hash(var->name), span);
+        } else {
+            remove_name(doc, name_hash(var->name), span);
+        }
+    }
+}
+
+// the span offset is in, the last one for the end of the text
+static uint32_t span_at (const Document *doc, size_t offset) {
+    uint32_t lo = 0;
+    uint32_t hi = doc->spans_len;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (doc->spans[mid]->start <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static size_t spans_end (const Document *doc, uint32_t end) {
+    return end == 0 ? 0 : doc->spans[end - 1]->start + doc->spans[end - 1]->len;
+}
+
+// the text of spans [first, last) with [from, to) replaced by text
+static char *region_text (const Document *doc, uint32_t first, uint32_t last, size_t from, size_t to, const char *text, size_t *len) {
+    size_t start = first < last ? doc->spans[first]->start : 0;
+    size_t old_len = spans_end(doc, last) - start;
+    size_t text_len = strlen(text);
+    *len = old_len - (to - from) + text_len;
+    char *old = alloc_bytes(old_len + 1);
+    for (uint32_t i = first; i < last; ++i) {
+        memcpy(old + doc->spans[i]->start - start, doc->spans[i]->text, doc->spans[i]->len);
+    }
+    char *region = alloc_bytes(*len + 1);
+    memcpy(region, old, from - start);
+    memcpy(region + from - start, text, text_len);
+    memcpy(region + from - start + text_len, old + to - start, old_len - (to - start));
+    region[*len] = '\0';
+    alloc_free(old);
+    return region;
+}
+
+typedef struct {
+    const char *text;
+    bool open_quote;
+} RegionLex;
+
+static void region_lex_report (void *ctx, size_t offset, const char *message) {
+    (void) message;
+    RegionLex *region = ctx;
+    if (is_quote(region->text[offset])) region->open_quote = true;
+}
+
+// replaces [from, to) with text
+// only the spans the edit touches are relexed and reparsed, plus the ones after them
+// until lexing ends on a complete statement again
+bool document_edit (Document *doc, size_t from, size_t to, const char *text) {
+    TRYBOOL(from <= to && to <= doc->len);
+    uint32_t first = 0;
+    uint32_t last = 0;
+    if (doc->spans_len > 0) {
+        first = span_at(doc, from);
+        last = span_at(doc, to > from ? to - 1 : from) + 1;
+    }
+    // an open string could be ended by anything after it
+    for (uint32_t i = 0; doc->open_spans > 0 && i < first; ++i) {
+        if (doc->spans[i]->open_quote) {
+            first = i;
+            break;
+        }
+    }
+    char *region;
+    size_t region_len;
+    Tokens tokens;
+    for (uint32_t extra = 1;; extra *= 2) {
+        region = region_text(doc, first, last, from, to, text, &region_len);
+        // whitespace there belongs to the semicolon before it
+        if (first > 0 && is_whitespace(region[0])) {
+            alloc_free(region);
+            --first;
+            continue;
+        }
+        RegionLex lexed = { .text = region, .open_quote = false };
+        lex((Prog) { .filename = doc->filename, .text = region, .report = region_lex_report, .report_ctx = &lexed }, &tokens);
+        const Token *last_tok = tokens.len == 0 ? NULL : VEC_ITEMS(tokens) + tokens.len - 1;
+        if ((!lexed.open_quote && (last_tok == NULL || last_tok->type == SEMICOLON)) || last == doc->spans_len) break;
+        free_tokens(tokens);
+        alloc_free(region);
+        last = last + extra < doc->spans_len ? last + extra : doc->spans_len;
+    }
+
+    size_t region_start = first < last ? doc->spans[first]->start : 0;
+
+    // a span ends after each semicolon and the whitespace following it
+    LList splits = list_new();
+    uint32_t new_len = 0;
+    size_t span_start = 0;
+    VEC_FOREACH(const Token, tok, tokens) {
+        if (tok->type != SEMICOLON) continue;
+        size_t end = tok->offset + 1;
+        while (is_whitespace(region[end])) ++end;
+        list_push(&splits, new_span(doc, region + span_start, end - span_start, region_start + span_start));
+        ++new_len;
+        span_start = end;
+    }
+    if (span_start < region_len) {
+        list_push(&splits, new_span(doc, region + span_start, region_len - span_start, region_start + span_start));
+        ++new_len;
+    }
+    free_tokens(tokens);
+    alloc_free(region);
+
+    size_t old_len = spans_end(doc, last) - region_start;
+    for (uint32_t i = first; i < last; ++i) {
+        if (doc->spans[i]->open_quote) --doc->open_spans;
+        index_span(doc, doc->spans[i], false);
+        free_span(doc->spans[i]);
+    }
+    uint32_t spans_len = doc->spans_len - (last - first) + new_len;
+    if (spans_len > doc->spans_cap) {
+        doc->spans_cap = doc->spans_cap == 0 ? 64 : doc->spans_cap;
+        while (spans_len > doc->spans_cap) doc->spans_cap *= 2;
+        doc->spans = alloc_resize(doc->spans, doc->spans_cap * sizeof(DocSpan *));
+    }
+    memmove(doc->spans + first + new_len, doc->spans + last, (doc->spans_len - last) * sizeof(DocSpan *));
+    uint32_t i = first;
+    for (LLNode *node = splits.head; node != NULL; node = node->next, ++i) {
+        doc->spans[i] = node->data;
+        if (doc->spans[i]->open_quote) ++doc->open_spans;
+        index_span(doc, doc->spans[i], true);
+    }
+    // the list nodes go, the spans they hold stay
+    for (LLNode *node = splits.head; node != NULL; node = node->next) node->data = NULL;
+    list_free(splits);
+    doc->spans_len = spans_len;
+    // pointer sized work per span, nothing gets relexed
+    for (uint32_t j = first + new_len; j < doc->spans_len; ++j) doc->spans[j]->start += region_len - old_len;
+    doc->len = doc->len + region_len - old_len;
+    return true;
+}
+
+void document_new (const char *filename, const char *text, Document *doc) {
+    *doc = (Document) {
+        .filename = alloc_strdup(filename),
+        .spans = NULL,
+        .spans_len = 0,
+        .spans_cap = 0,
+        .len = 0,
+        .open_spans = 0,
+        .names = NULL,
+        .names_cap = 0,
+        .names_used = 0
+    };
+    document_edit(doc, 0, 0, text);
+}
+
+// the whole text, alloced in here
+char *document_text (const Document *doc) {
+    char *text = alloc_bytes(doc->len + 1);
+    for (uint32_t i = 0; i < doc->spans_len; ++i) {
+        memcpy(text + doc->spans[i]->start, doc->spans[i]->text, doc->spans[i]->len);
+    }
+    text[doc->len] = '\0';
+    return text;
+}
+
+// every diagnostic in order, with offsets into the document
+// the array is alloced in here, the messages are the document's and last until the next edit
+DocDiagnostic *document_diagnostics (const Document *doc, uint32_t *len) {
+    *len = 0;
+    for (uint32_t i = 0; i < doc->spans_len; ++i) *len += doc->spans[i]->diagnostics_len;
+    DocDiagnostic *diagnostics = alloc_bytes((*len > 0 ? *len : 1) * sizeof(DocDiagnostic));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < doc->spans_len; ++i) {
+        const DocSpan *span = doc->spans[i];
+        for (uint32_t j = 0; j < span->diagnostics_len; ++j) {
+            diagnostics[n++] = (DocDiagnostic) {
+                .offset = span->start + span->diagnostics[j].offset,
+                .message = span->diagnostics[j].message
+            };
+        }
+    }
+    return diagnostics;
+}
+
+// the name used at offset in span, an identifier or a $(var) in a string
+// var is set for interpolations, which can only be variables
+static bool name_at (const DocSpan *span, size_t offset, StringSlice *name, bool *var) {
+    VEC_FOREACH(const Token, tok, span->tokens) {
+        if (offset < tok->offset || offset >= tok->offset + tok->length) continue;
+        if (tok->type == IDENT) {
+            *name = tok->data.ident;
+            *var = false;
+            return true;
+        }
+        TRYBOOL(tok->type == STRING);
+        VEC_FOREACH(const InterpolPart, part, tok->data.string.parts) {
+            // from the $( to the )
+            if (part->type == INTERPOL_IDENT && offset + 2 >= part->data.start && offset <= part->data.start + part->data.length) {
+                *name = part->data;
+                *var = true;
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+// names resolve the way the graph resolves them, actions before variables unless it's an interpolation
+// var is set if it's a variable, the first definition in the text wins
+static bool find_definition (const Document *doc, StringSlice name, bool *var, const DocSpan **span, StringSlice *def) {
+    TRYBOOL(doc->names_cap > 0);
+    uint64_t hash = name_hash(name);
+    uint32_t mask = doc->names_cap - 1;
+    for (int vars = *var; vars < 2; ++vars) {
+        *span = NULL;
+        for (uint32_t slot = hash & mask; doc->names[slot].span != NULL; slot = (slot + 1) & mask) {
+            const DocName *entry = doc->names + slot;
+            if (entry->removed || entry->hash != hash || (*span != NULL && entry->span->start > (*span)->start)) continue;
+            if (vars) {
+                VEC_FOREACH(const ASTVar, v, entry->span->ast.vars) {
+                    if (slices_equal(v->name, name)) {
+                        *span = entry->span;
+                        *def = v->name;
+                        break;
+                    }
+                }
+            } else {
+                VEC_FOREACH(const ASTAction, action, entry->span->ast.actions) {
+                    if (slices_equal(action->name, name)) {
+                        *span = entry->span;
+                        *def = action->name;
+                        break;
+                    }
+                }
+            }
+        }
+        if (*span != NULL) {
+            *var = vars;
+            return true;
+        }
+    }
+    return false;
+}
+
+// where the action or variable named at offset is defined
+bool document_definition (const Document *doc, size_t offset, size_t *def_offset) {
+    TRYBOOL(offset < doc->len);
+    const DocSpan *span = doc->spans[span_at(doc, offset)];
+    StringSlice name;
+    bool var;
+    TRYBOOL(name_at(span, offset - span->start, &name, &var));
+    const DocSpan *def_span;
+    StringSlice def;
+    TRYBOOL(find_definition(doc, name, &var, &def_span, &def));
+    *def_offset = def_span->start + def.start;
+    return true;
+}
+
+// the statement defining the variable used at offset, e.g. for $(cflags) "cflags '-Wall';"
+// it points into the document, so it lasts until the next edit
+bool document_hover (const Document *doc, size_t offset, StringSlice *statement) {
+    TRYBOOL(offset < doc->len);
+    const DocSpan *span = doc->spans[span_at(doc, offset)];
+    StringSlice name;
+    bool var;
+    TRYBOOL(name_at(span, offset - span->start, &name, &var));
+    const DocSpan *def_span;
+    StringSlice def;
+    TRYBOOL(find_definition(doc, name, &var, &def_span, &def) && var);
+
+    size_t end = def_span->len;
+    VEC_FOREACH(const Token, tok, def_span->tokens) {
+        if (tok->type == SEMICOLON && tok->offset > def.start) {
+            end = tok->offset + 1;
+            break;
+        }
+    }
+    *statement = (StringSlice) { .start = def.start, .length = end - def.start, .back = def_span->text };
+    return true;
+}
+
+void document_free (Document doc) {
+    for (uint32_t i = 0; i < doc.spans_len; ++i) free_span(doc.spans[i]);
+    alloc_free(doc.spans);
+    alloc_free(doc.names);
+    alloc_free(doc.filename);
+}
@@ -0,0 +1,59 @@
+// a build file open in an editor, reparsed a statement at a time as it's edited
+// the text is kept in spans of one statement each, so an edit only relexes and reparses the spans it touches
+// tokens and asts of every other span are kept, offsets in them are relative to their span
+
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+typedef struct {
+    size_t offset; // into the document from document_diagnostics, into the span in a DocSpan
+    char *message;
+} DocDiagnostic;
+
+// a statement, from its first token through the whitespace after its semicolon
+// the last span can be a partial statement, or several when strings are left open
+typedef struct {
+    size_t start; // in the document, moved by edits before it
+    size_t len;
+    char *text; // just this span's text
+    Tokens tokens;
+    ASTProg ast;
+    DocDiagnostic *diagnostics;
+    uint32_t diagnostics_len;
+    uint32_t diagnostics_cap;
+    bool open_quote; // has a string that didn't end, which text after it could still end
+} DocSpan;
+
+// where an action or variable with this name hash is defined, for lookups that don't walk every span
+typedef struct {
+    uint64_t hash;
+    DocSpan *span; // NULL if the slot is empty
+    bool removed; // left so probing carries on past it
+} DocName;
+
+typedef struct {
+    char *filename;
+    DocSpan **spans; // in order
+    uint32_t spans_len;
+    uint32_t spans_cap;
+    size_t len;
+    uint32_t open_spans; // spans with open_quote
+    DocName *names; // open addressing
+    uint32_t names_cap; // power of two
+    uint32_t names_used; // including removed ones
+} Document;
+
+void document_new (const char *, const char *, Document *);
+bool document_edit (Document *, size_t, size_t, const char *);
+char *document_text (const Document *);
+DocDiagnostic *document_diagnostics (const Document *, uint32_t *);
+bool document_definition (const Document *, size_t, size_t *);
+bool document_hover (const Document *, size_t, StringSlice *);
+void document_free (Document);
+
+#endif
@@ -2,6 +2,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#define ALLOC_SUBSYSTEM ALLOC_ERRORS
+#include "alloc.h"
 #include "fmt_error.h"
 
 // finds line and column of an offset
@@ -55,10 +57,21 @@ char *fmt_err (Prog prog, size_t offset, const char *message) {
             prog.filename,
             offset_line, offset_col,
             message);
-    err = malloc(err_len + 1);
+    err = alloc_bytes(err_len + 1);
     sprintf(err, "[%s at %zu,%zu] %s",
             prog.filename,
             offset_line, offset_col,
             message);
     return err;
 }
+
+// formats and writes the error to prog's errors
+void report_err (Prog prog, size_t offset, const char *message) {
+    if (prog.report != NULL) {
+        prog.report(prog.report_ctx, offset, message);
+        return;
+    }
+    char *err = fmt_err(prog, offset, message);
+    fputs(err, prog.errors == NULL ? stderr : prog.errors);
+    alloc_free(err);
+}
@@ -2,3 +2,4 @@
 #include "prog.h"
 
 char *fmt_err (Prog, size_t, const char *);
+void report_err (Prog, size_t, const char *);
@@ -0,0 +1,1164 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#define ALLOC_SUBSYSTEM ALLOC_GRAPH
+#include "alloc.h"
+#include "fmt_error.h"
+#include "graph.h"
+#include "hash.h"
+#include "parser.h"
+#include "try.h"
+
+VEC_DEFINE(GraphIds, graph_ids, uint32_t, 2)
+
+// reports "message name" at name, in whichever file it's from
+static void name_err (const Graph *g, StringSlice name, const char *message) {
+    char *name_str = slice_to_str(name);
+    char *full = alloc_bytes(strlen(message) + strlen(name_str) + sizeof(" \n"));
+    sprintf(full, "%s %s\n", message, name_str);
+    uint32_t i = 0;
+    while (i < g->progs_len && g->progs[i].text != name.back) ++i;
+    if (i < g->progs_len) {
+        report_err(g->progs[i], name.start, full);
+    } else {
+        // pattern instances' names aren't from any file
+        fprintf(stderr, "[%s] %s", g->progs[0].filename, full);
+    }
+    alloc_free(full);
+    alloc_free(name_str);
+}
+
+// expanding is two passes, one for the exact length and one writing it into the graph's scratch buffer
+// so nothing's allocated unless the result's new, and there's never any copying as it grows
+
+static bool expand_scratch (Graph *, const ASTConcat *, StringSlice, StringSlice *);
+
+// expands a variable's value if nothing has yet, values are kept for every later use
+static bool var_value (Graph *g, StringSlice name, uint32_t *id) {
+    TRYBOOL_R(interner_find(&g->var_index, name, id), name_err(g, name, "undefined variable"));
+    if (g->var_values[*id] != NULL) return true;
+
+    TRYBOOL_R(!g->var_expanding[*id], name_err(g, name, "variable uses itself:"));
+    g->var_expanding[*id] = true;
+    StringSlice value;
+    bool ok = expand_scratch(g, &g->vars[*id]->value, (StringSlice) { 0 }, &value);
+    g->var_expanding[*id] = false;
+    TRYBOOL(ok);
+    g->var_values[*id] = alloc_strndup(value.back, value.length);
+    g->var_lens[*id] = value.length;
+    return true;
+}
+
+// a % in a string becomes stem, unless stem is empty
+static size_t stemmed_len (StringSlice str, StringSlice stem) {
+    size_t len = str.length;
+    const char *start = str.back + str.start;
+    const char *end = start + str.length;
+    const char *percent;
+    while (stem.length > 0 && (percent = memchr(start, '%', end - start)) != NULL) {
+        len += stem.length - 1;
+        start = percent + 1;
+    }
+    return len;
+}
+
+static char *write_stemmed (char *out, StringSlice str, StringSlice stem) {
+    const char *start = str.back + str.start;
+    const char *end = start + str.length;
+    const char *percent;
+    while (stem.length > 0 && (percent = memchr(start, '%', end - start)) != NULL) {
+        memcpy(out, start, percent - start);
+        out += percent - start;
+        memcpy(out, stem.back + stem.start, stem.length);
+        out += stem.length;
+        start = percent + 1;
+    }
+    memcpy(out, start, end - start);
+    return out + (end - start);
+}
+
+// expands every variable concat uses on the way, so writing it can't fail
+// idents are variables here, variables' values don't get stemmed
+static bool concat_len (Graph *g, const ASTConcat *concat, StringSlice stem, size_t *len) {
+    *len = 0;
+    uint32_t id;
+    VEC_FOREACH(const ASTCatee, catee, concat->catee) {
+        if (catee->type == CATEE_IDENT) {
+            TRYBOOL(var_value(g, catee->data.ident, &id));
+            *len += g->var_lens[id];
+            continue;
+        }
+        VEC_FOREACH(const InterpolPart, part, catee->data.interpol_string.parts) {
+            if (part->type == INTERPOL_STRING) {
+                *len += stemmed_len(part->data, stem);
+            } else {
+                TRYBOOL(var_value(g, part->data, &id));
+                *len += g->var_lens[id];
+            }
+        }
+    }
+    return true;
+}
+
+static char *write_var (const Graph *g, char *out, StringSlice name) {
+    uint32_t id;
+    interner_find(&g->var_index, name, &id);
+    memcpy(out, g->var_values[id], g->var_lens[id]);
+    return out + g->var_lens[id];
+}
+
+static void write_concat (const Graph *g, const ASTConcat *concat, StringSlice stem, char *out) {
+    VEC_FOREACH(const ASTCatee, catee, concat->catee) {
+        if (catee->type == CATEE_IDENT) {
+            out = write_var(g, out, catee->data.ident);
+            continue;
+        }
+        VEC_FOREACH(const InterpolPart, part, catee->data.interpol_string.parts) {
+            out = part->type == INTERPOL_STRING ? write_stemmed(out, part->data, stem) : write_var(g, out, part->data);
+        }
+    }
+    *out = '\0';
+}
+
+// out is null terminated and only valid until the next expansion
+static bool expand_scratch (Graph *g, const ASTConcat *concat, StringSlice stem, StringSlice *out) {
+    size_t len;
+    TRYBOOL(concat_len(g, concat, stem, &len));
+    if (len + 1 > g->scratch_cap) {
+        g->scratch_cap = g->scratch_cap == 0 ? 256 : g->scratch_cap;
+        while (len + 1 > g->scratch_cap) g->scratch_cap *= 2;
+        alloc_free(g->scratch);
+        g->scratch = alloc_bytes(g->scratch_cap);
+    }
+    write_concat(g, concat, stem, g->scratch);
+    *out = str_to_slice(g->scratch, 0, len);
+    return true;
+}
+
+static int64_t stat_mtime (const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return GRAPH_MTIME_MISSING;
+    return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// the one copy of an expanded command or output, only allocated the first time
+static const char *intern_string (Graph *g, StringSlice str) {
+    uint32_t id;
+    if (interner_find(&g->strings, str, &id)) return interner_get(&g->strings, id).back;
+    char *owned = alloc_strndup(str.back + str.start, str.length);
+    list_push(&g->owned_strings, owned);
+    interner_add(&g->strings, str_to_slice(owned, 0, str.length));
+    return owned;
+}
+
+static uint64_t hash_slice (uint64_t hash, StringSlice slice) {
+    hash = hash_bytes_continue(hash, &slice.length, sizeof(slice.length));
+    return hash_bytes_continue(hash, slice.back + slice.start, slice.length);
+}
+
+static bool slices_equal (StringSlice a, StringSlice b) {
+    return a.length == b.length && memcmp(a.back + a.start, b.back + b.start, a.length) == 0;
+}
+
+// hashes what's written, not where, so repeats of the same expression anywhere hash the same
+static uint64_t hash_concat (const ASTConcat *concat, StringSlice stem) {
+    uint64_t hash = hash_slice(hash_bytes(&concat->catee.len, sizeof(concat->catee.len)), stem);
+    VEC_FOREACH(const ASTCatee, catee, concat->catee) {
+        hash = hash_bytes_continue(hash, &catee->type, sizeof(catee->type));
+        if (catee->type == CATEE_IDENT) {
+            hash = hash_slice(hash, catee->data.ident);
+            continue;
+        }
+        VEC_FOREACH(const InterpolPart, part, catee->data.interpol_string.parts) {
+            hash = hash_bytes_continue(hash, &part->type, sizeof(part->type));
+            hash = hash_slice(hash, part->data);
+        }
+    }
+    return hash;
+}
+
+static bool concats_equal (const ASTConcat *a, const ASTConcat *b) {
+    TRYBOOL(a->catee.len == b->catee.len);
+    for (uint32_t i = 0; i < a->catee.len; ++i) {
+        const ASTCatee *ca = VEC_ITEMS(a->catee) + i;
+        const ASTCatee *cb = VEC_ITEMS(b->catee) + i;
+        TRYBOOL(ca->type == cb->type);
+        if (ca->type == CATEE_IDENT) {
+            TRYBOOL(slices_equal(ca->data.ident, cb->data.ident));
+            continue;
+        }
+        const InterpolParts *pa = &ca->data.interpol_string.parts;
+        const InterpolParts *pb = &cb->data.interpol_string.parts;
+        TRYBOOL(pa->len == pb->len);
+        for (uint32_t j = 0; j < pa->len; ++j) {
+            TRYBOOL(VEC_ITEMS(*pa)[j].type == VEC_ITEMS(*pb)[j].type);
+            TRYBOOL(slices_equal(VEC_ITEMS(*pa)[j].data, VEC_ITEMS(*pb)[j].data));
+        }
+    }
+    return true;
+}
+
+static void grow_expansions (Graph *g) {
+    GraphExpansion *old = g->expansions;
+    uint32_t old_cap = g->expansions_cap;
+    g->expansions_cap = old_cap == 0 ? 256 : old_cap * 2;
+    g->expansions = alloc_zeroed(g->expansions_cap, sizeof(GraphExpansion));
+    for (uint32_t i = 0; i < old_cap; ++i) {
+        if (old[i].concat == NULL) continue;
+        uint32_t slot = old[i].hash & (g->expansions_cap - 1);
+        while (g->expansions[slot].concat != NULL) slot = (slot + 1) & (g->expansions_cap - 1);
+        g->expansions[slot] = old[i];
+    }
+    alloc_free(old);
+}
+
+static bool has_vars (const ASTConcat *concat) {
+    VEC_FOREACH(const ASTCatee, catee, concat->catee) {
+        if (catee->type == CATEE_IDENT) return true;
+        VEC_FOREACH(const InterpolPart, part, catee->data.interpol_string.parts) {
+            if (part->type == INTERPOL_IDENT) return true;
+        }
+    }
+    return false;
+}
+
+// expand_concat for commands, into the one shared copy of the result
+// variables can't change once defined, so a concat written the same way always expands the same
+// ones without variables are only interned, hashing them to look them up would cost as much as expanding
+static bool expand_shared (Graph *g, const ASTConcat *concat, StringSlice stem, const char **out) {
+    StringSlice str;
+    if (!has_vars(concat)) {
+        expand_scratch(g, concat, stem, &str);
+        *out = intern_string(g, str);
+        return true;
+    }
+
+    uint64_t hash = hash_concat(concat, stem);
+    uint32_t slot = 0;
+    if (g->expansions_cap > 0) {
+        slot = hash & (g->expansions_cap - 1);
+        for (GraphExpansion *e; (e = g->expansions + slot)->concat != NULL; slot = (slot + 1) & (g->expansions_cap - 1)) {
+            if (e->hash == hash && slices_equal(e->stem, stem) && concats_equal(e->concat, concat)) {
+                *out = e->str;
+                return true;
+            }
+        }
+    }
+
+    TRYBOOL(expand_scratch(g, concat, stem, &str));
+    *out = intern_string(g, str);
+    if ((g->expansions_len + 1) * 2 > g->expansions_cap) {
+        grow_expansions(g);
+        slot = hash & (g->expansions_cap - 1);
+        while (g->expansions[slot].concat != NULL) slot = (slot + 1) & (g->expansions_cap - 1);
+    }
+    g->expansions[slot] = (GraphExpansion) { .hash = hash, .concat = concat, .stem = stem, .str = *out };
+    ++g->expansions_len;
+    return true;
+}
+
+// interns an expanded path, taking owned if it's new or freeing it if not
+// with owned NULL a new path is copied, so expanding one that's already known allocates nothing
+// new paths get stat'd here, so only reachable files ever are
+static uint32_t intern_path (Graph *g, StringSlice path, char *owned) {
+    uint32_t id;
+    if (interner_find(&g->paths, path, &id)) {
+        alloc_free(owned);
+        return id;
+    }
+
+    if (owned == NULL) owned = alloc_strndup(path.back + path.start, path.length);
+    list_push(&g->owned_paths, owned);
+    id = interner_add(&g->paths, str_to_slice(owned, 0, path.length));
+    if (id >= g->mtimes_cap) {
+        g->mtimes_cap = g->mtimes_cap == 0 ? 64 : g->mtimes_cap * 2;
+        g->mtimes = alloc_resize(g->mtimes, g->mtimes_cap * sizeof(int64_t));
+        g->producers = alloc_resize(g->producers, g->mtimes_cap * sizeof(uint32_t));
+        g->consumers = alloc_resize(g->consumers, g->mtimes_cap * sizeof(GraphIds));
+    }
+    g->mtimes[id] = stat_mtime(owned);
+    g->producers[id] = GRAPH_NO_NODE;
+    g->consumers[id] = (GraphIds) VEC_EMPTY;
+    return id;
+}
+
+static void push_path (Graph *g, uint32_t **ids, uint32_t *len, size_t *cap, StringSlice path, char *owned) {
+    if (*len == *cap) {
+        *cap *= 2;
+        *ids = alloc_resize(*ids, *cap * sizeof(uint32_t));
+    }
+    (*ids)[(*len)++] = intern_path(g, path, owned);
+}
+
+// globs become every path they match, in order
+static bool expand_paths (Graph *g, const ASTList *list, StringSlice stem, uint32_t **ids, uint32_t *len) {
+    size_t cap = list->elems.len > 0 ? list->elems.len : 1;
+    *ids = alloc_bytes(cap * sizeof(uint32_t));
+    *len = 0;
+    VEC_FOREACH(const ASTConcat, concat, list->elems) {
+        StringSlice path;
+        TRYBOOL(expand_scratch(g, concat, stem, &path));
+        if (!is_glob(path.back)) {
+            push_path(g, ids, len, &cap, path, NULL);
+            continue;
+        }
+
+        LList matches = list_new();
+        dir_cache_glob(&g->dirs, path.back, &matches);
+        for (LLNode *match = matches.head; match != NULL; match = match->next) {
+            push_path(g, ids, len, &cap, str_to_slice_raw(match->data), match->data);
+            match->data = NULL;
+        }
+        list_free(matches);
+    }
+    return true;
+}
+
+// makes room for len nodes
+static void grow_nodes (Graph *g, uint32_t len) {
+    if (len <= g->nodes_cap) return;
+    uint32_t old_cap = g->nodes_cap;
+    g->nodes_cap = old_cap == 0 ? 64 : old_cap * 2;
+    while (len > g->nodes_cap) g->nodes_cap *= 2;
+    g->nodes = alloc_resize(g->nodes, g->nodes_cap * sizeof(GraphNode));
+    memset(g->nodes + old_cap, 0, (g->nodes_cap - old_cap) * sizeof(GraphNode));
+    g->order = alloc_resize(g->order, g->nodes_cap * sizeof(uint32_t));
+}
+
+// matches name against "prefix%suffix", the stem can't be empty
+static bool match_pattern (StringSlice pattern, StringSlice name, StringSlice *stem) {
+    const char *pat = pattern.back + pattern.start;
+    const char *percent = memchr(pat, '%', pattern.length);
+    size_t prefix_len = percent - pat;
+    size_t suffix_len = pattern.length - prefix_len - 1;
+    const char *str = name.back + name.start;
+    TRYBOOL(name.length > prefix_len + suffix_len);
+    TRYBOOL(memcmp(str, pat, prefix_len) == 0);
+    TRYBOOL(memcmp(str + name.length - suffix_len, percent + 1, suffix_len) == 0);
+    *stem = str_to_slice(str, prefix_len, name.length - prefix_len - suffix_len);
+    return true;
+}
+
+// finds the node for an action name, instantiating a pattern if that's what matches
+// the pattern with the shortest stem wins, like make
+static bool find_node (Graph *g, StringSlice name, uint32_t *idx) {
+    if (interner_find(&g->action_index, name, idx)) return true;
+    uint32_t id;
+    if (interner_find(&g->instance_index, name, &id)) {
+        *idx = g->actions_len + id;
+        return true;
+    }
+
+    const ASTAction *best = NULL;
+    size_t best_len = 0;
+    for (uint32_t i = 0; i < g->patterns_len; ++i) {
+        StringSlice stem;
+        if (match_pattern(g->patterns[i]->name, name, &stem) && (best == NULL || stem.length < best_len)) {
+            best = g->patterns[i];
+            best_len = stem.length;
+        }
+    }
+    TRYBOOL(best != NULL);
+
+    // the instance owns its name so the stem can point into it
+    char *owned = slice_to_str(name);
+    list_push(&g->owned_names, owned);
+    interner_add(&g->instance_index, str_to_slice_raw(owned));
+    grow_nodes(g, g->nodes_len + 1);
+    *idx = g->nodes_len++;
+    StringSlice stem;
+    match_pattern(best->name, str_to_slice_raw(owned), &stem);
+    g->nodes[*idx].action = best;
+    g->nodes[*idx].stem = stem;
+    return true;
+}
+
+// a lone identifier naming an action is a dependency, anything else is a shell command
+// dependencies are only recorded, resolve_from visits them
+// takes an index since instantiating patterns can move the nodes
+static bool expand_commands (Graph *g, uint32_t idx) {
+    const ASTList *list = &g->nodes[idx].action->commands;
+    StringSlice stem = g->nodes[idx].stem;
+    GraphCommand *commands = alloc_bytes((list->elems.len > 0 ? list->elems.len : 1) * sizeof(GraphCommand));
+    uint32_t commands_len = 0;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < list->elems.len; ++i) {
+        const ASTConcat *concat = VEC_ITEMS(list->elems) + i;
+        const ASTCatee *first = VEC_ITEMS(concat->catee);
+        uint32_t dep;
+        // variables shadow patterns, not the other way around
+        if (concat->catee.len == 1 && first->type == CATEE_IDENT
+                && (interner_find(&g->action_index, first->data.ident, &dep)
+                || (!interner_find(&g->var_index, first->data.ident, &dep)
+                && find_node(g, first->data.ident, &dep)))) {
+            commands[commands_len++] = (GraphCommand) {
+                .type = COMMAND_ACTION,
+                .data.action = dep
+            };
+        } else {
+            const char *command;
+            ok = expand_shared(g, concat, stem, &command);
+            if (ok) {
+                commands[commands_len++] = (GraphCommand) {
+                    .type = COMMAND_SHELL,
+                    .data.shell = command
+                };
+            }
+        }
+    }
+    g->nodes[idx].commands = commands;
+    g->nodes[idx].commands_len = commands_len;
+    return ok;
+}
+
+// an output claimed by two actions is an error, reported against the second
+static bool index_paths (Graph *g, uint32_t idx) {
+    const GraphNode *node = g->nodes + idx;
+    for (uint32_t i = 0; i < node->reqs_len; ++i) {
+        GraphIds *consumers = g->consumers + node->reqs[i];
+        if (consumers->len == 0 || VEC_ITEMS(*consumers)[consumers->len - 1] != idx) *graph_ids_push(consumers) = idx;
+    }
+    bool ok = true;
+    for (uint32_t i = 0; i < node->updates_len; ++i) {
+        uint32_t *producer = g->producers + node->updates[i];
+        if (*producer == GRAPH_NO_NODE || *producer == idx) {
+            *producer = idx;
+            continue;
+        }
+        StringSlice path = interner_get(&g->paths, node->updates[i]);
+        StringSlice other = g->nodes[*producer].action->name;
+        if (g->nodes[*producer].stem.length > 0) other = interner_get(&g->instance_index, *producer - g->actions_len);
+        char *message = alloc_bytes(path.length + other.length + sizeof(" is updated by  and"));
+        sprintf(message, "%.*s is updated by %.*s and", (int) path.length, path.back + path.start, (int) other.length, other.back + other.start);
+        name_err(g, node->stem.length > 0 ? interner_get(&g->instance_index, idx - g->actions_len) : node->action->name, message);
+        alloc_free(message);
+        ok = false;
+    }
+    return ok;
+}
+
+// adds what the deps log has for the node's updates to its reqs, each path once
+// index_paths has made the node the last consumer of every req it has, which is how repeats are spotted
+static void push_found (Graph *g, uint32_t idx) {
+    GraphNode *node = g->nodes + idx;
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < node->updates_len; ++i) {
+        const DepsEntry *entry = deps_log_get(g->deps, interner_get(&g->paths, node->updates[i]).back);
+        if (entry != NULL) found += entry->count;
+    }
+    if (found == 0) return;
+
+    node->reqs = alloc_resize(node->reqs, (node->reqs_len + found) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < node->updates_len; ++i) {
+        const DepsEntry *entry = deps_log_get(g->deps, interner_get(&g->paths, node->updates[i]).back);
+        for (uint32_t j = 0; entry != NULL && j < entry->count; ++j) {
+            uint32_t id = intern_path(g, interner_get(&g->deps->paths, entry->ids[j]), NULL);
+            GraphIds *consumers = g->consumers + id;
+            if (consumers->len > 0 && VEC_ITEMS(*consumers)[consumers->len - 1] == idx) continue;
+            *graph_ids_push(consumers) = idx;
+            node->reqs[node->reqs_len++] = id;
+            ++node->found_len;
+        }
+    }
+}
+
+static bool expand_node (Graph *g, uint32_t idx) {
+    GraphNode *node = g->nodes + idx;
+    TRYBOOL(expand_paths(g, &node->action->reqs, node->stem, &node->reqs, &node->reqs_len));
+    TRYBOOL(expand_commands(g, idx));
+    node = g->nodes + idx;
+    TRYBOOL(expand_paths(g, &node->action->updates, node->stem, &node->updates, &node->updates_len));
+    if (node->action->depfile.catee.len > 0) TRYBOOL(expand_shared(g, &node->action->depfile, node->stem, &node->depfile));
+    TRYBOOL(index_paths(g, idx));
+    if (g->deps != NULL) push_found(g, idx);
+    return true;
+}
+
+// undoes what a failed expand_node did, so nothing is left pointing at half an expansion
+// index_paths made the node the last consumer of its reqs, nothing else has come since
+static void clear_node (Graph *g, uint32_t idx) {
+    GraphNode *node = g->nodes + idx;
+    for (uint32_t i = 0; i < node->reqs_len; ++i) {
+        GraphIds *consumers = g->consumers + node->reqs[i];
+        if (consumers->len > 0 && VEC_ITEMS(*consumers)[consumers->len - 1] == idx) --consumers->len;
+    }
+    for (uint32_t i = 0; i < node->updates_len; ++i) {
+        if (g->producers[node->updates[i]] == idx) g->producers[node->updates[i]] = GRAPH_NO_NODE;
+    }
+    alloc_free(node->reqs);
+    alloc_free(node->commands);
+    alloc_free(node->updates);
+    node->reqs = NULL;
+    node->reqs_len = 0;
+    node->found_len = 0;
+    node->commands = NULL;
+    node->commands_len = 0;
+    node->updates = NULL;
+    node->updates_len = 0;
+    node->depfile = NULL;
+    node->failed = true;
+}
+
+// depth first from root, without recursion so deep graphs can't blow the stack
+// a node is expanded when first reached and resolved once all its dependencies are
+static bool resolve_from (Graph *g, uint32_t root) {
+    size_t stack_cap = 64;
+    size_t stack_len = 0;
+    uint32_t *stack = alloc_bytes(stack_cap * sizeof(uint32_t));
+    stack[stack_len++] = root;
+
+    bool ok = true;
+    while (ok && stack_len > 0) {
+        uint32_t idx = stack[stack_len - 1];
+        GraphNode *node = g->nodes + idx;
+        if (node->resolved) {
+            --stack_len;
+            continue;
+        }
+
+        if (node->failed) {
+            ok = false;
+            break;
+        }
+
+        if (!node->resolving) {
+            node->resolving = true;
+            if (!node->expanded) {
+                if (idx < g->actions_len) node->action = g->actions[idx];
+                ok = expand_node(g, idx);
+                if (!ok) clear_node(g, idx);
+                node = g->nodes + idx;
+                node->expanded = ok;
+            }
+        }
+
+        bool waiting = false;
+        for (uint32_t i = 0; ok && i < node->commands_len; ++i) {
+            if (node->commands[i].type != COMMAND_ACTION) continue;
+            GraphNode *dep = g->nodes + node->commands[i].data.action;
+            if (dep->resolved) continue;
+            if (dep->resolving) {
+                name_err(g, dep->action->name, "dependency cycle through");
+                ok = false;
+                break;
+            }
+            if (stack_len == stack_cap) {
+                stack_cap *= 2;
+                stack = alloc_resize(stack, stack_cap * sizeof(uint32_t));
+            }
+            stack[stack_len++] = node->commands[i].data.action;
+            waiting = true;
+        }
+
+        if (ok && !waiting) {
+            node->resolving = false;
+            node->resolved = true;
+            g->order[g->order_len++] = idx;
+            --stack_len;
+        }
+    }
+
+    // anything left resolving was cut off by the error
+    for (size_t i = 0; i < stack_len; ++i) g->nodes[stack[i]].resolving = false;
+    alloc_free(stack);
+    return ok;
+}
+
+static bool concat_expands (Graph *, const ASTConcat *);
+
+// what var_value would report an error for, checked without reporting it
+static bool var_expands (Graph *g, StringSlice name) {
+    uint32_t id;
+    TRYBOOL(interner_find(&g->var_index, name, &id));
+    if (g->var_values[id] != NULL) return true;
+    TRYBOOL(!g->var_expanding[id]);
+    g->var_expanding[id] = true;
+    bool ok = concat_expands(g, &g->vars[id]->value);
+    g->var_expanding[id] = false;
+    return ok;
+}
+
+// every variable it uses is defined, and so are the ones they use, without any using itself
+static bool concat_expands (Graph *g, const ASTConcat *concat) {
+    VEC_FOREACH(const ASTCatee, catee, concat->catee) {
+        if (catee->type == CATEE_IDENT) {
+            TRYBOOL(var_expands(g, catee->data.ident));
+            continue;
+        }
+        VEC_FOREACH(const InterpolPart, part, catee->data.interpol_string.parts) {
+            if (part->type == INTERPOL_IDENT) TRYBOOL(var_expands(g, part->data));
+        }
+    }
+    return true;
+}
+
+// expands every action's updates, patterns' need a stem so they're left out
+// the first action to claim a path gets it here, resolving reports the others
+// ones that can't expand are skipped without an error, they'll have one if they're resolved
+static void index_outputs (Graph *g) {
+    g->outputs_indexed = true;
+    uint32_t cap = 0;
+    for (uint32_t i = 0; i < g->actions_len; ++i) {
+        VEC_FOREACH(const ASTConcat, concat, g->actions[i]->updates.elems) {
+            StringSlice path;
+            if (!concat_expands(g, concat) || !expand_scratch(g, concat, (StringSlice) { 0 }, &path) || is_glob(path.back)) continue;
+            uint32_t len = g->outputs.len;
+            if (interner_add(&g->outputs, str_to_slice_raw(intern_string(g, path))) < len) continue;
+            if (len == cap) {
+                cap = cap == 0 ? 64 : cap * 2;
+                g->output_nodes = alloc_resize(g->output_nodes, cap * sizeof(uint32_t));
+            }
+            g->output_nodes[len] = i;
+        }
+    }
+}
+
+// names are padded with a space each side, so a name of len has len trigrams
+static uint32_t trigram_at (const char *name, size_t len, size_t i) {
+    uint32_t trigram = 0;
+    for (size_t j = i; j < i + 3; ++j) trigram = trigram << 8 | (unsigned char) (j == 0 || j > len ? ' ' : name[j - 1]);
+    return trigram;
+}
+
+static GraphTrigram *trigram_slot (const Graph *g, uint32_t trigram) {
+    uint32_t slot = (trigram * 2654435761u) & (g->trigrams_cap - 1);
+    while (g->trigrams[slot].trigram != 0 && g->trigrams[slot].trigram != trigram) slot = (slot + 1) & (g->trigrams_cap - 1);
+    return g->trigrams + slot;
+}
+
+static void grow_trigrams (Graph *g) {
+    GraphTrigram *old = g->trigrams;
+    uint32_t old_cap = g->trigrams_cap;
+    g->trigrams_cap = old_cap == 0 ? 256 : old_cap * 2;
+    g->trigrams = alloc_zeroed(g->trigrams_cap, sizeof(GraphTrigram));
+    for (uint32_t i = 0; i < old_cap; ++i) {
+        if (old[i].trigram != 0) *trigram_slot(g, old[i].trigram) = old[i];
+    }
+    alloc_free(old);
+}
+
+static void index_trigrams (Graph *g) {
+    grow_trigrams(g);
+    g->trigram_scores = alloc_zeroed(g->actions_len > 0 ? g->actions_len : 1, sizeof(uint32_t));
+    for (uint32_t i = 0; i < g->actions_len; ++i) {
+        StringSlice name = g->actions[i]->name;
+        for (size_t j = 0; j < name.length; ++j) {
+            if ((g->trigrams_len + 1) * 2 > g->trigrams_cap) grow_trigrams(g);
+            uint32_t trigram = trigram_at(name.back + name.start, name.length, j);
+            GraphTrigram *slot = trigram_slot(g, trigram);
+            if (slot->trigram == 0) {
+                *slot = (GraphTrigram) { .trigram = trigram, .actions = VEC_EMPTY };
+                ++g->trigrams_len;
+            }
+            if (slot->actions.len == 0 || VEC_ITEMS(slot->actions)[slot->actions.len - 1] != i) *graph_ids_push(&slot->actions) = i;
+        }
+    }
+}
+
+// the action name most like name, by the share of trigrams they have in common
+// only looks at actions sharing one, so it doesn't cost anything like comparing against every name
+// false if none come to 0.4 of them
+bool graph_suggest (Graph *g, const char *name, StringSlice *suggestion) {
+    if (g->trigrams == NULL) index_trigrams(g);
+    size_t len = strlen(name);
+    GraphIds touched = VEC_EMPTY;
+    for (size_t i = 0; i < len; ++i) {
+        const GraphTrigram *slot = trigram_slot(g, trigram_at(name, len, i));
+        VEC_FOREACH(const uint32_t, action, slot->actions) {
+            if (g->trigram_scores[*action]++ == 0) *graph_ids_push(&touched) = *action;
+        }
+    }
+
+    // dice coefficient, 2 * shared / (len + other len), compared without dividing
+    uint32_t best = GRAPH_NO_NODE;
+    VEC_FOREACH(const uint32_t, action, touched) {
+        size_t shared = g->trigram_scores[*action];
+        size_t total = len + g->actions[*action]->name.length;
+        if (shared * 5 >= total && (best == GRAPH_NO_NODE
+                || shared * (len + g->actions[best]->name.length) > g->trigram_scores[best] * total)) {
+            best = *action;
+        }
+    }
+    VEC_FOREACH(const uint32_t, action, touched) g->trigram_scores[*action] = 0;
+    graph_ids_free(touched);
+    TRYBOOL(best != GRAPH_NO_NODE);
+    *suggestion = g->actions[best]->name;
+    return true;
+}
+
+static bool find_output (Graph *g, StringSlice path, uint32_t *idx) {
+    if (!g->outputs_indexed) index_outputs(g);
+    uint32_t id;
+    TRYBOOL(interner_find(&g->outputs, path, &id));
+    *idx = g->output_nodes[id];
+    return true;
+}
+
+// resolves the action named target and everything it depends on
+// target can be an action's output too, that comes before patterns matching it
+// can be called again for more targets, resolved actions are reused
+bool graph_resolve (Graph *g, const char *target) {
+    StringSlice name = str_to_slice_raw(target);
+    uint32_t idx;
+    // anything else could index a half parsed file's outputs, or add instances the next action overwrites
+    if (g->streaming != NULL) {
+        if (interner_find(&g->action_index, name, &idx) && g->streaming[idx]) return resolve_from(g, idx);
+        fprintf(stderr, "[%s] %s can't be resolved before it's ready\n", g->progs[0].filename, target);
+        return false;
+    }
+    if (interner_find(&g->action_index, name, &idx) || find_output(g, name, &idx) || find_node(g, name, &idx)) {
+        return resolve_from(g, idx);
+    }
+
+    StringSlice suggestion;
+    if (graph_suggest(g, target, &suggestion)) {
+        fprintf(stderr, "[%s] unknown target %s, did you mean %.*s?\n", g->progs[0].filename, target,
+            (int) suggestion.length, suggestion.back + suggestion.start);
+    } else {
+        fprintf(stderr, "[%s] unknown target %s\n", g->progs[0].filename, target);
+    }
+    return false;
+}
+
+// the id of an expanded path some resolved action reads or updates
+bool graph_path_id (const Graph *g, const char *path, uint32_t *id) {
+    return interner_find(&g->paths, str_to_slice_raw(path), id);
+}
+
+// the resolved action that updates the path, or GRAPH_NO_NODE
+uint32_t graph_producer (const Graph *g, uint32_t path) {
+    return g->producers[path];
+}
+
+// the resolved actions that read the path, owned by the graph
+GraphIds graph_consumers (const Graph *g, uint32_t path) {
+    return g->consumers[path];
+}
+
+static void push_needed (const Graph *g, uint32_t path, const bool *cached, bool *seen, GraphIds *paths) {
+    uint32_t producer = g->producers[path];
+    if (seen[path] || producer == GRAPH_NO_NODE || !cached[producer]) return;
+    seen[path] = true;
+    *graph_ids_push(paths) = path;
+}
+
+// for builds that leave the outputs of actions served from a cache unwritten,
+// the path ids of the ones that still have to be put in place, added to paths
+// that's the ones an action that runs reads, and the ones the targets update
+// cached is by node index, for every resolved node, targets are node indices
+void graph_outputs_needed (const Graph *g, const bool *cached, const uint32_t *targets, uint32_t targets_len, GraphIds *paths) {
+    bool *seen = alloc_zeroed(g->paths.len > 0 ? g->paths.len : 1, sizeof(bool));
+    for (uint32_t i = 0; i < g->order_len; ++i) {
+        const GraphNode *node = g->nodes + g->order[i];
+        if (cached[g->order[i]]) continue;
+        for (uint32_t j = 0; j < node->reqs_len; ++j) push_needed(g, node->reqs[j], cached, seen, paths);
+    }
+    for (uint32_t i = 0; i < targets_len; ++i) {
+        const GraphNode *node = g->nodes + targets[i];
+        for (uint32_t j = 0; j < node->updates_len; ++j) push_needed(g, node->updates[j], cached, seen, paths);
+    }
+    alloc_free(seen);
+}
+
+static bool reqs_changed (const GraphNode *node, const bool *changed) {
+    for (uint32_t i = 0; i < node->reqs_len; ++i) {
+        if (changed[node->reqs[i]]) return true;
+    }
+    return false;
+}
+
+// early cutoff, once the action at node index ran and its updates were hashed
+// changed is by path id, true for paths with new contents, its updates included
+// the actions that read its updates but none of whose reqs changed are added to clean, once each
+void graph_cutoff (const Graph *g, uint32_t node, const bool *changed, GraphIds *clean) {
+    const GraphNode *ran = g->nodes + node;
+    size_t start = clean->len;
+    for (uint32_t i = 0; i < ran->updates_len; ++i) {
+        VEC_FOREACH(const uint32_t, consumer, g->consumers[ran->updates[i]]) {
+            if (reqs_changed(g->nodes + *consumer, changed)) continue;
+            bool seen = false;
+            for (size_t j = start; j < clean->len && !seen; ++j) seen = VEC_ITEMS(*clean)[j] == *consumer;
+            if (!seen) *graph_ids_push(clean) = *consumer;
+        }
+    }
+}
+
+static size_t count_percents (StringSlice name) {
+    size_t count = 0;
+    for (size_t i = 0; i < name.length; ++i) count += name.back[name.start + i] == '%';
+    return count;
+}
+
+// a graph to add actions and variables to one at a time, graph_end finishes it
+// progs are the files they'll come from, at least one
+void graph_begin (const Prog *progs, uint32_t len, Graph *g) {
+    *g = (Graph) {
+        .progs = progs,
+        .progs_len = len,
+        .actions = NULL,
+        .actions_len = 0,
+        .actions_cap = 0,
+        .action_index = interner_new(),
+        .patterns = NULL,
+        .patterns_len = 0,
+        .patterns_cap = 0,
+        .pattern_index = interner_new(),
+        .instance_index = interner_new(),
+        .owned_names = list_new(),
+        .dirs = dir_cache_new(),
+        .deps = NULL,
+        .vars = NULL,
+        .vars_len = 0,
+        .vars_cap = 0,
+        .var_index = interner_new(),
+        .var_values = NULL,
+        .var_lens = NULL,
+        .var_expanding = NULL,
+        .owned_actions = list_new(),
+        .owned_vars = list_new(),
+        .nodes = NULL,
+        .nodes_len = 0,
+        .nodes_cap = 0,
+        .strings = interner_new(),
+        .owned_strings = list_new(),
+        .expansions = NULL,
+        .expansions_cap = 0,
+        .expansions_len = 0,
+        .scratch = NULL,
+        .scratch_cap = 0,
+        .paths = interner_new(),
+        .owned_paths = list_new(),
+        .mtimes = NULL,
+        .mtimes_cap = 0,
+        .producers = NULL,
+        .consumers = NULL,
+        .outputs_indexed = false,
+        .outputs = interner_new(),
+        .output_nodes = NULL,
+        .trigrams = NULL,
+        .trigrams_cap = 0,
+        .trigrams_len = 0,
+        .trigram_scores = NULL,
+        .streaming = NULL,
+        .order = NULL,
+        .order_len = 0
+    };
+}
+
+static void push_action (const ASTAction ***actions, uint32_t *len, uint32_t *cap, const ASTAction *action) {
+    if (*len == *cap) {
+        *cap = *cap == 0 ? 64 : *cap * 2;
+        *actions = alloc_resize(*actions, *cap * sizeof(ASTAction *));
+    }
+    (*actions)[(*len)++] = action;
+}
+
+// indexes an action by name, it has to outlive the graph
+// duplicates are reported and make this fail, but the action is still added
+bool graph_add_action (Graph *g, const ASTAction *action) {
+    size_t percents = count_percents(action->name);
+    if (percents > 1) {
+        name_err(g, action->name, "more than one % in pattern");
+        return false;
+    } else if (percents == 1) {
+        bool ok = interner_add(&g->pattern_index, action->name) == g->patterns_len;
+        if (!ok) name_err(g, action->name, "duplicate pattern");
+        push_action(&g->patterns, &g->patterns_len, &g->patterns_cap, action);
+        return ok;
+    } else {
+        bool ok = interner_add(&g->action_index, action->name) == g->actions_len;
+        if (!ok) name_err(g, action->name, "duplicate action");
+        push_action(&g->actions, &g->actions_len, &g->actions_cap, action);
+        return ok;
+    }
+}
+
+// graph_add_action for variables
+bool graph_add_var (Graph *g, const ASTVar *var) {
+    bool ok = interner_add(&g->var_index, var->name) == g->vars_len;
+    if (!ok) name_err(g, var->name, "duplicate variable");
+    if (g->vars_len == g->vars_cap) {
+        uint32_t old_cap = g->vars_cap;
+        g->vars_cap = old_cap == 0 ? 64 : old_cap * 2;
+        g->vars = alloc_resize(g->vars, g->vars_cap * sizeof(ASTVar *));
+        g->var_values = alloc_resize(g->var_values, g->vars_cap * sizeof(char *));
+        g->var_lens = alloc_resize(g->var_lens, g->vars_cap * sizeof(size_t));
+        g->var_expanding = alloc_resize(g->var_expanding, g->vars_cap * sizeof(bool));
+        memset(g->var_values + old_cap, 0, (g->vars_cap - old_cap) * sizeof(char *));
+        memset(g->var_expanding + old_cap, 0, (g->vars_cap - old_cap) * sizeof(bool));
+    }
+    g->vars[g->vars_len++] = var;
+    return ok;
+}
+
+// done adding, the graph can be resolved now
+void graph_end (Graph *g) {
+    // patterns' instances go after the actions
+    grow_nodes(g, g->actions_len);
+    g->nodes_len = g->actions_len;
+}
+
+// indexes the actions and variables of every file's ast by name, nothing is expanded yet
+// progs and asts are parallel arrays of len, at least one
+// duplicate names are errors, even across files, they all get reported
+bool graph_new (const Prog *progs, const ASTProg *asts, uint32_t len, Graph *g) {
+    graph_begin(progs, len, g);
+    bool ok = true;
+    for (uint32_t i = 0; i < len; ++i) {
+        VEC_FOREACH(const ASTAction, action, asts[i].actions) ok = graph_add_action(g, action) && ok;
+        VEC_FOREACH(const ASTVar, var, asts[i].vars) ok = graph_add_var(g, var) && ok;
+    }
+    graph_end(g);
+    TRYBOOL_R(ok, graph_free(*g));
+    return true;
+}
+
+// the statements waiting on one name, until it's ready
+typedef struct {
+    uint32_t *ids; // actions, or variables with WAIT_VAR set
+    uint32_t len;
+    uint32_t cap;
+} Waiters;
+
+#define WAIT_VAR 0x80000000u
+
+typedef struct {
+    Graph *g;
+    bool ok;
+    // NULL unless pipelined
+    void (*ready) (void *, uint32_t);
+    void *ready_ctx;
+    bool *action_ready; // by action index, nothing later can change its closure
+    uint32_t action_ready_cap;
+    bool *var_ready; // by variable index, it and every variable it uses are defined
+    uint32_t var_ready_cap;
+    Interner waited; // names something's waiting on
+    Waiters *waiters; // by waited id
+    uint32_t waiters_cap;
+    uint32_t *work; // statements to check
+    uint32_t work_len;
+    uint32_t work_cap;
+} StreamState;
+
+static void push_id (uint32_t **ids, uint32_t *len, uint32_t *cap, uint32_t id) {
+    if (*len == *cap) {
+        *cap = *cap == 0 ? 8 : *cap * 2;
+        *ids = alloc_resize(*ids, *cap * sizeof(uint32_t));
+    }
+    (*ids)[(*len)++] = id;
+}
+
+// true if variable name is ready, otherwise it's what to wait for
+static bool var_ready (const StreamState *state, StringSlice name, StringSlice *wait) {
+    uint32_t id;
+    if (interner_find(&state->g->var_index, name, &id) && state->var_ready[id]) return true;
+    *wait = name;
+    return false;
+}
+
+static bool concat_ready (const StreamState *state, const ASTConcat *concat, StringSlice *wait) {
+    VEC_FOREACH(const ASTCatee, catee, concat->catee) {
+        if (catee->type == CATEE_IDENT) {
+            TRYBOOL(var_ready(state, catee->data.ident, wait));
+            continue;
+        }
+        VEC_FOREACH(const InterpolPart, part, catee->data.interpol_string.parts) {
+            if (part->type == INTERPOL_IDENT) TRYBOOL(var_ready(state, part->data, wait));
+        }
+    }
+    return true;
+}
+
+static bool list_ready (const StreamState *state, const ASTList *list, StringSlice *wait) {
+    VEC_FOREACH(const ASTConcat, concat, list->elems) TRYBOOL(concat_ready(state, concat, wait));
+    return true;
+}
+
+// a lone identifier only stays what it is if it names an action, anything else could become one later
+// so one naming a variable or a pattern instance holds its action back until the end
+static bool action_ready (const StreamState *state, const ASTAction *action, StringSlice *wait) {
+    TRYBOOL(list_ready(state, &action->reqs, wait));
+    VEC_FOREACH(const ASTConcat, concat, action->commands.elems) {
+        const ASTCatee *first = VEC_ITEMS(concat->catee);
+        if (concat->catee.len != 1 || first->type != CATEE_IDENT) {
+            TRYBOOL(concat_ready(state, concat, wait));
+            continue;
+        }
+        uint32_t dep;
+        if (interner_find(&state->g->action_index, first->data.ident, &dep) && state->action_ready[dep]) continue;
+        *wait = first->data.ident;
+        return false;
+    }
+    TRYBOOL(list_ready(state, &action->updates, wait));
+    return concat_ready(state, &action->depfile, wait);
+}
+
+// checks every statement on the work list, anything that gets ready wakes what's waiting on its name
+static void settle (StreamState *state) {
+    Graph *g = state->g;
+    while (state->work_len > 0) {
+        uint32_t id = state->work[--state->work_len];
+        bool is_var = id & WAIT_VAR;
+        uint32_t idx = id & ~WAIT_VAR;
+        if (is_var ? state->var_ready[idx] : state->action_ready[idx]) continue;
+
+        StringSlice wait;
+        bool ready = is_var ? concat_ready(state, &g->vars[idx]->value, &wait) : action_ready(state, g->actions[idx], &wait);
+        uint32_t waited;
+        if (!ready) {
+            waited = interner_add(&state->waited, wait);
+            if (waited >= state->waiters_cap) {
+                uint32_t old_cap = state->waiters_cap;
+                state->waiters_cap = old_cap == 0 ? 64 : old_cap * 2;
+                state->waiters = alloc_resize(state->waiters, state->waiters_cap * sizeof(Waiters));
+                memset(state->waiters + old_cap, 0, (state->waiters_cap - old_cap) * sizeof(Waiters));
+            }
+            Waiters *waiters = state->waiters + waited;
+            push_id(&waiters->ids, &waiters->len, &waiters->cap, id);
+            continue;
+        }
+
+        StringSlice name;
+        if (is_var) {
+            state->var_ready[idx] = true;
+            name = g->vars[idx]->name;
+        } else {
+            state->action_ready[idx] = true;
+            name = g->actions[idx]->name;
+            state->ready(state->ready_ctx, idx);
+        }
+        if (!interner_find(&state->waited, name, &waited)) continue;
+        Waiters *waiters = state->waiters + waited;
+        for (uint32_t i = 0; i < waiters->len; ++i) push_id(&state->work, &state->work_len, &state->work_cap, waiters->ids[i]);
+        waiters->len = 0;
+    }
+}
+
+static void stream_action (void *ctx, ASTAction action) {
+    StreamState *state = ctx;
+    Graph *g = state->g;
+    ASTAction *owned = alloc_bytes(sizeof(ASTAction));
+    *owned = action;
+    list_push(&g->owned_actions, owned);
+    uint32_t actions_len = g->actions_len;
+    bool added = graph_add_action(g, owned);
+    state->ok = added && state->ok;
+    // patterns aren't ever ready
+    if (state->ready == NULL || g->actions_len == actions_len) return;
+
+    // so the action can be resolved straight away
+    grow_nodes(g, g->actions_len);
+    g->nodes_len = g->actions_len;
+    if (state->action_ready_cap < g->actions_cap) {
+        state->action_ready_cap = g->actions_cap;
+        state->action_ready = alloc_resize(state->action_ready, g->actions_cap * sizeof(bool));
+        g->streaming = state->action_ready;
+    }
+    state->action_ready[actions_len] = false;
+    // nor are duplicates, their names are taken
+    if (!added) return;
+    push_id(&state->work, &state->work_len, &state->work_cap, actions_len);
+    settle(state);
+}
+
+static void stream_var (void *ctx, ASTVar var) {
+    StreamState *state = ctx;
+    Graph *g = state->g;
+    ASTVar *owned = alloc_bytes(sizeof(ASTVar));
+    *owned = var;
+    list_push(&g->owned_vars, owned);
+    bool added = graph_add_var(g, owned);
+    state->ok = added && state->ok;
+    if (state->ready == NULL) return;
+
+    if (state->var_ready_cap < g->vars_cap) {
+        state->var_ready_cap = g->vars_cap;
+        state->var_ready = alloc_resize(state->var_ready, g->vars_cap * sizeof(bool));
+    }
+    state->var_ready[g->vars_len - 1] = false;
+    if (!added) return;
+    push_id(&state->work, &state->work_len, &state->work_cap, (g->vars_len - 1) | WAIT_VAR);
+    settle(state);
+}
+
+// includes need every file loaded before the graph, like load_build_files does
+static void stream_include (void *ctx, ASTInclude include) {
+    StreamState *state = ctx;
+    report_err(state->g->progs[0], include.offset, "include isn't supported when parsing straight into a graph\n");
+    state->ok = false;
+}
+
+// lexes, parses and indexes prog a statement at a time, without keeping its tokens or a whole ast
+// the graph owns the statements, only prog has to outlive it
+bool graph_parse (const Prog *prog, Graph *g) {
+    return graph_parse_ready(prog, g, NULL, NULL);
+}
+
+// graph_parse, calling ready with each action's index as soon as no later statement can change it or anything it
+// depends on, so it can be resolved and started while the rest is parsed
+// that's once every variable it uses is defined, and every lone identifier in its commands names an action
+// that's itself ready, nothing later can redefine those without being a duplicate
+// ready can graph_resolve the action and ones it was given before, anything else fails until this returns
+// a duplicate or any other error later still makes this fail, after some ready actions might've run
+// actions held back by patterns, or by identifiers that aren't actions yet, are left for after the end
+bool graph_parse_ready (const Prog *prog, Graph *g, void (*ready) (void *, uint32_t), void *ctx) {
+    graph_begin(prog, 1, g);
+    StreamState state = (StreamState) { .g = g, .ok = true, .ready = ready, .ready_ctx = ctx, .waited = interner_new() };
+    bool parsed = parse_stream(*prog, (ParseSink) { stream_action, stream_var, stream_include, &state });
+    g->streaming = NULL;
+    graph_end(g);
+    alloc_free(state.action_ready);
+    alloc_free(state.var_ready);
+    for (uint32_t i = 0; i < state.waited.len; ++i) alloc_free(state.waiters[i].ids);
+    alloc_free(state.waiters);
+    interner_free(state.waited);
+    alloc_free(state.work);
+    TRYBOOL_R(parsed && state.ok, graph_free(*g));
+    return true;
+}
+
+// asts from graph_new have to outlive the graph, they aren't freed here
+void graph_free (Graph g) {
+    for (uint32_t i = 0; i < g.nodes_len; ++i) {
+        GraphNode node = g.nodes[i];
+        alloc_free(node.reqs);
+        alloc_free(node.commands);
+        alloc_free(node.updates);
+    }
+    for (uint32_t i = 0; i < g.vars_len; ++i) alloc_free(g.var_values[i]);
+    alloc_free(g.actions);
+    interner_free(g.action_index);
+    alloc_free(g.patterns);
+    interner_free(g.pattern_index);
+    interner_free(g.instance_index);
+    list_free(g.owned_names);
+    alloc_free(g.vars);
+    interner_free(g.var_index);
+    alloc_free(g.var_values);
+    alloc_free(g.var_lens);
+    alloc_free(g.var_expanding);
+    for (LLNode *node = g.owned_actions.head; node != NULL; node = node->next) free_streamed_action(*(ASTAction *) node->data);
+    list_free(g.owned_actions);
+    for (LLNode *node = g.owned_vars.head; node != NULL; node = node->next) free_streamed_var(*(ASTVar *) node->data);
+    list_free(g.owned_vars);
+    alloc_free(g.nodes);
+    dir_cache_free(g.dirs);
+    interner_free(g.strings);
+    list_free(g.owned_strings);
+    alloc_free(g.expansions);
+    alloc_free(g.scratch);
+    interner_free(g.paths);
+    list_free(g.owned_paths);
+    alloc_free(g.mtimes);
+    alloc_free(g.producers);
+    for (uint32_t i = 0; i < g.paths.len; ++i) graph_ids_free(g.consumers[i]);
+    alloc_free(g.consumers);
+    interner_free(g.outputs);
+    alloc_free(g.output_nodes);
+    for (uint32_t i = 0; i < g.trigrams_cap; ++i) graph_ids_free(g.trigrams[i].actions);
+    alloc_free(g.trigrams);
+    alloc_free(g.trigram_scores);
+    alloc_free(g.order);
+}
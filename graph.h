@@ -0,0 +1,151 @@
+// build graph, resolved lazily starting from the targets asked for
+// only reachable actions get their names looked up, strings expanded and files stat'd
+// actions named with a % are patterns, instantiated for each name they're reached by
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ast.h"
+#include "deps_log.h"
+#include "dir_cache.h"
+#include "intern.h"
+#include "list.h"
+#include "prog.h"
+
+// mtime of a path that doesn't exist
+#define GRAPH_MTIME_MISSING -1
+
+// no node produces the path
+#define GRAPH_NO_NODE UINT32_MAX
+
+// a commands list element
+typedef struct {
+    enum {
+        COMMAND_ACTION, // an action's name, so run that one first
+        COMMAND_SHELL
+    } type;
+    union {
+        uint32_t action; // node index
+        const char *shell; // shared, the graph's strings own it
+    } data;
+} GraphCommand;
+
+typedef struct {
+    const ASTAction *action;
+    StringSlice stem; // what the pattern's % matched, empty if it isn't an instance
+    bool resolved;
+    bool resolving; // on the resolve stack, for finding cycles
+    bool expanded; // reqs, commands and updates are filled in, which an error elsewhere can leave unresolved
+    bool failed; // expanding it gave errors, it's left empty and they aren't reported again
+    uint32_t *reqs; // path ids, the build file's then ones the deps log has for its updates
+    uint32_t reqs_len;
+    uint32_t found_len; // of reqs, the ones from the deps log
+    const char *depfile; // expanded and shared, NULL if it doesn't have one
+    GraphCommand *commands;
+    uint32_t commands_len;
+    uint32_t *updates; // path ids
+    uint32_t updates_len;
+} GraphNode;
+
+// node indices, most paths are read by one or two actions
+VEC_DECLARE(GraphIds, graph_ids, uint32_t, 2)
+
+// the actions whose names have a trigram
+typedef struct {
+    uint32_t trigram; // its three bytes, 0 if the slot is empty
+    GraphIds actions;
+} GraphTrigram;
+
+// a concat already expanded, for concats that look the same
+typedef struct {
+    uint64_t hash; // of its structure and the stem
+    const ASTConcat *concat; // NULL if the slot is empty
+    StringSlice stem;
+    const char *str;
+} GraphExpansion;
+
+typedef struct {
+    // the files the asts came from, for errors
+    const Prog *progs;
+    uint32_t progs_len;
+    // every action and variable is indexed up front, but that only hashes their names
+    const ASTAction **actions;
+    uint32_t actions_len;
+    uint32_t actions_cap;
+    Interner action_index;
+    const ASTAction **patterns;
+    uint32_t patterns_len;
+    uint32_t patterns_cap;
+    Interner pattern_index; // just for finding duplicates
+    Interner instance_index; // by name, id + actions_len is the node index
+    LList owned_names; // backing for instance_index
+    const ASTVar **vars;
+    uint32_t vars_len;
+    uint32_t vars_cap;
+    Interner var_index;
+    // statements from graph_parse, which nothing else keeps
+    LList owned_actions;
+    LList owned_vars;
+    char **var_values; // by variable index, NULL until something uses it
+    size_t *var_lens; // of the values that aren't NULL
+    bool *var_expanding; // for finding variables that use themselves
+    // action indices then instances, only filled in once resolved
+    GraphNode *nodes;
+    uint32_t nodes_len;
+    uint32_t nodes_cap;
+    // for globs in reqs and updates, load and save it around resolving to skip unchanged directories
+    DirCache dirs;
+    // what earlier runs' depfiles found, set before resolving to add it to reqs, NULL for none
+    const DepsLog *deps;
+    // every expanded command and output once, however many actions it's in
+    Interner strings;
+    LList owned_strings;
+    GraphExpansion *expansions; // open addressing
+    uint32_t expansions_cap; // power of two
+    uint32_t expansions_len;
+    // what strings are expanded into before they're looked up, so known ones aren't allocated
+    char *scratch;
+    size_t scratch_cap;
+    // expanded reqs and updates of resolved actions
+    Interner paths;
+    LList owned_paths;
+    // by path id, ns since the epoch
+    int64_t *mtimes;
+    uint32_t mtimes_cap; // and of producers and consumers
+    // which resolved actions update and read each path, for finding what a changed file affects
+    uint32_t *producers; // by path id, GRAPH_NO_NODE if none does
+    GraphIds *consumers; // by path id, each node once, in the order they were reached
+    // actions' outputs, so targets can be paths, only built the first time a target isn't an action
+    bool outputs_indexed;
+    Interner outputs;
+    uint32_t *output_nodes; // by outputs id
+    // for suggesting names like unknown targets, only built the first time there is one
+    GraphTrigram *trigrams; // open addressing
+    uint32_t trigrams_cap; // power of two
+    uint32_t trigrams_len;
+    uint32_t *trigram_scores; // by action index, all 0 between lookups
+    // set while graph_parse_ready runs, by action index, the only ones that can be resolved until it returns
+    const bool *streaming;
+    uint32_t *order; // resolved action indices, dependencies first
+    uint32_t order_len;
+} Graph;
+
+bool graph_new (const Prog *, const ASTProg *, uint32_t, Graph *);
+void graph_begin (const Prog *, uint32_t, Graph *);
+bool graph_add_action (Graph *, const ASTAction *);
+bool graph_add_var (Graph *, const ASTVar *);
+void graph_end (Graph *);
+bool graph_parse (const Prog *, Graph *);
+bool graph_parse_ready (const Prog *, Graph *, void (*) (void *, uint32_t), void *);
+bool graph_resolve (Graph *, const char *);
+bool graph_suggest (Graph *, const char *, StringSlice *);
+bool graph_path_id (const Graph *, const char *, uint32_t *);
+uint32_t graph_producer (const Graph *, uint32_t);
+GraphIds graph_consumers (const Graph *, uint32_t);
+void graph_outputs_needed (const Graph *, const bool *, const uint32_t *, uint32_t, GraphIds *);
+void graph_cutoff (const Graph *, uint32_t, const bool *, GraphIds *);
+void graph_free (Graph);
+
+#endif
@@ -0,0 +1,384 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_GRAPH
+#include "alloc.h"
+#include "graph_cache.h"
+#include "hash.h"
+#include "try.h"
+#include "version.h"
+
+// file layout, everything native endian and 8 aligned:
+// Header, then its sections in this order:
+//   a CacheFile per build file and a CacheDir per directory a glob listed, for checking it's still valid
+//   GraphCacheNodes, GraphCacheCommands, u32 path ids, a u64 string offset per path,
+//   the u32 name index, then the strings, nul terminated
+// string offsets are from the start of the strings
+
+#define GRAPH_CACHE_MAGIC "bidetgraph\0"
+#define GRAPH_CACHE_MAGIC_LEN 12
+#define GRAPH_CACHE_FORMAT 4
+// generated build files can be big enough to be worth it
+#define HASH_THREADS 4
+
+typedef struct {
+    char magic[GRAPH_CACHE_MAGIC_LEN];
+    uint32_t format;
+    uint64_t version_hash; // of BIDET_VERSION
+    uint64_t file_len;
+    uint32_t files_len;
+    uint32_t dirs_len;
+    uint32_t nodes_len;
+    uint32_t commands_len;
+    uint32_t ids_len;
+    uint32_t paths_len;
+    uint32_t index_cap; // power of two
+    uint32_t padding;
+    uint64_t files_off;
+    uint64_t dirs_off;
+    uint64_t nodes_off;
+    uint64_t commands_off;
+    uint64_t ids_off;
+    uint64_t paths_off;
+    uint64_t index_off;
+    uint64_t strings_off;
+} Header;
+
+typedef struct {
+    uint64_t path; // string offset
+    int64_t mtime;
+    uint64_t size;
+    HashContent hash; // of the contents, checked when mtime or size changed
+} CacheFile;
+
+typedef struct {
+    uint64_t path; // string offset
+    int64_t mtime;
+} CacheDir;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} ByteBuf;
+
+static void buf_reserve (ByteBuf *buf, size_t len) {
+    if (buf->len + len <= buf->cap) return;
+    buf->cap = buf->cap == 0 ? 4096 : buf->cap;
+    while (buf->len + len > buf->cap) buf->cap *= 2;
+    buf->data = alloc_resize(buf->data, buf->cap);
+}
+
+static void buf_push (ByteBuf *buf, const void *data, size_t len) {
+    buf_reserve(buf, len);
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void buf_align8 (ByteBuf *buf) {
+    char zeros[8] = { 0 };
+    buf_push(buf, zeros, (8 - buf->len % 8) % 8);
+}
+
+// returns the string's offset
+static uint64_t push_string (ByteBuf *strings, StringSlice str) {
+    uint64_t offset = strings->len;
+    buf_push(strings, str.back + str.start, str.length);
+    buf_push(strings, "", 1);
+    return offset;
+}
+
+static int64_t stat_mtime (const struct stat *st) {
+    return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// pattern instances aren't named by their action
+static StringSlice node_name (const Graph *g, uint32_t idx) {
+    if (idx < g->actions_len) return g->nodes[idx].action->name;
+    return interner_get(&g->instance_index, idx - g->actions_len);
+}
+
+// the build files as they were read, false if one has changed on disk since
+static bool push_files (const Graph *g, ByteBuf *out, ByteBuf *strings) {
+    for (uint32_t i = 0; i < g->progs_len; ++i) {
+        Prog prog = g->progs[i];
+        struct stat st;
+        HashContent disk_hash;
+        HashContent hash = hash_content_chunks(prog.text, strlen(prog.text), HASH_THREADS);
+        TRYBOOL(stat(prog.filename, &st) == 0 && hash_content_file(prog.filename, HASH_THREADS, &disk_hash)
+            && hash_content_equal(disk_hash, hash));
+        CacheFile file = {
+            .path = push_string(strings, str_to_slice_raw(prog.filename)),
+            .mtime = stat_mtime(&st),
+            .size = st.st_size,
+            .hash = hash
+        };
+        buf_push(out, &file, sizeof(file));
+    }
+    return true;
+}
+
+// every directory globbing looked at, including missing ones
+static uint32_t push_dirs (const Graph *g, ByteBuf *out, ByteBuf *strings) {
+    uint32_t len = 0;
+    for (uint32_t id = 0; id < g->dirs.index.len; ++id) {
+        const DirListing *listing = g->dirs.listings + id;
+        if (!listing->checked) continue;
+        CacheDir dir = {
+            .path = push_string(strings, interner_get(&g->dirs.index, id)),
+            .mtime = listing->mtime
+        };
+        buf_push(out, &dir, sizeof(dir));
+        ++len;
+    }
+    return len;
+}
+
+// saves g's resolved nodes, the ones in g->order, to path
+// false without writing anything if a build file changed since it was read
+bool graph_cache_write (const Graph *g, const char *path) {
+    ByteBuf out = { 0 };
+    ByteBuf strings = { 0 };
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GRAPH_CACHE_MAGIC, GRAPH_CACHE_MAGIC_LEN);
+    h.format = GRAPH_CACHE_FORMAT;
+    h.version_hash = hash_bytes(BIDET_VERSION, strlen(BIDET_VERSION));
+    buf_push(&out, &h, sizeof(h));
+
+    h.files_off = out.len;
+    h.files_len = g->progs_len;
+    bool ok = push_files(g, &out, &strings);
+    h.dirs_off = out.len;
+    h.dirs_len = push_dirs(g, &out, &strings);
+
+    // cache node indices are positions in the order
+    uint32_t *cache_idx = alloc_bytes((g->nodes_len > 0 ? g->nodes_len : 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < g->order_len; ++i) cache_idx[g->order[i]] = i;
+
+    h.nodes_off = out.len;
+    h.nodes_len = g->order_len;
+    uint32_t commands_len = 0;
+    uint32_t ids_len = 0;
+    for (uint32_t i = 0; i < g->order_len; ++i) {
+        const GraphNode *node = g->nodes + g->order[i];
+        uint32_t reqs_len = node->reqs_len - node->found_len;
+        GraphCacheNode cache_node = {
+            .name = push_string(&strings, node_name(g, g->order[i])),
+            .depfile = push_string(&strings, str_to_slice_raw(node->depfile == NULL ? "" : node->depfile)),
+            .reqs = ids_len,
+            .reqs_len = reqs_len,
+            .commands = commands_len,
+            .commands_len = node->commands_len,
+            .updates = ids_len + reqs_len,
+            .updates_len = node->updates_len,
+            .linkable = node->action->linkable,
+            .padding = 0
+        };
+        buf_push(&out, &cache_node, sizeof(cache_node));
+        commands_len += node->commands_len;
+        ids_len += reqs_len + node->updates_len;
+    }
+
+    h.commands_off = out.len;
+    h.commands_len = commands_len;
+    for (uint32_t i = 0; i < g->order_len; ++i) {
+        const GraphNode *node = g->nodes + g->order[i];
+        for (uint32_t j = 0; j < node->commands_len; ++j) {
+            GraphCommand command = node->commands[j];
+            GraphCacheCommand cache_command = { .type = command.type, .action = 0, .shell = 0 };
+            if (command.type == COMMAND_ACTION) {
+                cache_command.action = cache_idx[command.data.action];
+            } else {
+                cache_command.shell = push_string(&strings, str_to_slice_raw(command.data.shell));
+            }
+            buf_push(&out, &cache_command, sizeof(cache_command));
+        }
+    }
+    alloc_free(cache_idx);
+
+    h.ids_off = out.len;
+    h.ids_len = ids_len;
+    for (uint32_t i = 0; i < g->order_len; ++i) {
+        const GraphNode *node = g->nodes + g->order[i];
+        buf_push(&out, node->reqs, (node->reqs_len - node->found_len) * sizeof(uint32_t));
+        buf_push(&out, node->updates, node->updates_len * sizeof(uint32_t));
+    }
+    buf_align8(&out);
+
+    h.paths_off = out.len;
+    h.paths_len = g->paths.len;
+    for (uint32_t id = 0; id < g->paths.len; ++id) {
+        uint64_t offset = push_string(&strings, interner_get(&g->paths, id));
+        buf_push(&out, &offset, sizeof(offset));
+    }
+
+    h.index_off = out.len;
+    h.index_cap = 16;
+    while (h.index_cap < 2 * (uint64_t) h.nodes_len) h.index_cap *= 2;
+    buf_reserve(&out, h.index_cap * sizeof(uint32_t));
+    uint32_t *index = (uint32_t *) (out.data + out.len);
+    memset(index, 0, h.index_cap * sizeof(uint32_t));
+    const GraphCacheNode *nodes = (const GraphCacheNode *) (out.data + h.nodes_off);
+    for (uint32_t i = 0; i < h.nodes_len; ++i) {
+        const char *name = strings.data + nodes[i].name;
+        size_t slot = hash_bytes(name, strlen(name)) & (h.index_cap - 1);
+        while (index[slot] != 0) slot = (slot + 1) & (h.index_cap - 1);
+        index[slot] = i + 1;
+    }
+    out.len += h.index_cap * sizeof(uint32_t);
+    buf_align8(&out);
+
+    h.strings_off = out.len;
+    buf_push(&out, strings.data, strings.len);
+    // so every offset in it reads as a terminated string, even an empty strings section
+    buf_push(&out, "", 1);
+    buf_align8(&out);
+    h.file_len = out.len;
+    memcpy(out.data, &h, sizeof(h));
+    alloc_free(strings.data);
+
+    char *tmp_path = alloc_bytes(strlen(path) + sizeof(".tmp"));
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE *file = ok ? fopen(tmp_path, "wb") : NULL;
+    ok = file != NULL;
+    if (ok) {
+        ok = fwrite(out.data, 1, out.len, file) == out.len;
+        ok = fclose(file) == 0 && ok;
+        if (ok) ok = rename(tmp_path, path) == 0;
+        if (!ok) remove(tmp_path);
+    }
+    alloc_free(tmp_path);
+    alloc_free(out.data);
+    return ok;
+}
+
+static bool section_valid (uint64_t offset, uint64_t len, size_t elem_size, uint64_t next) {
+    return offset % 8 == 0 && offset <= next && len <= (next - offset) / elem_size;
+}
+
+// bounds every section and offset in the file
+// o(nodes), but that's just walking arrays, nothing like parsing
+static bool cache_valid (const GraphCache *cache) {
+    TRYBOOL(cache->map_len >= sizeof(Header));
+    const Header *h = cache->map;
+    TRYBOOL(memcmp(h->magic, GRAPH_CACHE_MAGIC, GRAPH_CACHE_MAGIC_LEN) == 0 && h->format == GRAPH_CACHE_FORMAT);
+    TRYBOOL(h->version_hash == hash_bytes(BIDET_VERSION, strlen(BIDET_VERSION)));
+    TRYBOOL(h->file_len == cache->map_len && (h->index_cap & (h->index_cap - 1)) == 0 && h->index_cap > h->nodes_len);
+    TRYBOOL(h->files_off >= sizeof(Header) && section_valid(h->files_off, h->files_len, sizeof(CacheFile), h->dirs_off));
+    TRYBOOL(section_valid(h->dirs_off, h->dirs_len, sizeof(CacheDir), h->nodes_off));
+    TRYBOOL(section_valid(h->nodes_off, h->nodes_len, sizeof(GraphCacheNode), h->commands_off));
+    TRYBOOL(section_valid(h->commands_off, h->commands_len, sizeof(GraphCacheCommand), h->ids_off));
+    TRYBOOL(section_valid(h->ids_off, h->ids_len, sizeof(uint32_t), h->paths_off));
+    TRYBOOL(section_valid(h->paths_off, h->paths_len, sizeof(uint64_t), h->index_off));
+    TRYBOOL(section_valid(h->index_off, h->index_cap, sizeof(uint32_t), h->strings_off));
+    TRYBOOL(h->strings_off < h->file_len);
+    uint64_t strings_len = h->file_len - h->strings_off;
+    const char *strings = (const char *) cache->map + h->strings_off;
+    TRYBOOL(strings[strings_len - 1] == '\0');
+
+    const char *map = cache->map;
+    const CacheFile *files = (const CacheFile *) (map + h->files_off);
+    for (uint32_t i = 0; i < h->files_len; ++i) TRYBOOL(files[i].path < strings_len);
+    const CacheDir *dirs = (const CacheDir *) (map + h->dirs_off);
+    for (uint32_t i = 0; i < h->dirs_len; ++i) TRYBOOL(dirs[i].path < strings_len);
+    for (uint32_t i = 0; i < h->nodes_len; ++i) {
+        GraphCacheNode node = cache->nodes[i];
+        TRYBOOL(node.name < strings_len && node.depfile < strings_len);
+        TRYBOOL(node.reqs <= h->ids_len && node.reqs_len <= h->ids_len - node.reqs);
+        TRYBOOL(node.updates <= h->ids_len && node.updates_len <= h->ids_len - node.updates);
+        TRYBOOL(node.commands <= h->commands_len && node.commands_len <= h->commands_len - node.commands);
+    }
+    for (uint32_t i = 0; i < h->commands_len; ++i) {
+        GraphCacheCommand command = cache->commands[i];
+        TRYBOOL(command.type == COMMAND_ACTION ? command.action < h->nodes_len
+            : command.type == COMMAND_SHELL && command.shell < strings_len);
+    }
+    for (uint32_t i = 0; i < h->ids_len; ++i) TRYBOOL(cache->ids[i] < h->paths_len);
+    for (uint32_t i = 0; i < h->paths_len; ++i) TRYBOOL(cache->paths[i] < strings_len);
+    for (uint32_t i = 0; i < h->index_cap; ++i) TRYBOOL(cache->index[i] <= h->nodes_len);
+    return true;
+}
+
+// the build files and globbed directories are what the graph came from
+static bool cache_current (const GraphCache *cache) {
+    const Header *h = cache->map;
+    const char *map = cache->map;
+    const CacheFile *files = (const CacheFile *) (map + h->files_off);
+    for (uint32_t i = 0; i < h->files_len; ++i) {
+        const char *path = cache->strings + files[i].path;
+        struct stat st;
+        TRYBOOL(stat(path, &st) == 0);
+        if (stat_mtime(&st) == files[i].mtime && (uint64_t) st.st_size == files[i].size) continue;
+        // touched but maybe not changed
+        HashContent hash;
+        TRYBOOL(hash_content_file(path, HASH_THREADS, &hash) && hash_content_equal(hash, files[i].hash));
+    }
+    const CacheDir *dirs = (const CacheDir *) (map + h->dirs_off);
+    for (uint32_t i = 0; i < h->dirs_len; ++i) {
+        struct stat st;
+        int64_t mtime = stat(cache->strings + dirs[i].path, &st) == 0 ? stat_mtime(&st) : GRAPH_MTIME_MISSING;
+        TRYBOOL(mtime == dirs[i].mtime);
+    }
+    return true;
+}
+
+// maps the cache at path, false if it's missing, broken, from another version or out of date
+bool graph_cache_open (const char *path, GraphCache *cache) {
+    *cache = (GraphCache) { .map = NULL, .map_len = 0 };
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    TRYBOOL(fd != -1);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            cache->map = map;
+            cache->map_len = st.st_size;
+        }
+    }
+    close(fd);
+    TRYBOOL(cache->map != NULL);
+
+    const Header *h = cache->map;
+    const char *map = cache->map;
+    if (cache->map_len >= sizeof(Header)) {
+        cache->nodes_len = h->nodes_len;
+        cache->nodes = (const GraphCacheNode *) (map + h->nodes_off);
+        cache->commands = (const GraphCacheCommand *) (map + h->commands_off);
+        cache->ids = (const uint32_t *) (map + h->ids_off);
+        cache->paths_len = h->paths_len;
+        cache->paths = (const uint64_t *) (map + h->paths_off);
+        cache->index = (const uint32_t *) (map + h->index_off);
+        cache->index_cap = h->index_cap;
+        cache->strings = map + h->strings_off;
+    }
+    TRYBOOL_R(cache_valid(cache) && cache_current(cache), graph_cache_close(*cache));
+    return true;
+}
+
+// finds the node named name, it's only there if it was resolved when the cache was written
+bool graph_cache_find (const GraphCache *cache, const char *name, uint32_t *idx) {
+    size_t mask = cache->index_cap - 1;
+    for (size_t slot = hash_bytes(name, strlen(name)) & mask; cache->index[slot] != 0; slot = (slot + 1) & mask) {
+        uint32_t cand = cache->index[slot] - 1;
+        if (strcmp(cache->strings + cache->nodes[cand].name, name) == 0) {
+            *idx = cand;
+            return true;
+        }
+    }
+    return false;
+}
+
+// names, depfiles, shell commands and paths (cache->paths[id]) are string offsets
+const char *graph_cache_string (const GraphCache *cache, uint64_t offset) {
+    return cache->strings + offset;
+}
+
+void graph_cache_close (GraphCache cache) {
+    if (cache.map != NULL) munmap(cache.map, cache.map_len);
+}
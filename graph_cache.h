@@ -0,0 +1,53 @@
+// the resolved part of a graph saved to a file, so an unchanged build can skip lexing, parsing and resolving
+// the file is used straight from its mapping, everything in it is offsets
+
+#ifndef GRAPH_CACHE_H
+#define GRAPH_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "graph.h"
+
+// these are the file's own structs, 8 aligned
+typedef struct {
+    uint32_t type; // COMMAND_ACTION or COMMAND_SHELL
+    uint32_t action; // node index, for COMMAND_ACTION
+    uint64_t shell; // string offset, for COMMAND_SHELL
+} GraphCacheCommand;
+
+typedef struct {
+    uint64_t name; // string offset
+    uint64_t depfile; // string offset, empty if it doesn't have one
+    uint32_t reqs; // index of the first path id in the ids
+    uint32_t reqs_len; // just the build file's, what the deps log has can change without the build file
+    uint32_t commands; // index of the first command
+    uint32_t commands_len;
+    uint32_t updates; // index of the first path id in the ids
+    uint32_t updates_len;
+    uint32_t linkable; // its updates can be hardlinked, see materialize
+    uint32_t padding;
+} GraphCacheNode;
+
+// nodes are in graph order, dependencies first
+typedef struct {
+    void *map;
+    size_t map_len;
+    uint32_t nodes_len;
+    const GraphCacheNode *nodes;
+    const GraphCacheCommand *commands;
+    const uint32_t *ids;
+    uint32_t paths_len;
+    const uint64_t *paths; // string offsets by path id
+    const uint32_t *index; // open addressing by name hash, node index + 1 or 0 if empty
+    uint32_t index_cap;
+    const char *strings; // nul terminated
+} GraphCache;
+
+bool graph_cache_write (const Graph *, const char *);
+bool graph_cache_open (const char *, GraphCache *);
+bool graph_cache_find (const GraphCache *, const char *, uint32_t *);
+const char *graph_cache_string (const GraphCache *, uint64_t);
+void graph_cache_close (GraphCache);
+
+#endif
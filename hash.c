@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_OTHER
+#include "alloc.h"
+#include "hash.h"
+#include "try.h"
+
+// 64 bit fnv-1a
+#define FNV_OFFSET 0xcbf29ce484222325u
+#define FNV_PRIME 0x100000001b3u
+
+uint64_t hash_bytes (const void *data, size_t length) {
+    return hash_bytes_continue(FNV_OFFSET, data, length);
+}
+
+// keeps hashing from a previous hash, for data that comes in pieces
+uint64_t hash_bytes_continue (uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// content hashing works on four independent 64 bit lanes over 32 byte stripes, like xxhash64
+// there's no dependency between lanes, so they run in parallel in the cpu's pipelines
+// there's no avx2 or neon path: each round is a full 64 bit multiply, which neither has for vectors
+// words are read in native byte order, it's only compared on the machine that made it
+#define PRIME1 0x9e3779b185ebca87u
+#define PRIME2 0xc2b2ae3d27d4eb4fu
+#define PRIME3 0x165667b19e3779f9u
+#define PRIME4 0x85ebca77c2b2ae63u
+#define PRIME5 0x27d4eb2f165667c5u
+
+static uint64_t rotl (uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64 (const unsigned char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static uint64_t round64 (uint64_t acc, uint64_t word) {
+    return rotl(acc + word * PRIME2, 31) * PRIME1;
+}
+
+static uint64_t avalanche (uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    return hash ^ (hash >> 32);
+}
+
+// the two halves finish the lanes with different seeds, so they don't just repeat each other
+HashContent hash_content (const void *data, size_t len) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, -PRIME1 };
+    for (; end - p >= 32; p += 32) {
+        for (int i = 0; i < 4; ++i) lanes[i] = round64(lanes[i], read64(p + i * 8));
+    }
+
+    uint64_t tail = len * PRIME5;
+    for (; end - p >= 8; p += 8) tail = rotl(tail ^ round64(0, read64(p)), 27) * PRIME1 + PRIME4;
+    for (; p < end; ++p) tail = rotl(tail ^ (*p * PRIME5), 11) * PRIME1;
+
+    HashContent hash = { .lo = tail, .hi = tail ^ PRIME3 };
+    for (int i = 0; i < 4; ++i) {
+        hash.lo = (hash.lo ^ round64(0, lanes[i])) * PRIME1 + PRIME4;
+        hash.hi = rotl(hash.hi + lanes[i] * PRIME3, 23) * PRIME2;
+    }
+    hash.lo = avalanche(hash.lo);
+    hash.hi = avalanche(hash.hi ^ hash.lo);
+    return hash;
+}
+
+bool hash_content_equal (HashContent a, HashContent b) {
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+// chunks are hashed by a pool of threads started on first use and kept for the process
+// so hashing every build file on each cache write doesn't start threads per file
+// one batch of chunks is hashed at a time, its caller works on it too
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    HashContent *chunks;
+    size_t chunks_len;
+    size_t next; // chunk to hash next
+    size_t finished;
+    unsigned joined; // threads working on it, the caller included
+    unsigned threads; // most that may
+} ChunkBatch;
+
+#define MAX_HASH_THREADS 64
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work; // a batch was posted
+    pthread_cond_t done; // a chunk or a batch finished
+    unsigned workers;
+    ChunkBatch *batch; // NULL when there's none
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, NULL };
+
+// takes batch's chunks until there are none left, called with the pool locked and returns with it locked
+static void hash_batch (ChunkBatch *batch) {
+    while (batch->next < batch->chunks_len) {
+        size_t i = batch->next++;
+        pthread_mutex_unlock(&pool.lock);
+        size_t start = i * (size_t) HASH_CHUNK;
+        size_t len = batch->len - start < HASH_CHUNK ? batch->len - start : HASH_CHUNK;
+        batch->chunks[i] = hash_content(batch->data + start, len);
+        pthread_mutex_lock(&pool.lock);
+        if (++batch->finished == batch->chunks_len) pthread_cond_broadcast(&pool.done);
+    }
+}
+
+static void *pool_worker (void *arg) {
+    (void) arg;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        ChunkBatch *batch = pool.batch;
+        if (batch == NULL || batch->next == batch->chunks_len || batch->joined == batch->threads) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+            continue;
+        }
+        ++batch->joined;
+        hash_batch(batch);
+    }
+    return NULL;
+}
+
+// starts workers until there are want of them, called with the pool locked
+static void pool_grow (unsigned want) {
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) != 0) return;
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t id;
+    // fewer is fine, the caller does whatever's left
+    while (pool.workers < want && pthread_create(&id, &attr, pool_worker, NULL) == 0) ++pool.workers;
+    pthread_attr_destroy(&attr);
+}
+
+// a tree of the chunks' hashes: adjacent pairs are hashed together level by level, an odd one out goes up as it is
+// it's the same however many threads did the chunks, and overwrites them
+static HashContent combine_chunks (HashContent *chunks, size_t len) {
+    for (; len > 1; len = (len + 1) / 2) {
+        for (size_t i = 0; i < len / 2; ++i) chunks[i] = hash_content(chunks + 2 * i, 2 * sizeof(HashContent));
+        if (len % 2 == 1) chunks[len / 2] = chunks[len - 1];
+    }
+    return chunks[0];
+}
+
+// what hash_content_file gives for a file holding data, on up to threads threads
+HashContent hash_content_chunks (const void *bytes, size_t len, unsigned threads) {
+    const unsigned char *data = bytes;
+    if (len <= HASH_CHUNK) return hash_content(data, len);
+    size_t chunks_len = (len + HASH_CHUNK - 1) / HASH_CHUNK;
+    if (threads == 0) threads = 1;
+    if (threads > chunks_len) threads = chunks_len;
+    if (threads > MAX_HASH_THREADS) threads = MAX_HASH_THREADS;
+    ChunkBatch batch = {
+        .data = data,
+        .len = len,
+        .chunks = alloc_bytes(chunks_len * sizeof(HashContent)),
+        .chunks_len = chunks_len,
+        .next = 0,
+        .finished = 0,
+        .joined = 1,
+        .threads = threads
+    };
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.batch != NULL) pthread_cond_wait(&pool.done, &pool.lock);
+    pool_grow(threads - 1);
+    pool.batch = &batch;
+    pthread_cond_broadcast(&pool.work);
+    hash_batch(&batch);
+    while (batch.finished < batch.chunks_len) pthread_cond_wait(&pool.done, &pool.lock);
+    pool.batch = NULL;
+    // for callers waiting for their turn
+    pthread_cond_broadcast(&pool.done);
+    pthread_mutex_unlock(&pool.lock);
+
+    HashContent hash = combine_chunks(batch.chunks, chunks_len);
+    alloc_free(batch.chunks);
+    return hash;
+}
+
+// for what can't be mapped, big reads a chunk at a time on this thread
+static bool hash_read (int fd, HashContent *hash) {
+    unsigned char *buf = alloc_bytes(HASH_CHUNK);
+    size_t cap = 16;
+    size_t chunks_len = 0;
+    HashContent *chunks = alloc_bytes(cap * sizeof(HashContent));
+    bool ok = true;
+    for (off_t offset = 0;;) {
+        size_t len = 0;
+        ssize_t got;
+        while (len < HASH_CHUNK && (got = pread(fd, buf + len, HASH_CHUNK - len, offset + len)) > 0) len += got;
+        if (got < 0) {
+            ok = false;
+            break;
+        }
+        if (len == 0 && chunks_len > 0) break;
+        if (chunks_len == cap) {
+            cap *= 2;
+            chunks = alloc_resize(chunks, cap * sizeof(HashContent));
+        }
+        chunks[chunks_len++] = hash_content(buf, len);
+        offset += len;
+        if (len < HASH_CHUNK) break;
+    }
+    // one chunk is just its hash, like hash_content_chunks
+    if (ok) *hash = chunks_len == 1 ? chunks[0] : combine_chunks(chunks, chunks_len);
+    alloc_free(chunks);
+    alloc_free(buf);
+    return ok;
+}
+
+// hashes a whole file's contents with hash_content, or its chunks' on up to threads threads if it's big
+// the result doesn't depend on threads
+// false if it can't be read
+bool hash_content_file (const char *path, unsigned threads, HashContent *hash) {
+    int fd = open(path, O_RDONLY);
+    TRYBOOL(fd >= 0);
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    void *map = MAP_FAILED;
+    if (ok && S_ISREG(st.st_mode) && st.st_size > 0) map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ok && map != MAP_FAILED) {
+        *hash = hash_content_chunks(map, st.st_size, threads);
+        munmap(map, st.st_size);
+    } else if (ok) {
+        ok = hash_read(fd, hash);
+    }
+    close(fd);
+    return ok;
+}
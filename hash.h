@@ -0,0 +1,28 @@
+// non cryptographic content hashing
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// for names and small keys, fnv-1a
+uint64_t hash_bytes (const void *, size_t);
+uint64_t hash_bytes_continue (uint64_t, const void *, size_t);
+
+// for file contents, where input's too big for a byte at a time
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} HashContent;
+
+// files bigger than this are hashed a chunk at a time, each chunk on whichever thread
+#define HASH_CHUNK (4 << 20)
+
+HashContent hash_content (const void *, size_t);
+HashContent hash_content_chunks (const void *, size_t, unsigned);
+bool hash_content_file (const char *, unsigned, HashContent *);
+bool hash_content_equal (HashContent, HashContent);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#define ALLOC_SUBSYSTEM ALLOC_STRINGS
+#include "alloc.h"
+#include "hash.h"
+#include "intern.h"
+#include "try.h"
+
+Interner interner_new () {
+    return (Interner) {
+        .strs = NULL,
+        .hashes = NULL,
+        .len = 0,
+        .cap = 0,
+        .table = NULL,
+        .table_cap = 0
+    };
+}
+
+static uint64_t slice_hash (StringSlice str) {
+    return hash_bytes(str.back + str.start, str.length);
+}
+
+static bool slices_equal (StringSlice a, StringSlice b) {
+    return a.length == b.length && memcmp(a.back + a.start, b.back + b.start, a.length) == 0;
+}
+
+// finds str's slot, either holding str or empty
+static size_t find_slot (const Interner *interner, StringSlice str, uint64_t hash) {
+    size_t mask = interner->table_cap - 1;
+    size_t slot = hash & mask;
+    while (interner->table[slot] != 0) {
+        uint32_t id = interner->table[slot] - 1;
+        if (interner->hashes[id] == hash && slices_equal(interner->strs[id], str)) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// slot for an id that isn't in the table yet
+static size_t free_slot (const Interner *interner, uint64_t hash) {
+    size_t mask = interner->table_cap - 1;
+    size_t slot = hash & mask;
+    while (interner->table[slot] != 0) slot = (slot + 1) & mask;
+    return slot;
+}
+
+// keeps the table at most half full
+static void grow_table (Interner *interner) {
+    alloc_free(interner->table);
+    interner->table_cap = interner->table_cap == 0 ? 64 : interner->table_cap * 2;
+    interner->table = alloc_zeroed(interner->table_cap, sizeof(uint32_t));
+    for (uint32_t id = 0; id < interner->len; ++id) {
+        interner->table[free_slot(interner, interner->hashes[id])] = id + 1;
+    }
+}
+
+// returns str's id, adding it if it's new
+// str's backing has to outlive the interner
+uint32_t interner_add (Interner *interner, StringSlice str) {
+    return interner_add_hashed(interner, str, slice_hash(str));
+}
+
+// interner_add with str's hash_bytes already known (e.g. stored next to it on disk)
+uint32_t interner_add_hashed (Interner *interner, StringSlice str, uint64_t hash) {
+    if ((interner->len + 1) * 2 > interner->table_cap) grow_table(interner);
+
+    size_t slot = find_slot(interner, str, hash);
+    if (interner->table[slot] != 0) return interner->table[slot] - 1;
+
+    if (interner->len == interner->cap) {
+        interner->cap = interner->cap == 0 ? 64 : interner->cap * 2;
+        interner->strs = alloc_resize(interner->strs, interner->cap * sizeof(StringSlice));
+        interner->hashes = alloc_resize(interner->hashes, interner->cap * sizeof(uint64_t));
+    }
+    interner->strs[interner->len] = str;
+    interner->hashes[interner->len] = hash;
+    interner->table[slot] = interner->len + 1;
+    return interner->len++;
+}
+
+bool interner_find (const Interner *interner, StringSlice str, uint32_t *id) {
+    TRYBOOL(interner->table_cap > 0);
+    size_t slot = find_slot(interner, str, slice_hash(str));
+    TRYBOOL(interner->table[slot] != 0);
+    *id = interner->table[slot] - 1;
+    return true;
+}
+
+StringSlice interner_get (const Interner *interner, uint32_t id) {
+    return interner->strs[id];
+}
+
+// doesn't free the strings' backing
+void interner_free (Interner interner) {
+    alloc_free(interner.strs);
+    alloc_free(interner.hashes);
+    alloc_free(interner.table);
+}
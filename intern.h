@@ -0,0 +1,27 @@
+// string interning, gives every distinct string a small sequential id
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "slice.h"
+
+typedef struct {
+    StringSlice *strs; // indexed by id, not owned
+    uint64_t *hashes; // indexed by id, so growing doesn't rehash every string
+    uint32_t len;
+    uint32_t cap;
+    uint32_t *table; // open addressing, id + 1 or 0 if empty
+    size_t table_cap; // power of two
+} Interner;
+
+Interner interner_new ();
+uint32_t interner_add (Interner *, StringSlice);
+uint32_t interner_add_hashed (Interner *, StringSlice, uint64_t);
+bool interner_find (const Interner *, StringSlice, uint32_t *);
+StringSlice interner_get (const Interner *, uint32_t);
+void interner_free (Interner);
+
+#endif
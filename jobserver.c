@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_OTHER
+#include "alloc.h"
+#include "jobserver.h"
+#include "try.h"
+
+// what gnu make writes; clients hand back whatever byte they took though
+#define JOBSERVER_TOKEN '+'
+
+// reopens fd through /proc so O_NONBLOCK only applies to us
+// setting it on the shared description would break every other client
+// returns -1 if /proc isn't there
+static int private_fd (int fd) {
+    char path[sizeof("/proc/self/fd/") + 3 * sizeof(int)];
+    sprintf(path, "/proc/self/fd/%d", fd);
+    return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+static bool fd_valid (int fd) {
+    return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+// finds the value of the last --jobserver-auth= (or pre 4.2 --jobserver-fds=) in makeflags
+// the value isn't null terminated, it ends at whitespace
+static bool find_auth (const char *makeflags, const char **auth, size_t *auth_len) {
+    const char *prefixes[2] = { "--jobserver-auth=", "--jobserver-fds=" };
+    bool found = false;
+    const char *word = makeflags;
+    while (*word != '\0') {
+        while (*word == ' ' || *word == '\t') ++word;
+        size_t word_len = strcspn(word, " \t");
+        for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
+            size_t prefix_len = strlen(prefixes[i]);
+            if (word_len > prefix_len && strncmp(word, prefixes[i], prefix_len) == 0) {
+                *auth = word + prefix_len;
+                *auth_len = word_len - prefix_len;
+                found = true;
+            }
+        }
+        word += word_len;
+    }
+    return found;
+}
+
+// makes a fresh fifo in $TMPDIR, path is alloced in here
+static bool make_fifo (char **path) {
+    static unsigned int counter = 0;
+    const char *tmpdir = getenv("TMPDIR");
+    if (tmpdir == NULL || *tmpdir == '\0') tmpdir = "/tmp";
+
+    for (int tries = 0; tries < 100; ++tries, ++counter) {
+        int path_len = snprintf(NULL, 0, "%s/bidet-jobserver-%ld-%u", tmpdir, (long) getpid(), counter);
+        *path = alloc_bytes(path_len + 1);
+        sprintf(*path, "%s/bidet-jobserver-%ld-%u", tmpdir, (long) getpid(), counter);
+        if (mkfifo(*path, 0600) == 0) {
+            ++counter;
+            return true;
+        }
+        alloc_free(*path);
+        if (errno != EEXIST) return false;
+    }
+    return false;
+}
+
+// connects to the jobserver described by makeflags (MAKEFLAGS's value, can be NULL)
+// fails if there's no jobserver, or if make didn't pass the pipe down (command not marked recursive)
+bool jobserver_connect (const char *makeflags, Jobserver *js) {
+    TRYBOOL(makeflags != NULL);
+    const char *auth;
+    size_t auth_len;
+    TRYBOOL(find_auth(makeflags, &auth, &auth_len));
+
+    js->owner = false;
+    if (auth_len > strlen("fifo:") && strncmp(auth, "fifo:", strlen("fifo:")) == 0) {
+        size_t path_len = auth_len - strlen("fifo:");
+        js->type = JOBSERVER_FIFO;
+        js->auth_fds[0] = js->auth_fds[1] = -1;
+        js->fifo_path = alloc_bytes(path_len + 1);
+        memcpy(js->fifo_path, auth + strlen("fifo:"), path_len);
+        js->fifo_path[path_len] = '\0';
+        // O_RDWR so an idle fifo reads as empty instead of eof
+        js->fd = open(js->fifo_path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        TRYBOOL_R(js->fd != -1, alloc_free(js->fifo_path));
+        return true;
+    }
+
+    int read_fd;
+    int write_fd;
+    // sscanf stops at the whitespace after the value
+    TRYBOOL(sscanf(auth, "%d,%d", &read_fd, &write_fd) == 2);
+    TRYBOOL(fd_valid(read_fd) && fd_valid(write_fd));
+    js->type = JOBSERVER_PIPE;
+    js->auth_fds[0] = read_fd;
+    js->auth_fds[1] = write_fd;
+    js->fifo_path = NULL;
+    js->fd = private_fd(read_fd);
+    return true;
+}
+
+// makes a jobserver allowing jobs jobs at once, including our own implicit one
+bool jobserver_create (JobserverType type, size_t jobs, Jobserver *js) {
+    js->type = type;
+    js->owner = true;
+    if (type == JOBSERVER_PIPE) {
+        // children need these, so no O_CLOEXEC
+        TRYBOOL(pipe(js->auth_fds) == 0);
+        js->fifo_path = NULL;
+        js->fd = private_fd(js->auth_fds[0]);
+    } else {
+        js->auth_fds[0] = js->auth_fds[1] = -1;
+        TRYBOOL(make_fifo(&js->fifo_path));
+        js->fd = open(js->fifo_path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        TRYBOOL_R(js->fd != -1, unlink(js->fifo_path), alloc_free(js->fifo_path));
+    }
+
+    for (size_t i = 1; i < jobs; ++i) {
+        TRYBOOL_R(jobserver_release(js, JOBSERVER_TOKEN), jobserver_free(*js));
+    }
+    return true;
+}
+
+// takes a token if one is free right now
+bool jobserver_try_acquire (const Jobserver *js, char *token) {
+    int fd = js->fd;
+    if (fd == -1) {
+        // no private nonblocking fd, so poll the shared one
+        // someone else can still take the token before we read, then we block until one comes back
+        struct pollfd pfd = { .fd = js->auth_fds[0], .events = POLLIN };
+        TRYBOOL(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN));
+        fd = js->auth_fds[0];
+    }
+
+    ssize_t res;
+    do {
+        res = read(fd, token, 1);
+    } while (res == -1 && errno == EINTR);
+    return res == 1;
+}
+
+// blocks until a token is free
+// fails when nobody can ever write a token again
+bool jobserver_acquire (const Jobserver *js, char *token) {
+    while (!jobserver_try_acquire(js, token)) {
+        struct pollfd pfd = { .fd = js->fd == -1 ? js->auth_fds[0] : js->fd, .events = POLLIN };
+        int res = poll(&pfd, 1, -1);
+        TRYBOOL(res != -1 || errno == EINTR);
+        TRYBOOL(res == -1 || (pfd.revents & POLLIN));
+    }
+    return true;
+}
+
+// gives back a token from jobserver_acquire
+bool jobserver_release (const Jobserver *js, char token) {
+    int fd = js->type == JOBSERVER_PIPE ? js->auth_fds[1] : js->fd;
+    ssize_t res;
+    do {
+        res = write(fd, &token, 1);
+    } while (res == -1 && errno == EINTR);
+    return res == 1;
+}
+
+// MAKEFLAGS for children so they share our jobserver
+// jobs is the total limit, passed along for tools that only read -j
+// alloced in here
+char *jobserver_makeflags (const Jobserver *js, size_t jobs) {
+    char *flags;
+    if (js->type == JOBSERVER_PIPE) {
+        int flags_len = snprintf(NULL, 0, "-j%zu --jobserver-auth=%d,%d", jobs, js->auth_fds[0], js->auth_fds[1]);
+        flags = alloc_bytes(flags_len + 1);
+        sprintf(flags, "-j%zu --jobserver-auth=%d,%d", jobs, js->auth_fds[0], js->auth_fds[1]);
+    } else {
+        int flags_len = snprintf(NULL, 0, "-j%zu --jobserver-auth=fifo:%s", jobs, js->fifo_path);
+        flags = alloc_bytes(flags_len + 1);
+        sprintf(flags, "-j%zu --jobserver-auth=fifo:%s", jobs, js->fifo_path);
+    }
+    return flags;
+}
+
+// tokens still held aren't given back, release them first
+void jobserver_free (Jobserver js) {
+    if (js.fd != -1) close(js.fd);
+    if (js.owner) {
+        if (js.type == JOBSERVER_PIPE) {
+            close(js.auth_fds[0]);
+            close(js.auth_fds[1]);
+        } else {
+            unlink(js.fifo_path);
+        }
+    }
+    alloc_free(js.fifo_path);
+}
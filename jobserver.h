@@ -0,0 +1,31 @@
+// gnu make jobserver
+// a client when MAKEFLAGS has one, a server for our children otherwise
+
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    JOBSERVER_PIPE,
+    JOBSERVER_FIFO
+} JobserverType;
+
+typedef struct {
+    JobserverType type;
+    int auth_fds[2]; // pipe fds handed to children, -1 for fifo
+    char *fifo_path; // fifo handed to children, NULL for pipe
+    int fd; // our own nonblocking descriptor for taking tokens, -1 if we couldn't get one
+    bool owner; // true if we made it (so we remove the fifo)
+} Jobserver;
+
+bool jobserver_connect (const char *, Jobserver *);
+bool jobserver_create (JobserverType, size_t, Jobserver *);
+bool jobserver_try_acquire (const Jobserver *, char *);
+bool jobserver_acquire (const Jobserver *, char *);
+bool jobserver_release (const Jobserver *, char);
+char *jobserver_makeflags (const Jobserver *, size_t);
+void jobserver_free (Jobserver);
+
+#endif
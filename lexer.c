@@ -1,10 +1,17 @@
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define ALLOC_SUBSYSTEM ALLOC_LEXER
+#include "alloc.h"
 #include "fmt_error.h"
 #include "lexer.h"
 #include "try.h"
 
+VEC_DEFINE(InterpolParts, interpol_parts, InterpolPart, 1)
+VEC_DEFINE(Tokens, tokens, Token, 0)
+
 typedef struct {
     Prog prog; // program info
     size_t offset; // offset from beginning of file
@@ -44,7 +51,7 @@ static bool take_char (LexState *s, char chr) {
 
 static bool take_chars (LexState *s, char* chrs) {
     LexState s_save = *s;
-    while (*chrs != '\0' && take_char(s, *chrs++)) ++s->offset;
+    while (*chrs != '\0' && take_char(s, *chrs)) ++chrs;
     if (*chrs == '\0') {
         return true;
     } else {
@@ -90,7 +97,8 @@ static bool valid_ident_char (char c) {
     return ('0' <= c && c <= '9') ||
         ('A' <= c && c <= 'Z') ||
         ('a' <= c && c <= 'z') ||
-        c == '-' || c == '_';
+        c == '-' || c == '_' ||
+        c == '%'; // for pattern actions
 }
 
 static bool lex_ident (LexState *s, Token *tok) {
@@ -148,7 +156,7 @@ static bool lex_string (LexState *s, Token *tok) {
     TRYBOOL(lex_quote_start(s, &backticks));
     InterpolString str = (InterpolString) {
         .backticks = backticks,
-        .parts = list_new()
+        .parts = VEC_EMPTY
     };
 
     size_t str_section_start = s_save.offset + backticks + 1;
@@ -158,31 +166,30 @@ static bool lex_string (LexState *s, Token *tok) {
         if (take_chars(s, "$(")) {
             // dont want empty strings
             if (str_section_len > 0) {
-                list_push(&str.parts, malloc(sizeof(InterpolPart)));
-                *(InterpolPart *) str.parts.last->data = (InterpolPart) {
+                *interpol_parts_push(&str.parts) = (InterpolPart) {
                     .type = INTERPOL_STRING,
                     .data = str_to_slice(s->prog.text, str_section_start, str_section_len)
                 };
                 str_section_len = 0;
             }
             Token ident;
-            TRYBOOL_R(lex_ident(s, &ident), list_free(str.parts), *s = s_save);
-            list_push(&str.parts, malloc(sizeof(InterpolPart)));
-            *(InterpolPart *) str.parts.last->data = (InterpolPart) {
+            TRYBOOL_R(lex_ident(s, &ident), interpol_parts_free(str.parts), *s = s_save);
+            *interpol_parts_push(&str.parts) = (InterpolPart) {
                 .type = INTERPOL_IDENT,
                 .data = ident.data.ident
             };
 
-            TRYBOOL_R(take_char(s, ')'), list_free(str.parts), *s = s_save);
+            TRYBOOL_R(take_char(s, ')'), interpol_parts_free(str.parts), *s = s_save);
             str_section_start = s->offset;
+            // the string could end or interpolate again right away
+            continue;
         }
         char c;
-        TRYBOOL_R(next(s, &c), list_free(str.parts), *s = s_save);
+        TRYBOOL_R(next(s, &c), interpol_parts_free(str.parts), *s = s_save);
         ++str_section_len;
     }
     if (str_section_len > 0) {
-        list_push(&str.parts, malloc(sizeof(InterpolPart)));
-        *(InterpolPart *) str.parts.last->data = (InterpolPart) {
+        *interpol_parts_push(&str.parts) = (InterpolPart) {
             .type = INTERPOL_STRING,
             .data = str_to_slice(s->prog.text, str_section_start, str_section_len)
         };
@@ -200,54 +207,210 @@ static bool take_whitespace (LexState *s) {
     return true;
 }
 
-bool lex (Prog prog, LList *tokens) {
-    // starting state
-    LexState state = (LexState) {
-        .prog = prog,
-        .offset = 0
-    };
+// offsets of unexpected characters, reported later
+typedef struct {
+    size_t *offsets;
+    size_t len;
+    size_t cap;
+} ErrorOffsets;
+
+static void unexpected_err (Prog prog, size_t offset) {
+    char *message = alloc_bytes(sizeof("unexpected character: x\n"));
+    // prog.text[offset] can never be \0 because it would've been caught in the loop
+    sprintf(message, "unexpected character: %c\n", prog.text[offset]); // fputs doesnt newline :((
+    report_err(prog, offset, message);
+    alloc_free(message);
+}
+
+// lexes the next token from s's offset, unless it would start at or after end
+// errors are reported right away, or just pushed to deferred if it isn't NULL, and set failed
+static bool lex_one (LexState *state, size_t end, Token *tok, ErrorOffsets *deferred, bool *failed) {
     // array of possible lexers
     bool (*lexers[3]) (LexState *, Token *) = { lex_symbol, lex_string, lex_ident };
-    *tokens = list_new();
 
-    // whether lexer failed while lexing
-    bool failed = false;
-    while (state.prog.text[state.offset] != '\0') {
-        bool one_succeeded = false;
+    while (state->offset < end && state->prog.text[state->offset] != '\0') {
         for (size_t i = 0; i < sizeof(lexers) / sizeof(lexers[0]); ++i) {
-            Token tok;
-            if (lexers[i](&state, &tok)) {
-                one_succeeded = true;
-                Token *tok_heap = malloc(sizeof(Token));
-                *tok_heap = tok;
-                list_push(tokens, tok_heap);
-                take_whitespace(&state);
-                break;
+            if (lexers[i](state, tok)) {
+                take_whitespace(state);
+                return true;
             }
         }
         // no lexers worked
-        if (!one_succeeded) {
-            failed = true;
-
-            // print error
-            char *message = malloc(sizeof("unexpected character: x\n"));
-            // state.prog.text[state.offset] can never be \0 because it would've been caught in the loop
-            sprintf(message, "unexpected character: %c\n", state.prog.text[state.offset]); // fputs doesnt newline :((
-            char *err = fmt_err(state.prog, state.offset, message);
-            fputs(err, stderr);
-            free(err);
-            ++state.offset;
+        *failed = true;
+        if (deferred == NULL) {
+            unexpected_err(state->prog, state->offset);
+        } else {
+            if (deferred->len == deferred->cap) {
+                deferred->cap = deferred->cap == 0 ? 16 : deferred->cap * 2;
+                deferred->offsets = alloc_resize(deferred->offsets, deferred->cap * sizeof(size_t));
+            }
+            deferred->offsets[deferred->len++] = state->offset;
         }
+        ++state->offset;
     }
+    return false;
+}
+
+// lexes from s's offset until the next token would start at or after end
+// tokens can run past end, s is left where the next one would start
+static bool lex_range (LexState *state, size_t end, Tokens *tokens, ErrorOffsets *deferred) {
+    bool failed = false;
+    Token tok;
+    while (lex_one(state, end, &tok, deferred, &failed)) *tokens_push(tokens) = tok;
     return !failed;
 }
 
-// frees tokens from lex given tokens and length
-void free_tokens (LList tokens) {
-    FOREACH(Token, tok, tokens) {
-        if (tok.type == STRING) {
-            list_free(tok.data.string.parts);
+bool lex (Prog prog, Tokens *tokens) {
+    // starting state
+    LexState state = (LexState) {
+        .prog = prog,
+        .offset = 0
+    };
+    *tokens = (Tokens) VEC_EMPTY;
+    return lex_range(&state, SIZE_MAX, tokens, NULL);
+}
+
+Lexer lexer_new (Prog prog) {
+    return (Lexer) { .prog = prog, .offset = 0, .failed = false };
+}
+
+// the next token, false at the end of the text
+// errors are reported as they're reached and set failed
+bool lexer_next (Lexer *lexer, Token *tok) {
+    LexState state = (LexState) {
+        .prog = lexer->prog,
+        .offset = lexer->offset
+    };
+    bool got = lex_one(&state, SIZE_MAX, tok, NULL, &lexer->failed);
+    lexer->offset = state.offset;
+    return got;
+}
+
+// one thread's share of lex_parallel
+typedef struct {
+    pthread_t thread;
+    Prog prog;
+    size_t start;
+    size_t end;
+    Tokens tokens;
+    size_t stop; // where the next token would start
+    // formatting an error walks the text from the start, so only chunks that get used pay for it
+    ErrorOffsets errors;
+} LexChunk;
+
+static void *lex_chunk (void *arg) {
+    LexChunk *chunk = arg;
+    LexState state = (LexState) {
+        .prog = chunk->prog,
+        .offset = chunk->start
+    };
+    // guessing the chunk starts between tokens, where lex would've skipped whitespace
+    if (chunk->start > 0) take_whitespace(&state);
+    chunk->tokens = (Tokens) VEC_EMPTY;
+    chunk->errors = (ErrorOffsets) { .offsets = NULL, .len = 0, .cap = 0 };
+    lex_range(&state, chunk->end, &chunk->tokens, &chunk->errors);
+    chunk->stop = state.offset;
+    return NULL;
+}
+
+// frees what a token from lexer_next owns
+void free_token (Token tok) {
+    if (tok.type == STRING) interpol_parts_free(tok.data.string.parts);
+}
+
+// appends chunk's tokens as lex would've lexed them, continuing from state
+// lexing is only its offset, so once lex would be somewhere the chunk's lexer also was,
+// everything the chunk lexed from there on is right
+// until then (like when the chunk started inside a string) it's lexed again here one token at a time
+static bool merge_chunk (LexState *state, LexChunk *chunk, Tokens *tokens) {
+    LexState guess = (LexState) {
+        .prog = chunk->prog,
+        .offset = chunk->start
+    };
+    if (chunk->start > 0) take_whitespace(&guess);
+
+    bool ok = true;
+    const Token *chunk_tokens = VEC_ITEMS(chunk->tokens);
+    uint32_t next_tok = 0;
+    size_t error = 0;
+    bool synced = state->offset == guess.offset;
+    while (!synced && state->offset < chunk->end && state->prog.text[state->offset] != '\0') {
+        ok = lex_range(state, state->offset + 1, tokens, NULL) && ok;
+        // drop what the chunk lexed before here
+        while (next_tok < chunk->tokens.len && chunk_tokens[next_tok].offset < state->offset) {
+            free_token(chunk_tokens[next_tok++]);
+        }
+        while (error < chunk->errors.len && chunk->errors.offsets[error] < state->offset) ++error;
+        synced = (next_tok < chunk->tokens.len && chunk_tokens[next_tok].offset == state->offset)
+            || (error < chunk->errors.len && chunk->errors.offsets[error] == state->offset);
+    }
+
+    if (synced) {
+        tokens_append(tokens, chunk_tokens + next_tok, chunk->tokens.len - next_tok);
+        for (; error < chunk->errors.len; ++error) {
+            unexpected_err(state->prog, chunk->errors.offsets[error]);
+            ok = false;
         }
+        state->offset = chunk->stop;
+    } else {
+        for (; next_tok < chunk->tokens.len; ++next_tok) free_token(chunk_tokens[next_tok]);
+    }
+    tokens_free(chunk->tokens);
+    alloc_free(chunk->errors.offsets);
+    return ok;
+}
+
+// the first ";\n" ending at or after offset, or len if there isn't one
+static size_t next_boundary (const char *text, size_t offset, size_t len) {
+    const char *semi;
+    while (offset < len && (semi = memchr(text + offset, ';', len - offset)) != NULL) {
+        offset = semi - text + 1;
+        if (text[offset] == '\n') return offset + 1;
+    }
+    return len;
+}
+
+// same tokens, return value and errors as lex, but big programs are split across threads
+// chunks start after a ";\n", guessing that's between statements
+// a chunk that actually starts inside something (like a string with ";\n" in it) is thrown away,
+// and lexed again from where the chunk before it really stopped
+bool lex_parallel (Prog prog, unsigned threads, Tokens *tokens) {
+    size_t len = strlen(prog.text);
+    if (threads <= 1 || len < LEX_PARALLEL_MIN_LEN) return lex(prog, tokens);
+
+    LexChunk *chunks = alloc_bytes(threads * sizeof(LexChunk));
+    unsigned chunks_len = 0;
+    size_t start = 0;
+    for (unsigned i = 0; i < threads && start < len; ++i) {
+        size_t target = (i + 1) * (len / threads);
+        size_t end = i + 1 == threads ? len : next_boundary(prog.text, target > start ? target : start, len);
+        chunks[chunks_len++] = (LexChunk) { .prog = prog, .start = start, .end = end };
+        start = end;
+    }
+    chunks[chunks_len - 1].end = SIZE_MAX;
+
+    // the first one runs here
+    unsigned started = 1;
+    while (started < chunks_len && pthread_create(&chunks[started].thread, NULL, lex_chunk, chunks + started) == 0) {
+        ++started;
     }
-    list_free(tokens);
+    lex_chunk(chunks);
+    for (unsigned i = started; i < chunks_len; ++i) lex_chunk(chunks + i);
+    for (unsigned i = 1; i < started; ++i) pthread_join(chunks[i].thread, NULL);
+
+    *tokens = (Tokens) VEC_EMPTY;
+    LexState state = (LexState) {
+        .prog = prog,
+        .offset = 0
+    };
+    bool ok = true;
+    for (unsigned i = 0; i < chunks_len; ++i) ok = merge_chunk(&state, chunks + i, tokens) && ok;
+    alloc_free(chunks);
+    return ok;
+}
+
+// frees tokens from lex given tokens and length
+void free_tokens (Tokens tokens) {
+    VEC_FOREACH(const Token, tok, tokens) free_token(*tok);
+    tokens_free(tokens);
 }
@@ -1,8 +1,11 @@
+#ifndef LEXER_H
+#define LEXER_H
+
 #include <stdbool.h>
 #include <stddef.h>
-#include "list.h"
 #include "prog.h"
 #include "slice.h"
+#include "vec.h"
 
 typedef enum {
     ARROW,
@@ -23,10 +26,13 @@ typedef struct {
     StringSlice data;
 } InterpolPart;
 
+// most strings are one plain part
+VEC_DECLARE(InterpolParts, interpol_parts, InterpolPart, 1)
+
 // interpolated string
 typedef struct {
     size_t backticks;
-    LList parts;
+    InterpolParts parts;
 } InterpolString; // wee woo wee woo
 
 typedef struct {
@@ -39,5 +45,23 @@ typedef struct {
     size_t length;
 } Token;
 
-bool lex (Prog, LList *);
-void free_tokens (LList);
+VEC_DECLARE(Tokens, tokens, Token, 0)
+
+// programs smaller than this aren't worth splitting
+#define LEX_PARALLEL_MIN_LEN (1 << 16)
+
+// lexes a token at a time, for parsing without keeping them all
+typedef struct {
+    Prog prog;
+    size_t offset;
+    bool failed;
+} Lexer;
+
+bool lex (Prog, Tokens *);
+bool lex_parallel (Prog, unsigned, Tokens *);
+void free_tokens (Tokens);
+Lexer lexer_new (Prog);
+bool lexer_next (Lexer *, Token *);
+void free_token (Token);
+
+#endif
@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#define ALLOC_SUBSYSTEM ALLOC_LIST
+#include "alloc.h"
 #include "list.h"
 
 LList list_new () {
@@ -25,12 +27,12 @@ size_t list_len (LList list) {
 
 void list_push (LList *list, void *elem) {
     if (list->head != NULL) {
-        list->last->next = malloc(sizeof(LLNode));
+        list->last->next = alloc_bytes(sizeof(LLNode));
         list->last->next->data = elem;
         list->last->next->next = NULL;
         list->last = list->last->next;
     } else {
-        list->last = malloc(sizeof(LLNode));
+        list->last = alloc_bytes(sizeof(LLNode));
         list->last->data = elem;
         list->last->next = NULL;
         list->head = list->last;
@@ -42,7 +44,7 @@ void list_free (LList list) {
     while (node != NULL) {
         LLNode *tmp = node;
         node = node->next;
-        free(tmp->data);
-        free(tmp);
+        alloc_free(tmp->data);
+        alloc_free(tmp);
     }
 }
@@ -1,5 +1,8 @@
 // linked list
 
+#ifndef LIST_H
+#define LIST_H
+
 #include <stddef.h>
 
 struct LLNode {
@@ -20,6 +23,4 @@ size_t list_len (LList);
 void list_push (LList *, void *);
 void list_free (LList);
 
-#define FOREACH(type, var, list) \
-    type var; /* hope you didnt use the same name twice! (maybe use that local struct trick?) */ \
-    for (LLNode *FOREACH_NODE##var = list.head; FOREACH_NODE##var != NULL && (var = *(type *) FOREACH_NODE##var->data, true); FOREACH_NODE##var = FOREACH_NODE##var->next)
+#endif
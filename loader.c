@@ -0,0 +1,282 @@
+#define _XOPEN_SOURCE 700
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_LOADER
+#include "alloc.h"
+#include "intern.h"
+#include "lexer.h"
+#include "loader.h"
+#include "parser.h"
+#include "try.h"
+
+// shared between the workers, everything in here is behind lock
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    BuildFiles *out;
+    Interner seen; // by key, ids are file indices
+    uint32_t *queue;
+    uint32_t queue_len;
+    uint32_t queue_cap;
+    uint32_t pending; // queued or being loaded
+} LoadState;
+
+static char *read_file (const char *path) {
+    FILE *file = fopen(path, "rb");
+    TRYBOOL(file != NULL);
+    size_t text_len = 0;
+    size_t text_cap = 4096;
+    char *text = alloc_bytes(text_cap);
+    size_t read;
+    while ((read = fread(text + text_len, 1, text_cap - text_len - 1, file)) > 0) {
+        text_len += read;
+        if (text_cap - text_len == 1) {
+            text_cap *= 2;
+            text = alloc_resize(text, text_cap);
+        }
+    }
+    fclose(file);
+    text[text_len] = '\0';
+    return text;
+}
+
+// drops . and dir/.. components, so a file included through different relative paths gets one name
+// symlinks aren't followed, the key catches those
+static void normalize_path (char *path) {
+    bool absolute = path[0] == '/';
+    char *copy = alloc_strdup(path);
+    size_t parts_cap = 1;
+    for (const char *c = path; *c != '\0'; ++c) parts_cap += *c == '/';
+    char **parts = alloc_bytes(parts_cap * sizeof(char *));
+    size_t parts_len = 0;
+    char *save;
+    for (char *part = strtok_r(copy, "/", &save); part != NULL; part = strtok_r(NULL, "/", &save)) {
+        if (strcmp(part, ".") == 0) continue;
+        if (strcmp(part, "..") == 0 && parts_len > 0 && strcmp(parts[parts_len - 1], "..") != 0) {
+            --parts_len;
+        } else if (strcmp(part, "..") != 0 || !absolute) {
+            parts[parts_len++] = part;
+        }
+    }
+
+    char *out = path;
+    if (absolute) *out++ = '/';
+    for (size_t i = 0; i < parts_len; ++i) {
+        if (i > 0) *out++ = '/';
+        size_t len = strlen(parts[i]);
+        memcpy(out, parts[i], len);
+        out += len;
+    }
+    *out = '\0';
+    alloc_free(parts);
+    alloc_free(copy);
+}
+
+// path relative to the directory dir_of is in
+static char *join_dir (const char *dir_of, StringSlice path) {
+    const char *slash = strrchr(dir_of, '/');
+    bool absolute = path.length > 0 && path.back[path.start] == '/';
+    size_t dir_len = absolute || slash == NULL ? 0 : slash - dir_of + 1;
+    char *joined = alloc_bytes(dir_len + path.length + 1);
+    memcpy(joined, dir_of, dir_len);
+    memcpy(joined + dir_len, path.back + path.start, path.length);
+    joined[dir_len + path.length] = '\0';
+    normalize_path(joined);
+    return joined;
+}
+
+// the same file through different paths gets the same key
+// missing files keep their path, loading them reports the error
+static char *path_key (const char *path) {
+    char *key = realpath(path, NULL);
+    return key != NULL ? key : alloc_strdup(path);
+}
+
+static BuildFile *new_file (char *path, char *key) {
+    BuildFile *file = alloc_bytes(sizeof(BuildFile));
+    *file = (BuildFile) {
+        .path = path,
+        .key = key,
+        .text = NULL,
+        .tokens = VEC_EMPTY,
+        .ok = false,
+        .includes = NULL,
+        .includes_len = 0,
+        .diagnostics = NULL,
+        .diagnostics_len = 0
+    };
+    file->ast = (ASTProg) { .actions = VEC_EMPTY, .vars = VEC_EMPTY, .includes = VEC_EMPTY };
+    return file;
+}
+
+// reads, lexes and parses file, with its diagnostics going to its own buffer
+static void load_file (BuildFile *file) {
+    FILE *errors = open_memstream(&file->diagnostics, &file->diagnostics_len);
+    file->text = read_file(file->path);
+    file->prog = (Prog) { .filename = file->path, .text = file->text, .errors = errors };
+    if (file->text == NULL) {
+        fprintf(errors, "[%s] couldn't open build file\n", file->path);
+    } else if (lex(file->prog, &file->tokens)) {
+        free_prog(file->ast);
+        file->ok = parse(file->prog, file->tokens, &file->ast);
+    }
+    fclose(errors);
+    // anything reported later goes straight to stderr
+    file->prog.errors = NULL;
+}
+
+static void push_queue (LoadState *state, uint32_t idx) {
+    if (state->queue_len == state->queue_cap) {
+        state->queue_cap = state->queue_cap == 0 ? 64 : state->queue_cap * 2;
+        state->queue = alloc_resize(state->queue, state->queue_cap * sizeof(uint32_t));
+    }
+    state->queue[state->queue_len++] = idx;
+    ++state->pending;
+}
+
+// finds the key's file, queueing a new one for path if it hasn't been seen
+// takes path and key
+static uint32_t add_file (LoadState *state, char *path, char *key) {
+    uint32_t idx;
+    if (interner_find(&state->seen, str_to_slice_raw(key), &idx)) {
+        alloc_free(path);
+        alloc_free(key);
+        return idx;
+    }
+
+    BuildFiles *out = state->out;
+    if (out->files_len == out->files_cap) {
+        out->files_cap = out->files_cap == 0 ? 64 : out->files_cap * 2;
+        out->files = alloc_resize(out->files, out->files_cap * sizeof(BuildFile *));
+    }
+    idx = out->files_len++;
+    out->files[idx] = new_file(path, key);
+    interner_add(&state->seen, str_to_slice_raw(key));
+    push_queue(state, idx);
+    pthread_cond_signal(&state->cond);
+    return idx;
+}
+
+static void *worker (void *arg) {
+    LoadState *state = arg;
+    pthread_mutex_lock(&state->lock);
+    while (true) {
+        while (state->queue_len == 0 && state->pending > 0) pthread_cond_wait(&state->cond, &state->lock);
+        if (state->queue_len == 0) break;
+        BuildFile *file = state->out->files[state->queue[--state->queue_len]];
+        pthread_mutex_unlock(&state->lock);
+
+        // the slow part, done without the lock
+        load_file(file);
+        uint32_t includes_len = file->ast.includes.len;
+        char **paths = alloc_bytes((includes_len > 0 ? includes_len : 1) * sizeof(char *));
+        char **keys = alloc_bytes((includes_len > 0 ? includes_len : 1) * sizeof(char *));
+        uint32_t i = 0;
+        VEC_FOREACH(const ASTInclude, include, file->ast.includes) {
+            paths[i] = join_dir(file->path, include->path);
+            keys[i] = path_key(paths[i]);
+            ++i;
+        }
+        file->includes = alloc_bytes((includes_len > 0 ? includes_len : 1) * sizeof(uint32_t));
+        file->includes_len = includes_len;
+
+        pthread_mutex_lock(&state->lock);
+        for (i = 0; i < includes_len; ++i) file->includes[i] = add_file(state, paths[i], keys[i]);
+        alloc_free(paths);
+        alloc_free(keys);
+        if (--state->pending == 0) pthread_cond_broadcast(&state->cond);
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+// depth first from idx, each file the first time it's reached
+static void add_order (BuildFiles *files, bool *visited, uint32_t idx, uint32_t *order_len) {
+    if (visited[idx]) return;
+    visited[idx] = true;
+    files->order[(*order_len)++] = idx;
+    const BuildFile *file = files->files[idx];
+    for (uint32_t i = 0; i < file->includes_len; ++i) add_order(files, visited, file->includes[i], order_len);
+}
+
+// loads root and everything it includes, on threads threads (0 for one per cpu)
+// diagnostics are written to stderr afterwards, file by file in include order
+// false if any file failed to load, the ones that didn't are still filled in
+bool load_build_files (const char *root, unsigned threads, BuildFiles *files) {
+    *files = (BuildFiles) {
+        .files = NULL,
+        .files_len = 0,
+        .files_cap = 0,
+        .order = NULL,
+        .progs = NULL,
+        .asts = NULL
+    };
+    LoadState state = {
+        .out = files,
+        .seen = interner_new(),
+        .queue = NULL,
+        .queue_len = 0,
+        .queue_cap = 0,
+        .pending = 0
+    };
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.cond, NULL);
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+    add_file(&state, alloc_strdup(root), path_key(root));
+    // this thread works too
+    pthread_t *pool = alloc_bytes(threads * sizeof(pthread_t));
+    unsigned started = 0;
+    while (started + 1 < threads && pthread_create(pool + started, NULL, worker, &state) == 0) ++started;
+    worker(&state);
+    for (unsigned i = 0; i < started; ++i) pthread_join(pool[i], NULL);
+    alloc_free(pool);
+    pthread_cond_destroy(&state.cond);
+    pthread_mutex_destroy(&state.lock);
+    interner_free(state.seen);
+    alloc_free(state.queue);
+
+    // every file is reachable from root, so the order covers them all
+    files->order = alloc_bytes(files->files_len * sizeof(uint32_t));
+    bool *visited = alloc_zeroed(files->files_len, sizeof(bool));
+    uint32_t order_len = 0;
+    add_order(files, visited, 0, &order_len);
+    alloc_free(visited);
+
+    bool ok = true;
+    files->progs = alloc_bytes(files->files_len * sizeof(Prog));
+    files->asts = alloc_bytes(files->files_len * sizeof(ASTProg));
+    for (uint32_t i = 0; i < files->files_len; ++i) {
+        const BuildFile *file = files->files[files->order[i]];
+        files->progs[i] = file->prog;
+        files->asts[i] = file->ast;
+        fwrite(file->diagnostics, 1, file->diagnostics_len, stderr);
+        ok = ok && file->ok;
+    }
+    return ok;
+}
+
+void free_build_files (BuildFiles files) {
+    for (uint32_t i = 0; i < files.files_len; ++i) {
+        BuildFile *file = files.files[i];
+        free_prog(file->ast);
+        free_tokens(file->tokens);
+        alloc_free(file->text);
+        alloc_free(file->path);
+        alloc_free(file->key);
+        alloc_free(file->includes);
+        alloc_free(file->diagnostics);
+        alloc_free(file);
+    }
+    alloc_free(files.files);
+    alloc_free(files.order);
+    alloc_free(files.progs);
+    alloc_free(files.asts);
+}
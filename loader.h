@@ -0,0 +1,40 @@
+// loads a build file and everything it includes, lexing and parsing them on a thread pool
+// one file per task, each include path is only loaded once
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "prog.h"
+
+typedef struct {
+    char *path; // relative to the working directory, or absolute
+    char *key; // canonical path, for deduplicating
+    char *text; // NULL if it couldn't be read
+    Prog prog;
+    Tokens tokens;
+    ASTProg ast;
+    bool ok; // read, lexed and parsed without errors
+    uint32_t *includes; // file indices, in the order they're included
+    uint32_t includes_len;
+    char *diagnostics; // everything lexing and parsing reported
+    size_t diagnostics_len;
+} BuildFile;
+
+typedef struct {
+    BuildFile **files; // in the order they were found, which changes between runs
+    uint32_t files_len;
+    uint32_t files_cap;
+    // root first then includes depth first, the same every run
+    uint32_t *order;
+    Prog *progs; // in order, for graph_new
+    ASTProg *asts;
+} BuildFiles;
+
+bool load_build_files (const char *, unsigned, BuildFiles *);
+void free_build_files (BuildFiles);
+
+#endif
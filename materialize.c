@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ALLOC_SUBSYSTEM ALLOC_OTHER
+#include "alloc.h"
+#include "materialize.h"
+#include "try.h"
+
+static const char *method_names[MATERIALIZE_METHODS] = { "reflink", "hardlink", "copy_file_range", "copy" };
+
+// a new file at tmp with mode exactly, not masked
+static int create (const char *tmp, mode_t mode) {
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, mode);
+    if (fd >= 0 && fchmod(fd, mode) != 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    return fd;
+}
+
+// only works if both are on a filesystem that shares blocks, like btrfs or xfs
+static bool try_reflink (int src, const char *tmp, mode_t mode) {
+    int dst = create(tmp, mode);
+    TRYBOOL(dst >= 0);
+    bool ok = ioctl(dst, FICLONE, src) == 0;
+    ok = close(dst) == 0 && ok;
+    if (!ok) unlink(tmp);
+    return ok;
+}
+
+// unsupported is set if it failed before copying anything because the kernel can't do it for these files
+static bool copy_range (int src, int dst, size_t len, bool *unsupported) {
+    for (size_t done = 0; done < len;) {
+        ssize_t copied = copy_file_range(src, NULL, dst, NULL, len - done, 0);
+        if (copied <= 0) {
+            *unsupported = done == 0 && copied < 0
+                && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL);
+            return false;
+        }
+        done += copied;
+    }
+    return true;
+}
+
+static bool copy_fds (int src, int dst) {
+    char buf[1 << 16];
+    ssize_t got;
+    while ((got = read(src, buf, sizeof(buf))) > 0) {
+        for (ssize_t done = 0; done < got;) {
+            ssize_t wrote = write(dst, buf + done, got - done);
+            TRYBOOL(wrote > 0);
+            done += wrote;
+        }
+    }
+    return got == 0;
+}
+
+static bool try_copy (int src, const char *tmp, mode_t mode, size_t len, MaterializeMethod *method) {
+    int dst = create(tmp, mode);
+    TRYBOOL(dst >= 0);
+    bool unsupported = false;
+    *method = MATERIALIZE_COPY_RANGE;
+    bool ok = copy_range(src, dst, len, &unsupported);
+    if (!ok && unsupported) {
+        *method = MATERIALIZE_COPY;
+        ok = copy_fds(src, dst);
+    }
+    ok = close(dst) == 0 && ok;
+    if (!ok) unlink(tmp);
+    return ok;
+}
+
+// replaces to with from's contents and mode, counting how in stats
+// it goes through a file next to to and a rename, so to is never seen half written
+// may_link allows a hardlink, which is only safe if nothing ever writes to either file in place,
+// what the action's linkable attribute says
+bool materialize (const char *from, const char *to, bool may_link, MaterializeStats *stats) {
+    int src = open(from, O_RDONLY);
+    TRYBOOL(src >= 0);
+    struct stat st;
+    TRYBOOL_R(fstat(src, &st) == 0, close(src));
+    mode_t mode = st.st_mode & 07777;
+    // linked by an earlier call, renaming tmp onto it would do nothing and leave tmp behind
+    struct stat to_st;
+    if (may_link && stat(to, &to_st) == 0 && to_st.st_dev == st.st_dev && to_st.st_ino == st.st_ino) {
+        close(src);
+        ++stats->files[MATERIALIZE_HARDLINK];
+        stats->bytes[MATERIALIZE_HARDLINK] += st.st_size;
+        return true;
+    }
+
+    char *tmp = alloc_bytes(strlen(to) + sizeof(".bidet-tmp"));
+    sprintf(tmp, "%s.bidet-tmp", to);
+    // left by one that was interrupted
+    unlink(tmp);
+    MaterializeMethod method = MATERIALIZE_REFLINK;
+    bool ok = try_reflink(src, tmp, mode);
+    if (!ok && may_link) {
+        method = MATERIALIZE_HARDLINK;
+        ok = link(from, tmp) == 0;
+    }
+    if (!ok) ok = try_copy(src, tmp, mode, st.st_size, &method);
+    close(src);
+    if (ok && rename(tmp, to) != 0) {
+        unlink(tmp);
+        ok = false;
+    }
+    alloc_free(tmp);
+    TRYBOOL(ok);
+    ++stats->files[method];
+    stats->bytes[method] += st.st_size;
+    return true;
+}
+
+const char *materialize_method_name (MaterializeMethod method) {
+    return method_names[method];
+}
+
+// a line per method that put anything in place
+void materialize_report (const MaterializeStats *stats, FILE *out) {
+    fprintf(out, "%-16s %12s %14s\n", "materialized by", "files", "bytes");
+    for (int i = 0; i < MATERIALIZE_METHODS; ++i) {
+        if (stats->files[i] == 0) continue;
+        fprintf(out, "%-16s %12llu %14llu\n", method_names[i], (unsigned long long) stats->files[i], (unsigned long long) stats->bytes[i]);
+    }
+}
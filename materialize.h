@@ -0,0 +1,31 @@
+// puts a cached output in place, as cheaply as the filesystem allows
+// a reflink shares the blocks until either copy's written, a hardlink shares the file itself,
+// copy_file_range lets the kernel copy without going through userspace, or failing all that a plain copy
+
+#ifndef MATERIALIZE_H
+#define MATERIALIZE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// in the order they're tried
+typedef enum {
+    MATERIALIZE_REFLINK,
+    MATERIALIZE_HARDLINK, // only if the caller says nothing will write to the output in place
+    MATERIALIZE_COPY_RANGE,
+    MATERIALIZE_COPY,
+    MATERIALIZE_METHODS
+} MaterializeMethod;
+
+// how many files and bytes each method put in place, for --stats
+typedef struct {
+    uint64_t files[MATERIALIZE_METHODS];
+    uint64_t bytes[MATERIALIZE_METHODS];
+} MaterializeStats;
+
+bool materialize (const char *, const char *, bool, MaterializeStats *);
+const char *materialize_method_name (MaterializeMethod);
+void materialize_report (const MaterializeStats *, FILE *);
+
+#endif
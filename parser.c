@@ -1,10 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define ALLOC_SUBSYSTEM ALLOC_PARSER
+#include "alloc.h"
 #include "fmt_error.h"
 #include "parser.h"
 #include "try.h"
 
+VEC_DEFINE(ASTCatees, ast_catees, ASTCatee, 1)
+VEC_DEFINE(ASTConcats, ast_concats, ASTConcat, 3)
+VEC_DEFINE(ASTActions, ast_actions, ASTAction, 0)
+VEC_DEFINE(ASTVars, ast_vars, ASTVar, 0)
+VEC_DEFINE(ASTIncludes, ast_includes, ASTInclude, 0)
+
 // lots of these are just token versions of their lexer equivalents
 
 // name is the same as in lexer_test but this prints it for humans
@@ -22,32 +30,59 @@ static char *type_to_string (TokenType type) {
     }
 }
 
+// tokens come from the array, or from lexer if it isn't NULL
 typedef struct {
     Prog prog;
-    LList tokens;
-    LLNode *pos;
+    const Token *tokens;
+    uint32_t tokens_len;
+    uint32_t pos;
+    Lexer *lexer;
+    Token ahead[2]; // lexed but not taken yet
+    uint32_t ahead_len;
+    size_t last_offset; // of the last token taken
 } ParseState;
 
-// reports error at s's offset
-static void expected_err (const ParseState *s, const char *expected) {
-    Token *pos_data = s->pos->data;
-    char *got = s->pos == NULL ? "EOF" : type_to_string(pos_data->type);
-    char *message = malloc(sizeof("expected , got \n") + strlen(expected) + strlen(got));
+// the token n after the next one, NULL past the end
+static const Token *token_at (ParseState *s, uint32_t n) {
+    if (s->lexer == NULL) return s->pos + n < s->tokens_len ? s->tokens + s->pos + n : NULL;
+    while (s->ahead_len <= n && lexer_next(s->lexer, s->ahead + s->ahead_len)) ++s->ahead_len;
+    return n < s->ahead_len ? s->ahead + n : NULL;
+}
+
+// takes the next token, kept is whether the ast took its string's parts
+// streamed tokens aren't kept anywhere, so the parts the ast didn't take are freed here
+static void advance (ParseState *s, bool kept) {
+    const Token *tok = token_at(s, 0);
+    s->last_offset = tok->offset;
+    if (s->lexer == NULL) {
+        ++s->pos;
+        return;
+    }
+    if (!kept) free_token(*tok);
+    s->ahead[0] = s->ahead[1];
+    --s->ahead_len;
+}
+
+// reports error at s's offset, or the last token's at EOF
+static void expected_err (ParseState *s, const char *expected) {
+    const Token *tok = token_at(s, 0);
+    char *got = tok == NULL ? "EOF" : type_to_string(tok->type);
+    char *message = alloc_bytes(sizeof("expected , got \n") + strlen(expected) + strlen(got));
     sprintf(message, "expected %s, got %s\n", expected, got);
-    char *err = fmt_err(s->prog, pos_data->offset, message);
-    fputs(err, stderr);
-    free(err);
+    report_err(s->prog, tok == NULL ? s->last_offset : tok->offset, message);
+    alloc_free(message);
 }
 
 static bool peek (ParseState *s, Token *tok) {
-    TRYBOOL(s->pos != NULL);
-    *tok = *(Token *) s->pos->data;
+    const Token *next_tok = token_at(s, 0);
+    TRYBOOL(next_tok != NULL);
+    *tok = *next_tok;
     return true;
 }
 
 static bool next (ParseState *s, Token *tok) {
     TRYBOOL(peek(s, tok));
-    s->pos = s->pos->next;
+    advance(s, false);
     return true;
 }
 
@@ -56,7 +91,7 @@ static bool take_token (ParseState *s, TokenType type, Token *tok) {
     if (tok->type != type) {
         return false;
     } else {
-        s->pos = s->pos->next;
+        advance(s, false);
         return true;
     }
 }
@@ -68,7 +103,7 @@ static bool take_token_ignore (ParseState *s, TokenType type) {
     if (tok.type != type) {
         return false;
     } else {
-        s->pos = s->pos->next;
+        advance(s, false);
         return true;
     }
 }
@@ -79,70 +114,91 @@ static void synchronize (ParseState *s) {
     while (next(s, &tok) && tok.type != SEMICOLON);
 }
 
+// streamed asts own their strings' parts, others share them with the tokens
+static void free_parts (ASTConcat concat) {
+    VEC_FOREACH(const ASTCatee, catee, concat.catee) {
+        if (catee->type == CATEE_INTERPOL_STRING) interpol_parts_free(catee->data.interpol_string.parts);
+    }
+}
+
+static void free_list_parts (ASTList list) {
+    VEC_FOREACH(const ASTConcat, concat, list.elems) free_parts(*concat);
+}
+
 // parses concatenated strings concatenated with the concatenation operator, + (concatenation operator)
 static bool parse_concat_string (ParseState *s, ASTConcat *concat_str) {
+    concat_str->catee = (ASTCatees) VEC_EMPTY;
     Token first;
-    TRYBOOL(peek(s, &first) && (first.type == IDENT || first.type == STRING));
+    TRYBOOL_R(peek(s, &first) && (first.type == IDENT || first.type == STRING), expected_err(s, "string or identifier"));
 
-    concat_str->catee = list_new();
     Token concat;
     do {
         Token str;
         TRYBOOL_R(peek(s, &str), str.type = -1); // dirty hack
-        list_push(&concat_str->catee, malloc(sizeof(ASTCatee)));
         switch(str.type) {
             case IDENT:
-                *(ASTCatee *) concat_str->catee.last->data = (ASTCatee) {
+                *ast_catees_push(&concat_str->catee) = (ASTCatee) {
                     .type = CATEE_IDENT,
                     .data.ident = str.data.ident
                 };
                 break;
             case STRING:
-                *(ASTCatee *) concat_str->catee.last->data = (ASTCatee) {
+                *ast_catees_push(&concat_str->catee) = (ASTCatee) {
                     .type = CATEE_INTERPOL_STRING,
                     .data.interpol_string = str.data.string 
                 };
                 break;
             default:
-                list_free(concat_str->catee);
+                if (s->lexer != NULL) free_parts(*concat_str);
+                ast_catees_free(concat_str->catee);
+                concat_str->catee = (ASTCatees) VEC_EMPTY;
                 expected_err(s, "string or identifier");
                 return false;
         }
-        s->pos = s->pos->next;
+        advance(s, str.type == STRING);
     } while (take_token(s, CONCAT, &concat));
 
     return true;
 }
 
+// frees the elements and leaves list empty, for failed lists
+static void clear_list (const ParseState *s, ASTList *list) {
+    if (s->lexer != NULL) free_list_parts(*list);
+    free_list(*list);
+    list->elems = (ASTConcats) VEC_EMPTY;
+}
+
 static bool parse_list (ParseState *s, ASTList *list) {
+    list->elems = (ASTConcats) VEC_EMPTY;
     TRYBOOL(take_token_ignore(s, BRACKET_OPEN));
 
     // find elements
     Token next_tok; // either close bracket or first element of list
     TRYBOOL_R(peek(s, &next_tok), expected_err(s, "list element or close bracket"));
 
-    list->elems = list_new();
     if (next_tok.type == BRACKET_CLOSE) { // no length
-        s->pos = s->pos->next;
+        advance(s, false);
         return true;
     }
 
     Token comma;
     do {
-        list_push(&list->elems, malloc(sizeof(ASTConcat)));
-        TRYBOOL_R(parse_concat_string(s, list->elems.last->data),
-            list_free(list->elems),
-            expected_err(s, "list element"));
+        TRYBOOL_R(parse_concat_string(s, ast_concats_push(&list->elems)), clear_list(s, list));
 
         TRYBOOL_R(take_token(s, COMMA, &comma) || take_token(s, BRACKET_CLOSE, &comma),
-            list_free(list->elems),
+            clear_list(s, list),
             expected_err(s, "comma or close bracket"));
     } while (comma.type != BRACKET_CLOSE);
 
     return true;
 }
 
+// action is always left freeable, even when this fails
 static bool parse_action (ParseState *s, ASTAction *action) {
+    action->commands.elems = (ASTConcats) VEC_EMPTY;
+    action->updates.elems = (ASTConcats) VEC_EMPTY;
+    action->depfile.catee = (ASTCatees) VEC_EMPTY;
+    action->linkable = false;
     TRYBOOL(parse_list(s, &action->reqs));
     TRYBOOL_R(take_token_ignore(s, ARROW), expected_err(s, "arrow"));
 
@@ -154,49 +210,182 @@ static bool parse_action (ParseState *s, ASTAction *action) {
     TRYBOOL(take_token_ignore(s, ARROW));
     TRYBOOL(parse_list(s, &action->updates));
 
+    // optional attributes, each at most once, in any order
+    Token attr_tok;
+    while (peek(s, &attr_tok) && attr_tok.type == IDENT) {
+        if (slice_equals_str(attr_tok.data.ident, "depfile") && action->depfile.catee.len == 0) {
+            // the depfile the commands write, e.g. from cc -MD
+            advance(s, false);
+            TRYBOOL(parse_concat_string(s, &action->depfile));
+        } else if (slice_equals_str(attr_tok.data.ident, "linkable") && !action->linkable) {
+            advance(s, false);
+            action->linkable = true;
+        } else {
+            break;
+        }
+    }
+
     TRYBOOL_R(take_token_ignore(s, SEMICOLON), expected_err(s, "semicolon"));
 
     return true;
 }
 
-bool parse (Prog prog, LList tokens, LList *actions) {
-    ParseState state = (ParseState) {
-        .prog = prog,
-        .tokens = tokens,
-        .pos = tokens.head
-    };
+static bool parse_var (ParseState *s, ASTVar *var) {
+    Token name_tok;
+    TRYBOOL(take_token(s, IDENT, &name_tok));
+    var->name = name_tok.data.ident;
+    var->value.catee = (ASTCatees) VEC_EMPTY;
+    TRYBOOL(parse_concat_string(s, &var->value));
+
+    TRYBOOL_R(take_token_ignore(s, SEMICOLON), expected_err(s, "semicolon"));
 
+    return true;
+}
+
+// include is a keyword when a string follows it
+static bool is_include (ParseState *s) {
+    const Token *tok = token_at(s, 0);
+    const Token *after = token_at(s, 1);
+    return tok->type == IDENT && slice_equals_str(tok->data.ident, "include") && after != NULL && after->type == STRING;
+}
+
+// paths can't use variables, files are loaded before anything is expanded
+static bool parse_include (ParseState *s, ASTInclude *include) {
+    Token path_tok;
+    advance(s, false);
+    TRYBOOL(peek(s, &path_tok) && path_tok.type == STRING);
+    InterpolParts parts = path_tok.data.string.parts;
+    const InterpolPart *part = VEC_ITEMS(parts);
+    if (parts.len != 1 || part->type != INTERPOL_STRING) {
+        report_err(s->prog, path_tok.offset, "include path has to be a plain string\n");
+        return false;
+    }
+    include->path = part->data;
+    include->offset = path_tok.offset;
+    advance(s, false);
+
+    TRYBOOL_R(take_token_ignore(s, SEMICOLON), expected_err(s, "semicolon"));
+
+    return true;
+}
+
+// parses every statement, handing the ones that parse to sink
+static bool parse_statements (ParseState *s, ParseSink sink) {
     // we don't want to exit right away after parse_action fails because we'll miss all the other errors
     bool return_res = true;
 
-    *actions = list_new();
-    while (state.pos != NULL) {
-        list_push(actions, malloc(sizeof(ASTAction)));
-        if (!parse_action(&state, actions->last->data)) {
+    Token first;
+    while (peek(s, &first)) {
+        bool res;
+        // actions start with their reqs list, variables with their name
+        if (is_include(s)) {
+            ASTInclude include;
+            res = parse_include(s, &include);
+            if (res) sink.include(sink.ctx, include);
+        } else if (first.type == IDENT) {
+            ASTVar var;
+            res = parse_var(s, &var);
+            if (res) {
+                sink.var(sink.ctx, var);
+            } else if (s->lexer != NULL) {
+                free_streamed_var(var);
+            } else {
+                free_var(var);
+            }
+        } else {
+            ASTAction action;
+            res = parse_action(s, &action);
+            if (res) {
+                sink.action(sink.ctx, action);
+            } else if (s->lexer != NULL) {
+                free_streamed_action(action);
+            } else {
+                free_action(action);
+            }
+        }
+        if (!res) {
             return_res = false;
-            synchronize(&state);
+            synchronize(s);
         }
     }
 
     return return_res;
 }
 
+static void push_action (void *ctx, ASTAction action) {
+    *ast_actions_push(&((ASTProg *) ctx)->actions) = action;
+}
+
+static void push_var (void *ctx, ASTVar var) {
+    *ast_vars_push(&((ASTProg *) ctx)->vars) = var;
+}
+
+static void push_include (void *ctx, ASTInclude include) {
+    *ast_includes_push(&((ASTProg *) ctx)->includes) = include;
+}
+
+// only statements that parse are kept, so the ast can always be freed
+bool parse (Prog prog, Tokens tokens, ASTProg *ast) {
+    ParseState state = (ParseState) {
+        .prog = prog,
+        .tokens = VEC_ITEMS(tokens),
+        .tokens_len = tokens.len,
+        .pos = 0,
+        .lexer = NULL
+    };
+    *ast = (ASTProg) { .actions = VEC_EMPTY, .vars = VEC_EMPTY, .includes = VEC_EMPTY };
+    return parse_statements(&state, (ParseSink) { push_action, push_var, push_include, ast });
+}
+
+// lexes and parses a token at a time, each statement goes to sink as soon as it's parsed
+// nothing keeps the tokens, so the statements own their strings' parts, see free_streamed_action
+bool parse_stream (Prog prog, ParseSink sink) {
+    Lexer lexer = lexer_new(prog);
+    ParseState state = (ParseState) {
+        .prog = prog,
+        .lexer = &lexer,
+        .ahead_len = 0,
+        .last_offset = 0
+    };
+    bool ok = parse_statements(&state, sink);
+    return !lexer.failed && ok;
+}
+
 // doesn't free some lexer stuff copied from tokens
 // free_tokens does that
-void free_actions (LList actions) {
-    FOREACH(ASTAction, action, actions) {
-        FOREACH(ASTConcat, rconcat, action.reqs.elems) {
-            list_free(rconcat.catee);
-        }
-        list_free(action.reqs.elems);
-        FOREACH(ASTConcat, cconcat, action.commands.elems) {
-            list_free(cconcat.catee);
-        }
-        list_free(action.commands.elems);
-        FOREACH(ASTConcat, uconcat, action.updates.elems) {
-            list_free(uconcat.catee);
-        }
-        list_free(action.updates.elems);
-    }
-    list_free(actions);
+void free_list (ASTList list) {
+    VEC_FOREACH(const ASTConcat, concat, list.elems) ast_catees_free(concat->catee);
+    ast_concats_free(list.elems);
+}
+
+void free_action (ASTAction action) {
+    free_list(action.reqs);
+    free_list(action.commands);
+    free_list(action.updates);
+    ast_catees_free(action.depfile.catee);
+}
+
+void free_var (ASTVar var) {
+    ast_catees_free(var.value.catee);
+}
+
+void free_prog (ASTProg ast) {
+    VEC_FOREACH(const ASTAction, action, ast.actions) free_action(*action);
+    ast_actions_free(ast.actions);
+    VEC_FOREACH(const ASTVar, var, ast.vars) free_var(*var);
+    ast_vars_free(ast.vars);
+    ast_includes_free(ast.includes);
+}
+
+void free_streamed_action (ASTAction action) {
+    free_list_parts(action.reqs);
+    free_list_parts(action.commands);
+    free_list_parts(action.updates);
+    free_parts(action.depfile);
+    free_action(action);
+}
+
+void free_streamed_var (ASTVar var) {
+    free_parts(var.value);
+    free_var(var);
 }
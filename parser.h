@@ -1,5 +1,24 @@
+#ifndef PARSER_H
+#define PARSER_H
+
 #include "ast.h"
 #include "prog.h"
 
-bool parse (Prog, LList, LList *);
-void free_actions (LList);
+// where parse_stream sends statements, they're the callbacks' to free
+typedef struct {
+    void (*action) (void *, ASTAction);
+    void (*var) (void *, ASTVar);
+    void (*include) (void *, ASTInclude);
+    void *ctx;
+} ParseSink;
+
+bool parse (Prog, Tokens, ASTProg *);
+bool parse_stream (Prog, ParseSink);
+void free_list (ASTList);
+void free_action (ASTAction);
+void free_var (ASTVar);
+void free_streamed_action (ASTAction);
+void free_streamed_var (ASTVar);
+void free_prog (ASTProg);
+
+#endif
@@ -1,10 +1,17 @@
 #ifndef PROG_H
 #define PROG_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 // program info
 typedef struct {
     const char *filename;
     const char *text;
+    FILE *errors; // where diagnostics go, stderr if NULL
+    // called with the offset into text instead of writing to errors when set, for editors
+    void (*report) (void *, size_t, const char *);
+    void *report_ctx;
 } Prog;
 
 #endif
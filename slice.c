@@ -1,17 +1,20 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#define ALLOC_SUBSYSTEM ALLOC_STRINGS
+#include "alloc.h"
 #include "slice.h"
 
 char *slice_to_str (StringSlice slice) {
-    char *str = malloc(slice.length + 1);
+    char *str = alloc_bytes(slice.length + 1);
     strncpy(str, slice.back + slice.start, slice.length);
     str[slice.length] = '\0';
     return str;
 }
 
 StringSlice str_to_slice (const char *str, size_t start, size_t length) {
-    assert(strlen(str) - start >= length);
+    // only looks at the slice, strlen here made lexing quadratic
+    assert(memchr(str + start, '\0', length) == NULL);
     return (StringSlice) {
         .start = start,
         .length = length,
@@ -26,3 +29,7 @@ StringSlice str_to_slice_raw (const char *str) {
         .back = str
     };
 }
+
+bool slice_equals_str (StringSlice slice, const char *str) {
+    return strlen(str) == slice.length && strncmp(slice.back + slice.start, str, slice.length) == 0;
+}
@@ -1,3 +1,7 @@
+#ifndef SLICE_H
+#define SLICE_H
+
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef struct {
@@ -9,3 +13,6 @@ typedef struct {
 char *slice_to_str (StringSlice);
 StringSlice str_to_slice (const char *, size_t, size_t);
 StringSlice str_to_slice_raw (const char *);
+bool slice_equals_str (StringSlice, const char *);
+
+#endif
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../alloc.h"
+#include "greatest/greatest.h"
+
+// other suites can allocate through the same subsystems in tracking builds, so these look at differences
+
+TEST stats_test (void) {
+    AllocStats before = alloc_stats(ALLOC_EDITOR);
+    char *a = alloc_tracked(ALLOC_EDITOR, 100);
+    char *b = alloc_tracked_zeroed(ALLOC_EDITOR, 10, 5);
+    ASSERT(a != NULL && b != NULL);
+    ASSERT_EQm("alloc_tracked_zeroed should zero", 0, b[49]);
+    AllocStats after = alloc_stats(ALLOC_EDITOR);
+    ASSERT_EQ(before.count + 2, after.count);
+    ASSERT_EQ(before.bytes + 150, after.bytes);
+    ASSERT_EQ(before.live + 150, after.live);
+    ASSERTm("peak should cover what's live", after.peak >= after.live);
+
+    alloc_tracked_free(a);
+    after = alloc_stats(ALLOC_EDITOR);
+    ASSERT_EQm("freeing should only take from live", before.count + 2, after.count);
+    ASSERT_EQ(before.live + 50, after.live);
+    alloc_tracked_free(b);
+    ASSERT_EQ(before.live, alloc_stats(ALLOC_EDITOR).live);
+    PASS();
+}
+
+TEST resize_test (void) {
+    AllocStats before_list = alloc_stats(ALLOC_LIST);
+    AllocStats before_graph = alloc_stats(ALLOC_GRAPH);
+    char *ptr = alloc_tracked(ALLOC_LIST, 8);
+    strcpy(ptr, "resized");
+    ptr = alloc_tracked_resize(ALLOC_GRAPH, ptr, 4096);
+    ASSERT_STR_EQm("resizing should keep the contents", "resized", ptr);
+    ASSERT_EQm("a resized block should leave its old subsystem", before_list.live, alloc_stats(ALLOC_LIST).live);
+    ASSERT_EQm("and count in the new one", before_graph.live + 4096, alloc_stats(ALLOC_GRAPH).live);
+    alloc_tracked_free(ptr);
+    ASSERT_EQ(before_graph.live, alloc_stats(ALLOC_GRAPH).live);
+
+    char *dup = alloc_tracked_strndup(ALLOC_LIST, "abcdef", 3);
+    ASSERT_STR_EQ("abc", dup);
+    ASSERT_EQ(before_list.live + 4, alloc_stats(ALLOC_LIST).live);
+    alloc_tracked_free(dup);
+    PASS();
+}
+
+TEST untracked_test (void) {
+    AllocStats before = alloc_stats(ALLOC_OTHER);
+    // what libc allocated can still be freed here
+    alloc_tracked_free(malloc(16));
+    alloc_tracked_free(NULL);
+    ASSERT_EQ(before.live, alloc_stats(ALLOC_OTHER).live);
+
+    // lots at once, so the table grows
+    void *ptrs[5000];
+    for (size_t i = 0; i < 5000; ++i) ptrs[i] = alloc_tracked(ALLOC_OTHER, 1);
+    ASSERT_EQ(before.live + 5000, alloc_stats(ALLOC_OTHER).live);
+    for (size_t i = 0; i < 5000; ++i) alloc_tracked_free(ptrs[i]);
+    ASSERT_EQ(before.live, alloc_stats(ALLOC_OTHER).live);
+    PASS();
+}
+
+GREATEST_SUITE(alloc_suite) {
+    RUN_TEST(stats_test);
+    RUN_TEST(resize_test);
+    RUN_TEST(untracked_test);
+}
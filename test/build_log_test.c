@@ -0,0 +1,301 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../build_log.h"
+#include "greatest/greatest.h"
+
+static bool record (BuildLog *log, const char *name, int64_t start, const char *output, int64_t mtime) {
+    BuildLogOutput out = { .mtime = mtime };
+    BuildLogEntry entry = {
+        .exit_status = 0,
+        .start = start,
+        .end = start + 5,
+        .command_hash = 42,
+        .outputs_len = 1,
+        .outputs = &out
+    };
+    return build_log_name(log, name, &entry.name)
+        && build_log_name(log, output, &out.path)
+        && build_log_record(log, entry);
+}
+
+static bool find (const BuildLog *log, const char *name, BuildLogEntry *entry) {
+    uint32_t id;
+    return build_log_lookup(log, name, &id) && build_log_find(log, id, entry);
+}
+
+TEST reload_test (void) {
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+
+    BuildLog log;
+    ASSERTm("build_log_open should make a new log", build_log_open(path, &log));
+    ASSERTm("build_log_record should record entries", record(&log, "lexer.o", 100, "build/lexer.o", 7));
+    ASSERTm("build_log_record should record entries", record(&log, "parser.o", 200, "build/parser.o", 8));
+    ASSERTm("build_log_record should record entries", record(&log, "lexer.o", 300, "build/lexer.o", 9));
+
+    BuildLogEntry entry;
+    ASSERTm("build_log_find should find recorded entries", find(&log, "lexer.o", &entry));
+    ASSERT_EQm("build_log_find should give the newest entry", 300, entry.start);
+    build_log_close(log);
+
+    ASSERTm("build_log_open should load the log", build_log_open(path, &log));
+    ASSERT_EQm("every entry should load", 3, log.appended);
+    ASSERTm("build_log_find should find loaded entries", find(&log, "lexer.o", &entry));
+    ASSERT_EQm("loaded entry should be the newest", 300, entry.start);
+    ASSERT_EQm("loaded end should match", 305, entry.end);
+    ASSERT_EQm("loaded command hash should match", 42, entry.command_hash);
+    ASSERT_EQm("loaded outputs should match", 1, entry.outputs_len);
+    ASSERT_EQm("loaded output mtime should match", 9, entry.outputs[0].mtime);
+    ASSERTm("loaded output path should match", slice_equals_str(build_log_get_name(&log, entry.outputs[0].path), "build/lexer.o"));
+    ASSERT_FALSEm("build_log_find shouldn't find unlogged actions", find(&log, "tests.o", &entry));
+    build_log_close(log);
+
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST torn_write_test (void) {
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+
+    BuildLog log;
+    ASSERT(build_log_open(path, &log));
+    ASSERT(record(&log, "lexer.o", 100, "build/lexer.o", 7));
+    build_log_close(log);
+
+    // half a record, like a crash mid write would leave
+    FILE *file = fopen(path, "ab");
+    fwrite("\x30\x00\x00\x80\x01\x00\x00\x00\x05", 1, 9, file);
+    fclose(file);
+
+    ASSERTm("build_log_open should load up to the torn record", build_log_open(path, &log));
+    BuildLogEntry entry;
+    ASSERTm("entries before the torn record should survive", find(&log, "lexer.o", &entry));
+    ASSERTm("recording after a torn record should work", record(&log, "lexer.o", 200, "build/lexer.o", 8));
+    build_log_close(log);
+
+    ASSERT(build_log_open(path, &log));
+    ASSERTm("entries after the cut should load", find(&log, "lexer.o", &entry) && entry.start == 200);
+    build_log_close(log);
+
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST compact_test (void) {
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+
+    BuildLog log;
+    ASSERT(build_log_open(path, &log));
+    for (int i = 0; i < 100; ++i) {
+        ASSERT(record(&log, "lexer.o", i, "build/lexer.o", i));
+    }
+    ASSERT(record(&log, "parser.o", 1000, "build/parser.o", 1000));
+
+    ASSERTm("build_log_compact should succeed", build_log_compact(&log));
+    ASSERT_EQm("compaction should leave nothing appended", 0, log.appended);
+    ASSERT_EQm("compaction should put every name in the table", 4, log.table_names_len);
+    BuildLogEntry entry;
+    ASSERTm("compaction should keep the newest entry", find(&log, "lexer.o", &entry) && entry.start == 99);
+    ASSERTm("compaction should keep outputs", slice_equals_str(build_log_get_name(&log, entry.outputs[0].path), "build/lexer.o"));
+
+    // appending on top of a table
+    ASSERT(record(&log, "lexer.o", 2000, "build/lexer.o", 2000));
+    ASSERT(record(&log, "tests.o", 3000, "build/tests.o", 3000));
+    build_log_close(log);
+
+    ASSERT(build_log_open(path, &log));
+    ASSERTm("appended entries should override the table", find(&log, "lexer.o", &entry) && entry.start == 2000);
+    ASSERTm("table entries should still load", find(&log, "parser.o", &entry) && entry.start == 1000);
+    ASSERTm("appended names should load", find(&log, "tests.o", &entry) && entry.start == 3000);
+    ASSERT_EQm("live should count every action", 3, log.live);
+    build_log_close(log);
+
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST failed_write_test (void) {
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+
+    BuildLog log;
+    ASSERT(build_log_open(path, &log));
+    ASSERT(record(&log, "lexer.o", 100, "build/lexer.o", 7));
+
+    // a stream that can't be written to, like a full disk
+    fclose(log.file);
+    log.file = fopen(path, "rb");
+    ASSERT_FALSEm("build_log_record should fail when it can't write", record(&log, "parser.o", 200, "build/parser.o", 8));
+    ASSERT_EQm("names that weren't written shouldn't get ids", 2, log.names_len);
+    fclose(log.file);
+    log.file = fopen(path, "ab");
+    ASSERT(record(&log, "parser.o", 200, "build/parser.o", 8));
+    build_log_close(log);
+
+    ASSERT(build_log_open(path, &log));
+    BuildLogEntry entry;
+    ASSERT(find(&log, "parser.o", &entry));
+    ASSERT_EQ(200, entry.start);
+    ASSERTm("ids on disk should match after a failed write",
+        slice_equals_str(build_log_get_name(&log, entry.outputs[0].path), "build/parser.o"));
+    ASSERT(find(&log, "lexer.o", &entry));
+    ASSERT(slice_equals_str(build_log_get_name(&log, entry.outputs[0].path), "build/lexer.o"));
+    build_log_close(log);
+
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST cutoff_test (void) {
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+    BuildLog log;
+    ASSERT(build_log_open(path, &log));
+    uint32_t gen;
+    uint32_t header;
+    ASSERT(build_log_name(&log, "gen", &gen) && build_log_name(&log, "gen.h", &header));
+    HashContent contents = hash_content("#define X 1", 11);
+    HashContent edited = hash_content("#define X 2", 11);
+    ASSERTm("outputs of actions that never ran should count as changed", build_log_output_changed(&log, gen, header, contents));
+
+    BuildLogOutput out = { .path = header, .mtime = 1, .hash = contents };
+    ASSERT(build_log_record(&log, (BuildLogEntry) { .name = gen, .outputs_len = 1, .outputs = &out }));
+    ASSERT(build_log_compact(&log));
+    build_log_close(log);
+
+    ASSERT(build_log_open(path, &log));
+    ASSERT(build_log_lookup(&log, "gen", &gen) && build_log_lookup(&log, "gen.h", &header));
+    ASSERT_FALSEm("the same contents should be unchanged", build_log_output_changed(&log, gen, header, contents));
+    ASSERTm("other contents should be changed", build_log_output_changed(&log, gen, header, edited));
+    build_log_close(log);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+static bool record_usage (BuildLog *log, const char *name, int64_t duration, int64_t max_rss_kb) {
+    BuildLogEntry entry = { .start = 0, .end = duration, .usage = { .max_rss_kb = max_rss_kb } };
+    return build_log_name(log, name, &entry.name) && build_log_record(log, entry);
+}
+
+TEST usage_test (void) {
+    struct rusage rusage = { .ru_utime = { 1, 500 }, .ru_maxrss = 2048, .ru_oublock = 8 };
+    BuildLogUsage usage = build_log_usage(&rusage);
+    ASSERT_EQm("user time should be in ns", 1000500000, usage.user_ns);
+    ASSERT_EQ(2048, usage.max_rss_kb);
+    ASSERT_EQ(8, usage.out_blocks);
+
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+    BuildLog log;
+    ASSERT(build_log_open(path, &log));
+    ASSERT(record_usage(&log, "lexer.o", 800, 100));
+    ASSERT(record_usage(&log, "lexer.o", 1600, 100));
+    ASSERT(record_usage(&log, "parser.o", 1500, 900));
+    ASSERT(build_log_compact(&log));
+    ASSERT(record_usage(&log, "parser.o", 1400, 100));
+    build_log_close(log);
+
+    ASSERT(build_log_open(path, &log));
+    BuildLogEntry entry;
+    ASSERT(find(&log, "lexer.o", &entry));
+    ASSERT_EQm("runs should count every recording", 2, entry.runs);
+    ASSERT_EQm("the newest run should come first", 1600, entry.recent[0][BUILD_LOG_BY_DURATION]);
+    ASSERT_EQm("the average should be over the kept runs", 1200, build_log_recent_average(entry, BUILD_LOG_BY_DURATION, BUILD_LOG_RECENT_RUNS));
+    ASSERT_EQm("the average should be over the runs asked for", 1600, build_log_recent_average(entry, BUILD_LOG_BY_DURATION, 1));
+    ASSERT(find(&log, "parser.o", &entry));
+    ASSERT_EQm("runs should survive compaction", 2, entry.runs);
+    ASSERT_EQ(100, entry.usage.max_rss_kb);
+    ASSERT_EQ(500, build_log_recent_average(entry, BUILD_LOG_BY_MAX_RSS, BUILD_LOG_RECENT_RUNS));
+
+    char *report;
+    size_t len;
+    FILE *out = open_memstream(&report, &len);
+    build_log_report(&log, BUILD_LOG_BY_DURATION, BUILD_LOG_RECENT_RUNS, 1, out);
+    fclose(out);
+    ASSERTm("the slowest action on average should be reported", strstr(report, "parser.o") != NULL);
+    ASSERT_FALSEm("only n actions should be", strstr(report, "lexer.o") != NULL);
+    ASSERTm("the newest run's change from the average should be reported", strstr(report, "-3%") != NULL);
+    free(report);
+
+    out = open_memstream(&report, &len);
+    build_log_report(&log, BUILD_LOG_BY_DURATION, 1, 1, out);
+    fclose(out);
+    ASSERTm("averaging over fewer runs should rank by those", strstr(report, "lexer.o") != NULL);
+    ASSERT_FALSE(strstr(report, "parser.o") != NULL);
+    free(report);
+
+    out = open_memstream(&report, &len);
+    build_log_report(&log, BUILD_LOG_BY_DURATION, 1000, 1, out);
+    fclose(out);
+    ASSERTm("runs should be clamped to the kept window", strstr(report, "parser.o") != NULL);
+    free(report);
+    build_log_close(log);
+
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST recent_test (void) {
+    char dir[] = "/tmp/bidet_build_logXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/log", dir);
+    BuildLog log;
+    ASSERT(build_log_open(path, &log));
+    ASSERT(record_usage(&log, "gen", 100000, 0));
+    for (int i = 0; i < BUILD_LOG_RECENT_RUNS - 2; ++i) ASSERT(record_usage(&log, "gen", 100, 0));
+    long before = ftell(log.file);
+    ASSERT(record_usage(&log, "gen", 100, 0));
+    ASSERTm("a run should append only its own values, not the window",
+        (size_t) (ftell(log.file) - before) < sizeof(((BuildLogEntry *) NULL)->recent));
+    BuildLogEntry entry;
+    ASSERT(find(&log, "gen", &entry));
+    ASSERT_EQm("an outlier should count while it's kept", (100000 + 100 * (BUILD_LOG_RECENT_RUNS - 1)) / BUILD_LOG_RECENT_RUNS,
+        build_log_recent_average(entry, BUILD_LOG_BY_DURATION, BUILD_LOG_RECENT_RUNS));
+    ASSERT(build_log_compact(&log));
+    ASSERT(record_usage(&log, "gen", 100, 0));
+    build_log_close(log);
+
+    ASSERT(build_log_open(path, &log));
+    ASSERT(find(&log, "gen", &entry));
+    ASSERT_EQ(BUILD_LOG_RECENT_RUNS + 1, entry.runs);
+    ASSERT_EQm("an outlier should drop out once it's older than the kept runs", 100, build_log_recent_average(entry, BUILD_LOG_BY_DURATION, BUILD_LOG_RECENT_RUNS));
+    build_log_close(log);
+
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+GREATEST_SUITE(build_log_suite) {
+    RUN_TEST(reload_test);
+    RUN_TEST(torn_write_test);
+    RUN_TEST(compact_test);
+    RUN_TEST(failed_write_test);
+    RUN_TEST(cutoff_test);
+    RUN_TEST(usage_test);
+    RUN_TEST(recent_test);
+}
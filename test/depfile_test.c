@@ -0,0 +1,51 @@
+#include "../depfile.h"
+#include "greatest/greatest.h"
+
+static bool deps_equal (LList deps, const char **expected, size_t expected_len) {
+    if (list_len(deps) != expected_len) return false;
+    LLNode *node = deps.head;
+    for (size_t i = 0; i < expected_len; ++i, node = node->next) {
+        if (strcmp(node->data, expected[i]) != 0) return false;
+    }
+    return true;
+}
+
+TEST gcc_test (void) {
+    // cc -MD -MP output
+    Prog prog = (Prog) {
+        .filename = "lexer.d",
+        .text = "build/lexer.o: lexer.c fmt_error.h prog.h \\\n lexer.h list.h\n\nfmt_error.h:\nprog.h:\n"
+    };
+    LList deps;
+    ASSERTm("parse_depfile should succeed on gcc output", parse_depfile(prog, &deps));
+    const char *expected[5] = { "lexer.c", "fmt_error.h", "prog.h", "lexer.h", "list.h" };
+    ASSERTm("parse_depfile should find every prerequisite", deps_equal(deps, expected, 5));
+    list_free(deps);
+    PASS();
+}
+
+TEST escape_test (void) {
+    Prog prog = (Prog) {
+        .filename = "weird.d",
+        .text = "out\\ put.o : has\\ space.h price$$.h \\#hash.h c:\\dir\\x.h\r\n"
+    };
+    LList deps;
+    ASSERTm("parse_depfile should succeed on escapes", parse_depfile(prog, &deps));
+    const char *expected[4] = { "has space.h", "price$.h", "#hash.h", "c:\\dir\\x.h" };
+    ASSERTm("parse_depfile should unescape paths", deps_equal(deps, expected, 4));
+    list_free(deps);
+    PASS();
+}
+
+TEST no_colon_test (void) {
+    Prog prog = (Prog) { .filename = "bad.d", .text = "lexer.o lexer.c\n" };
+    LList deps;
+    ASSERT_FALSEm("parse_depfile should fail without a colon", parse_depfile(prog, &deps));
+    PASS();
+}
+
+GREATEST_SUITE(depfile_suite) {
+    RUN_TEST(gcc_test);
+    RUN_TEST(escape_test);
+    RUN_TEST(no_colon_test);
+}
@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <unistd.h>
+#include "../deps_log.h"
+#include "greatest/greatest.h"
+
+static LList make_deps (const char **paths, size_t len) {
+    LList deps = list_new();
+    for (size_t i = 0; i < len; ++i) {
+        char *path = malloc(strlen(paths[i]) + 1);
+        strcpy(path, paths[i]);
+        list_push(&deps, path);
+    }
+    return deps;
+}
+
+static bool entry_equal (const DepsLog *log, const DepsEntry *entry, const char **paths, size_t len) {
+    if (entry == NULL || entry->count != len) return false;
+    for (size_t i = 0; i < len; ++i) {
+        if (!slice_equals_str(interner_get(&log->paths, entry->ids[i]), paths[i])) return false;
+    }
+    return true;
+}
+
+TEST reload_test (void) {
+    char dir[] = "/tmp/bidet_depsXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/deps", dir);
+
+    DepsLog log;
+    ASSERTm("deps_log_open should make a new log", deps_log_open(path, &log));
+    const char *lexer_paths[3] = { "lexer.c", "lexer.h", "prog.h" };
+    const char *parser_paths[3] = { "parser.c", "ast.h", "prog.h" };
+    LList lexer_deps = make_deps(lexer_paths, 3);
+    LList parser_deps = make_deps(parser_paths, 3);
+    ASSERTm("deps_log_record should record deps", deps_log_record(&log, "lexer.o", 10, lexer_deps));
+    ASSERTm("deps_log_record should record deps", deps_log_record(&log, "parser.o", 20, parser_deps));
+    ASSERTm("deps_log_get should give recorded deps", entry_equal(&log, deps_log_get(&log, "lexer.o"), lexer_paths, 3));
+    ASSERT_EQm("shared paths should be interned once", 7, log.paths.len);
+    deps_log_close(log);
+
+    ASSERTm("deps_log_open should load the log", deps_log_open(path, &log));
+    const DepsEntry *entry = deps_log_get(&log, "parser.o");
+    ASSERTm("loaded deps should match recorded deps", entry_equal(&log, entry, parser_paths, 3));
+    ASSERT_EQm("loaded mtime should match recorded mtime", 20, entry->mtime);
+    ASSERT_FALSEm("loaded deps should point into the mapping", entry->owned);
+    ASSERT_EQm("deps_log_get shouldn't find unrecorded outputs", NULL, deps_log_get(&log, "tests.o"));
+    deps_log_close(log);
+
+    list_free(lexer_deps);
+    list_free(parser_deps);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST torn_write_test (void) {
+    char dir[] = "/tmp/bidet_depsXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/deps", dir);
+
+    DepsLog log;
+    ASSERT(deps_log_open(path, &log));
+    const char *paths[1] = { "lexer.c" };
+    LList deps = make_deps(paths, 1);
+    ASSERT(deps_log_record(&log, "lexer.o", 10, deps));
+    deps_log_close(log);
+
+    // half a record, like a crash mid write would leave
+    FILE *file = fopen(path, "ab");
+    fwrite("\x10\x00", 1, 2, file);
+    fclose(file);
+
+    ASSERTm("deps_log_open should load up to the torn record", deps_log_open(path, &log));
+    ASSERTm("deps before the torn record should survive", entry_equal(&log, deps_log_get(&log, "lexer.o"), paths, 1));
+    ASSERTm("recording after a torn record should work", deps_log_record(&log, "lexer.o", 11, deps));
+    deps_log_close(log);
+
+    ASSERT(deps_log_open(path, &log));
+    ASSERT_EQm("records after the cut should load", 11, deps_log_get(&log, "lexer.o")->mtime);
+    deps_log_close(log);
+
+    list_free(deps);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST compact_test (void) {
+    char dir[] = "/tmp/bidet_depsXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/deps", dir);
+
+    DepsLog log;
+    ASSERT(deps_log_open(path, &log));
+    const char *old_paths[1] = { "old.h" };
+    const char *new_paths[2] = { "lexer.c", "new.h" };
+    LList old_deps = make_deps(old_paths, 1);
+    LList new_deps = make_deps(new_paths, 2);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT(deps_log_record(&log, "lexer.o", i, old_deps));
+    }
+    ASSERT(deps_log_record(&log, "lexer.o", 100, new_deps));
+    ASSERT_EQm("every change should be a record", 101, log.records);
+
+    ASSERTm("deps_log_compact should succeed", deps_log_compact(&log));
+    ASSERT_EQm("compaction should leave one record per output", 1, log.records);
+    ASSERT_EQm("compaction should drop unused paths", 3, log.paths.len);
+    ASSERTm("compaction should keep the latest deps", entry_equal(&log, deps_log_get(&log, "lexer.o"), new_paths, 2));
+    deps_log_close(log);
+
+    list_free(old_deps);
+    list_free(new_deps);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST failed_write_test (void) {
+    char dir[] = "/tmp/bidet_depsXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/deps", dir);
+
+    DepsLog log;
+    ASSERT(deps_log_open(path, &log));
+    const char *lexer_paths[1] = { "lexer.c" };
+    const char *parser_paths[1] = { "parser.c" };
+    LList lexer_deps = make_deps(lexer_paths, 1);
+    LList parser_deps = make_deps(parser_paths, 1);
+    ASSERT(deps_log_record(&log, "lexer.o", 10, lexer_deps));
+
+    // a stream that can't be written to, like a full disk
+    fclose(log.file);
+    log.file = fopen(path, "rb");
+    ASSERT_FALSEm("deps_log_record should fail when it can't write", deps_log_record(&log, "parser.o", 20, parser_deps));
+    ASSERT_EQm("paths that weren't written shouldn't get ids", 2, log.paths.len);
+    fclose(log.file);
+    log.file = fopen(path, "ab");
+    ASSERT(deps_log_record(&log, "parser.o", 20, parser_deps));
+    deps_log_close(log);
+
+    ASSERT(deps_log_open(path, &log));
+    ASSERTm("ids on disk should match after a failed write", entry_equal(&log, deps_log_get(&log, "parser.o"), parser_paths, 1));
+    deps_log_close(log);
+
+    list_free(lexer_deps);
+    list_free(parser_deps);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+GREATEST_SUITE(deps_log_suite) {
+    RUN_TEST(reload_test);
+    RUN_TEST(torn_write_test);
+    RUN_TEST(compact_test);
+    RUN_TEST(failed_write_test);
+}
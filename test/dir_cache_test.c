@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../dir_cache.h"
+#include "greatest/greatest.h"
+
+static void touch (const char *dir, const char *name) {
+    char path[256];
+    sprintf(path, "%s/%s", dir, name);
+    fclose(fopen(path, "w"));
+}
+
+static void remove_in (const char *dir, const char *name) {
+    char path[256];
+    sprintf(path, "%s/%s", dir, name);
+    remove(path);
+}
+
+// the nth match without the temporary directory in front
+static const char *match_name (LList matches, size_t n, const char *dir) {
+    LLNode *node = matches.head;
+    for (size_t i = 0; i < n && node != NULL; ++i) node = node->next;
+    return node == NULL ? "" : (const char *) node->data + strlen(dir) + 1;
+}
+
+TEST glob_test (void) {
+    char dir[] = "/tmp/bidet_globXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char sub[64];
+    sprintf(sub, "%s/sub", dir);
+    ASSERT(mkdir(sub, 0755) == 0);
+    touch(dir, "parser.c");
+    touch(dir, "lexer.c");
+    touch(dir, "lexer.h");
+    touch(dir, ".hidden.c");
+    touch(sub, "sub.c");
+
+    DirCache cache = dir_cache_new();
+    char pattern[64];
+    LList matches = list_new();
+    sprintf(pattern, "%s/*.c", dir);
+    ASSERTm("dir_cache_glob should match", dir_cache_glob(&cache, pattern, &matches));
+    ASSERT_EQm("* shouldn't match hidden files or other extensions", 2, list_len(matches));
+    ASSERT_STR_EQm("matches should be sorted", "lexer.c", match_name(matches, 0, dir));
+    ASSERT_STR_EQm("matches should be sorted", "parser.c", match_name(matches, 1, dir));
+    list_free(matches);
+
+    matches = list_new();
+    sprintf(pattern, "%s/*/s?b.[ch]", dir);
+    ASSERTm("dir_cache_glob should match in subdirectories", dir_cache_glob(&cache, pattern, &matches));
+    ASSERT_EQ(1, list_len(matches));
+    ASSERT_STR_EQ("sub/sub.c", match_name(matches, 0, dir));
+    list_free(matches);
+
+    matches = list_new();
+    sprintf(pattern, "%s/*.o", dir);
+    ASSERT_FALSEm("dir_cache_glob should fail without matches", dir_cache_glob(&cache, pattern, &matches));
+    list_free(matches);
+    ASSERT_EQm("each directory should only be read once", 2, cache.read);
+    dir_cache_free(cache);
+
+    remove_in(sub, "sub.c");
+    remove_in(dir, "parser.c");
+    remove_in(dir, "lexer.c");
+    remove_in(dir, "lexer.h");
+    remove_in(dir, ".hidden.c");
+    remove(sub);
+    remove(dir);
+
+    PASS();
+}
+
+TEST persist_test (void) {
+    char dir[] = "/tmp/bidet_globXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    touch(dir, "a.c");
+    // not in dir, saving it there would change dir's mtime
+    char cache_dir[] = "/tmp/bidet_dir_cacheXXXXXX";
+    ASSERT(mkdtemp(cache_dir) != NULL);
+    char cache_path[64];
+    sprintf(cache_path, "%s/dirs", cache_dir);
+    char pattern[64];
+    sprintf(pattern, "%s/*.c", dir);
+
+    DirCache cache = dir_cache_new();
+    ASSERTm("dir_cache_load should allow missing caches", dir_cache_load(&cache, cache_path));
+    LList matches = list_new();
+    dir_cache_glob(&cache, pattern, &matches);
+    list_free(matches);
+    ASSERTm("dir_cache_save should save", dir_cache_save(&cache, cache_path));
+    dir_cache_free(cache);
+
+    cache = dir_cache_new();
+    ASSERTm("dir_cache_load should load", dir_cache_load(&cache, cache_path));
+    matches = list_new();
+    ASSERT(dir_cache_glob(&cache, pattern, &matches));
+    ASSERT_EQm("unchanged directories shouldn't be read", 0, cache.read);
+    ASSERT_STR_EQm("saved listings should match", "a.c", match_name(matches, 0, dir));
+    list_free(matches);
+    dir_cache_free(cache);
+
+    // the mtime could land in the same tick otherwise
+    touch(dir, "b.c");
+    struct timespec times[2] = { { .tv_sec = 1, .tv_nsec = 0 }, { .tv_sec = 1, .tv_nsec = 0 } };
+    ASSERT(utimensat(AT_FDCWD, dir, times, 0) == 0);
+
+    cache = dir_cache_new();
+    ASSERT(dir_cache_load(&cache, cache_path));
+    matches = list_new();
+    ASSERT(dir_cache_glob(&cache, pattern, &matches));
+    ASSERT_EQm("changed directories should be read again", 1, cache.read);
+    ASSERT_EQm("changed directories should be read again", 2, list_len(matches));
+    list_free(matches);
+    dir_cache_free(cache);
+
+    remove_in(dir, "a.c");
+    remove_in(dir, "b.c");
+    remove(dir);
+    remove(cache_path);
+    rmdir(cache_dir);
+    PASS();
+}
+
+GREATEST_SUITE(dir_cache_suite) {
+    RUN_TEST(glob_test);
+    RUN_TEST(persist_test);
+}
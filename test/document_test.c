@@ -0,0 +1,173 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../document.h"
+#include "../parser.h"
+#include "greatest/greatest.h"
+
+static const char *base_text =
+    "cflags '-Wall';\n"
+    "[] > lexer ['cc $(cflags) -c lexer.c'] > ['lexer.o'];\n"
+    "[] > parser [lexer, 'cc -c parser.c'] > ['parser.o'];\n"
+    "[] > all [parser] > [];\n";
+
+typedef struct {
+    DocDiagnostic *diagnostics;
+    uint32_t len;
+    uint32_t cap;
+} Diagnostics;
+
+static void collect (void *ctx, size_t offset, const char *message) {
+    Diagnostics *d = ctx;
+    if (d->len == d->cap) {
+        d->cap = d->cap == 0 ? 8 : d->cap * 2;
+        d->diagnostics = realloc(d->diagnostics, d->cap * sizeof(DocDiagnostic));
+    }
+    size_t len = strlen(message);
+    if (len > 0 && message[len - 1] == '\n') --len;
+    d->diagnostics[d->len++] = (DocDiagnostic) { .offset = offset, .message = strndup(message, len) };
+}
+
+static int diagnostic_cmp (const void *a, const void *b) {
+    const DocDiagnostic *da = a;
+    const DocDiagnostic *db = b;
+    if (da->offset != db->offset) return da->offset < db->offset ? -1 : 1;
+    return strcmp(da->message, db->message);
+}
+
+// the document should have the statements and diagnostics lexing and parsing its whole text would give
+static bool same_as_full (const Document *doc) {
+    char *text = document_text(doc);
+    Diagnostics full = { 0 };
+    Prog prog = (Prog) { .filename = "test", .text = text, .report = collect, .report_ctx = &full };
+    Tokens tokens;
+    ASTProg ast;
+    lex(prog, &tokens);
+    parse(prog, tokens, &ast);
+
+    // statements per span, the full parse only knows statement order
+    char full_names[4096] = "";
+    char doc_names[4096] = "";
+    VEC_FOREACH(const ASTAction, action, ast.actions) {
+        strncat(full_names, action->name.back + action->name.start, action->name.length);
+        strcat(full_names, " ");
+    }
+    for (uint32_t i = 0; i < doc->spans_len; ++i) {
+        VEC_FOREACH(const ASTAction, doc_action, doc->spans[i]->ast.actions) {
+            strncat(doc_names, doc_action->name.back + doc_action->name.start, doc_action->name.length);
+            strcat(doc_names, " ");
+        }
+    }
+    bool same = strcmp(full_names, doc_names) == 0;
+
+    uint32_t len;
+    DocDiagnostic *diagnostics = document_diagnostics(doc, &len);
+    qsort(diagnostics, len, sizeof(DocDiagnostic), diagnostic_cmp);
+    qsort(full.diagnostics, full.len, sizeof(DocDiagnostic), diagnostic_cmp);
+    same = same && len == full.len;
+    for (uint32_t i = 0; same && i < len; ++i) same = diagnostic_cmp(diagnostics + i, full.diagnostics + i) == 0;
+
+    free(diagnostics);
+    for (uint32_t i = 0; i < full.len; ++i) free(full.diagnostics[i].message);
+    free(full.diagnostics);
+    free_prog(ast);
+    free_tokens(tokens);
+    free(text);
+    return same;
+}
+
+// replaces del characters skip past the first match of needle
+static bool edit_at (Document *doc, const char *needle, size_t skip, size_t del, const char *text) {
+    char *doc_text = document_text(doc);
+    char *found = strstr(doc_text, needle);
+    size_t offset = found == NULL ? 0 : found - doc_text + skip;
+    free(doc_text);
+    return found != NULL && document_edit(doc, offset, offset + del, text);
+}
+
+static size_t offset_of (const Document *doc, const char *needle) {
+    char *doc_text = document_text(doc);
+    size_t offset = strstr(doc_text, needle) - doc_text;
+    free(doc_text);
+    return offset;
+}
+
+TEST edit_test (void) {
+    Document doc;
+    document_new("test", base_text, &doc);
+    ASSERT_EQm("every statement should get a span", 4, doc.spans_len);
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+
+    DocSpan *untouched = doc.spans[1];
+    ASSERT(edit_at(&doc, "parser [", 0, 6, "parse"));
+    ASSERT_EQm("spans the edit doesn't touch should be kept", untouched, doc.spans[1]);
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+    ASSERT_EQ(4, doc.spans_len);
+
+    ASSERT(edit_at(&doc, "['lexer.o'];", 11, 1, ""));
+    ASSERT_EQm("removing a semicolon should join statements", 3, doc.spans_len);
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+    ASSERT(edit_at(&doc, "['lexer.o']", 11, 0, ";"));
+    ASSERT_EQ(4, doc.spans_len);
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+
+    // a string left open could end anywhere after it
+    ASSERT(edit_at(&doc, "cc -c parser.c", 0, 0, "'"));
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+    ASSERT(edit_at(&doc, "[parser]", 0, 0, "'"));
+    ASSERTm("edits after an open string should end it", same_as_full(&doc));
+    ASSERT(edit_at(&doc, "'[parser]", 0, 1, ""));
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+    ASSERT(edit_at(&doc, "''cc -c", 0, 1, ""));
+    ASSERT_EQ(4, doc.spans_len);
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+
+    ASSERT(document_edit(&doc, doc.len, doc.len, "[] > unfinished [] > []"));
+    ASSERT_EQ(5, doc.spans_len);
+    ASSERTm("unfinished statements should be reported at their end", same_as_full(&doc));
+    ASSERT(document_edit(&doc, doc.len, doc.len, ";\n"));
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+    ASSERT(document_edit(&doc, 0, 0, "  "));
+    ASSERTm("the document should parse like the whole text", same_as_full(&doc));
+
+    ASSERT_FALSEm("document_edit should fail out of range", document_edit(&doc, 0, doc.len + 1, ""));
+    ASSERT(document_edit(&doc, 0, doc.len, ""));
+    ASSERT_EQm("deleting everything should leave nothing", 0, doc.spans_len);
+    ASSERT(document_edit(&doc, 0, 0, base_text));
+    ASSERT_EQ(4, doc.spans_len);
+    char *text = document_text(&doc);
+    ASSERT_STR_EQ(base_text, text);
+    free(text);
+    document_free(doc);
+    PASS();
+}
+
+TEST lookup_test (void) {
+    Document doc;
+    document_new("test", base_text, &doc);
+
+    size_t def;
+    ASSERTm("document_definition should find variables in interpolations", document_definition(&doc, offset_of(&doc, "$(cflags)") + 3, &def));
+    ASSERT_EQ(0, def);
+    ASSERTm("document_definition should find actions used in commands", document_definition(&doc, offset_of(&doc, "lexer, "), &def));
+    ASSERT_EQ(offset_of(&doc, "lexer ["), def);
+    ASSERT_FALSEm("document_definition should fail on plain strings", document_definition(&doc, offset_of(&doc, "lexer.c"), &def));
+
+    StringSlice statement;
+    ASSERTm("document_hover should give variables' statements", document_hover(&doc, offset_of(&doc, "$(cflags)"), &statement));
+    ASSERTm("document_hover should give variables' statements", slice_equals_str(statement, "cflags '-Wall';"));
+    ASSERT_FALSEm("document_hover should only work on variables", document_hover(&doc, offset_of(&doc, "lexer, "), &statement));
+
+    // spans after an edit move, definitions in them should too
+    ASSERT(document_edit(&doc, 0, 0, "extra 'x';\n"));
+    ASSERTm("document_definition should find actions used in commands", document_definition(&doc, offset_of(&doc, "lexer, "), &def));
+    ASSERT_EQ(offset_of(&doc, "lexer ["), def);
+    document_free(doc);
+    PASS();
+}
+
+GREATEST_SUITE(document_suite) {
+    RUN_TEST(edit_test);
+    RUN_TEST(lookup_test);
+}
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../graph_cache.h"
+#include "../loader.h"
+#include "greatest/greatest.h"
+
+static void write_file (const char *dir, const char *name, const char *text) {
+    char path[256];
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+static void remove_in (const char *dir, const char *name) {
+    char path[256];
+    sprintf(path, "%s/%s", dir, name);
+    remove(path);
+}
+
+// loads root and resolves target, then caches it at cache_path
+static bool write_cache (const char *root, const char *target, const char *cache_path) {
+    BuildFiles files;
+    Graph g;
+    bool ok = load_build_files(root, 1, &files) && graph_new(files.progs, files.asts, files.files_len, &g);
+    if (ok) {
+        ok = graph_resolve(&g, target) && graph_cache_write(&g, cache_path);
+        graph_free(g);
+    }
+    free_build_files(files);
+    return ok;
+}
+
+TEST round_trip_test (void) {
+    char dir[] = "/tmp/bidet_graph_cacheXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    write_file(dir, "root.bdt",
+        "cflags '-Wall';\n"
+        "['lexer.c'] > lexer ['cc $(cflags) -c lexer.c'] > ['lexer.o'] depfile 'lexer.d' linkable;\n"
+        "['%.c'] > obj_% ['cc -c %.c'] > ['%.o'];\n"
+        "['main.c'] > all [lexer, obj_main, 'cc lexer.o main.o'] > ['bidet'];\n"
+        "[] > unrelated [] > [];\n");
+    char root[64], cache_path[64];
+    sprintf(root, "%s/root.bdt", dir);
+    sprintf(cache_path, "%s/graph", dir);
+    ASSERTm("graph_cache_write should write the cache", write_cache(root, "all", cache_path));
+
+    GraphCache cache;
+    ASSERTm("graph_cache_open should open an up to date cache", graph_cache_open(cache_path, &cache));
+    ASSERT_EQm("only resolved nodes should be cached", 3, cache.nodes_len);
+    uint32_t all, lexer, main_o;
+    ASSERTm("graph_cache_find should find actions", graph_cache_find(&cache, "all", &all));
+    ASSERTm("graph_cache_find should find actions", graph_cache_find(&cache, "lexer", &lexer));
+    ASSERTm("graph_cache_find should find pattern instances", graph_cache_find(&cache, "obj_main", &main_o));
+    ASSERT_FALSEm("unresolved actions shouldn't be cached", graph_cache_find(&cache, "unrelated", &all));
+    ASSERT_EQm("dependencies should come first", 2, all);
+
+    GraphCacheNode node = cache.nodes[all];
+    ASSERT_EQ(3, node.commands_len);
+    GraphCacheCommand command = cache.commands[node.commands];
+    ASSERT_EQm("actions in commands should be cache node indices", COMMAND_ACTION, command.type);
+    ASSERT_EQm("actions in commands should be cache node indices", lexer, command.action);
+    ASSERT_EQm("actions in commands should be cache node indices", main_o, cache.commands[node.commands + 1].action);
+    command = cache.commands[node.commands + 2];
+    ASSERT_STR_EQm("shell commands should be kept", "cc lexer.o main.o", graph_cache_string(&cache, command.shell));
+    ASSERT_EQ(1, node.reqs_len);
+    ASSERT_STR_EQm("paths should be kept", "main.c", graph_cache_string(&cache, cache.paths[cache.ids[node.reqs]]));
+    ASSERT_EQ(1, node.updates_len);
+    ASSERT_STR_EQm("paths should be kept", "bidet", graph_cache_string(&cache, cache.paths[cache.ids[node.updates]]));
+    command = cache.commands[cache.nodes[lexer].commands];
+    ASSERT_STR_EQm("commands should be expanded", "cc -Wall -c lexer.c", graph_cache_string(&cache, command.shell));
+    ASSERT_STR_EQm("depfiles should be kept", "lexer.d", graph_cache_string(&cache, cache.nodes[lexer].depfile));
+    ASSERT_STR_EQm("no depfile should be empty", "", graph_cache_string(&cache, node.depfile));
+    ASSERTm("linkable should be kept", cache.nodes[lexer].linkable && !node.linkable);
+    graph_cache_close(cache);
+
+    remove_in(dir, "graph");
+    remove_in(dir, "root.bdt");
+    remove(dir);
+    PASS();
+}
+
+TEST stale_test (void) {
+    char dir[] = "/tmp/bidet_graph_cacheXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char src[64];
+    sprintf(src, "%s/src", dir);
+    ASSERT(mkdir(src, 0755) == 0);
+    const char *text = "include 'more.bdt';\n[] > all [more] > [];\n";
+    write_file(dir, "root.bdt", text);
+    write_file(dir, "more.bdt", "[] > more [] > [];\n");
+    char root[64], cache_path[64], glob_text[128];
+    sprintf(root, "%s/root.bdt", dir);
+    sprintf(cache_path, "%s/graph", dir);
+    GraphCache cache;
+
+    ASSERT_FALSEm("graph_cache_open should fail on missing caches", graph_cache_open(cache_path, &cache));
+    write_file(dir, "graph", "not a cache");
+    ASSERT_FALSEm("graph_cache_open should fail on garbage", graph_cache_open(cache_path, &cache));
+
+    ASSERT(write_cache(root, "all", cache_path));
+    write_file(dir, "root.bdt", text);
+    ASSERTm("rewriting a build file unchanged should keep the cache", graph_cache_open(cache_path, &cache));
+    graph_cache_close(cache);
+    write_file(dir, "more.bdt", "[] > more ['echo'] > [];\n");
+    ASSERT_FALSEm("changing an included file should make the cache stale", graph_cache_open(cache_path, &cache));
+
+    sprintf(glob_text, "[] > all [] > ['%s/*.c'];\n", src);
+    write_file(dir, "root.bdt", glob_text);
+    ASSERT(write_cache(root, "all", cache_path));
+    ASSERTm("graph_cache_open should open an up to date cache", graph_cache_open(cache_path, &cache));
+    graph_cache_close(cache);
+    write_file(src, "new.c", "");
+    ASSERT_FALSEm("files added to globbed directories should make the cache stale", graph_cache_open(cache_path, &cache));
+
+    remove_in(src, "new.c");
+    remove(src);
+    remove_in(dir, "graph");
+    remove_in(dir, "root.bdt");
+    remove_in(dir, "more.bdt");
+    remove(dir);
+    PASS();
+}
+
+GREATEST_SUITE(graph_cache_suite) {
+    RUN_TEST(round_trip_test);
+    RUN_TEST(stale_test);
+}
@@ -0,0 +1,510 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../graph.h"
+#include "../parser.h"
+#include "greatest/greatest.h"
+
+// lexes and parses prog's text, then indexes it
+// the graph keeps pointing at prog
+static bool load (const Prog *prog, Tokens *toks, ASTProg *ast, Graph *g) {
+    return lex(*prog, toks) && parse(*prog, *toks, ast) && graph_new(prog, ast, 1, g);
+}
+
+static bool path_is (const Graph *g, uint32_t id, const char *path) {
+    return slice_equals_str(interner_get(&g->paths, id), path);
+}
+
+static void count_error (void *ctx, size_t offset, const char *message) {
+    (void) offset;
+    (void) message;
+    ++*(int *) ctx;
+}
+
+TEST lazy_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "build_dir 'no_such_dir';\n"
+            "cflags '-Wall';\n"
+            "['lexer.c'] > lexer [`'cc $(cflags) -c lexer.c -o $(build_dir)/lexer.o'`] > ['$(build_dir)/lexer.o'];\n"
+            "['parser.c'] > parser [lexer, 'cc $(cflags) -c parser.c'] > [build_dir + '/parser.o'];\n"
+            "['$(undefined)'] > unrelated [] > [];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERTm("graph should load", load(&prog, &toks, &ast, &g));
+
+    ASSERTm("graph_resolve should resolve parser", graph_resolve(&g, "parser"));
+    ASSERT_EQm("only parser and lexer should be resolved", 2, g.order_len);
+    ASSERT_FALSEm("unreachable actions shouldn't be resolved", g.nodes[2].resolved);
+    ASSERT_EQm("dependencies should come first", 0, g.order[0]);
+    ASSERT_EQm("dependencies should come first", 1, g.order[1]);
+
+    GraphNode parser = g.nodes[1];
+    ASSERT_EQm("parser should have both commands", 2, parser.commands_len);
+    ASSERT_EQm("lone action names should be dependencies", COMMAND_ACTION, parser.commands[0].type);
+    ASSERT_EQm("lone action names should be dependencies", 0, parser.commands[0].data.action);
+    ASSERT_STR_EQm("commands should be expanded", "cc -Wall -c parser.c", parser.commands[1].data.shell);
+    ASSERTm("updates should be expanded", path_is(&g, parser.updates[0], "no_such_dir/parser.o"));
+    ASSERT_STR_EQm("interpolation should work in any string",
+        "cc -Wall -c lexer.c -o no_such_dir/lexer.o", g.nodes[0].commands[0].data.shell);
+    ASSERT_EQm("missing files should be stat'd as missing", GRAPH_MTIME_MISSING, g.mtimes[parser.updates[0]]);
+
+    ASSERT_FALSEm("graph_resolve should fail on unknown targets", graph_resolve(&g, "tests"));
+    ASSERT_FALSEm("graph_resolve should fail on undefined variables", graph_resolve(&g, "unrelated"));
+
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST stat_test (void) {
+    char dir[] = "/tmp/bidet_statXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/req", dir);
+    FILE *file = fopen(path, "w");
+    ASSERT(file != NULL);
+    fclose(file);
+
+    char text[2 * sizeof(path) + 64];
+    sprintf(text, "['%s', '%s*'] > foo [] > [];", path, path);
+    Prog prog = (Prog) { .filename = "test", .text = text };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERTm("graph should load", load(&prog, &toks, &ast, &g));
+    ASSERTm("graph_resolve should resolve foo", graph_resolve(&g, "foo"));
+    ASSERTm("existing reqs should have an mtime", g.mtimes[g.nodes[0].reqs[0]] > 0);
+    ASSERT_EQm("globs should expand to what they match", 2, g.nodes[0].reqs_len);
+    ASSERTm("globs should expand to what they match", path_is(&g, g.nodes[0].reqs[1], path));
+
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST depfile_test (void) {
+    char dir[] = "/tmp/bidet_graphXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/deps", dir);
+    DepsLog log;
+    ASSERT(deps_log_open(path, &log));
+    LList deps = list_new();
+    list_push(&deps, strdup("lexer.c"));
+    list_push(&deps, strdup("lexer.h"));
+    list_push(&deps, strdup("prog.h"));
+    ASSERT(deps_log_record(&log, "lexer.o", 1, deps));
+    list_free(deps);
+
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "['lexer.c'] > lexer ['cc -MD -c lexer.c'] > ['lexer.o'] depfile 'lexer.d';\n"
+            "['parser.c'] > parser ['cc -c parser.c'] > ['parser.o'];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    g.deps = &log;
+    ASSERT(graph_resolve(&g, "lexer") && graph_resolve(&g, "parser"));
+    GraphNode lexer = g.nodes[0];
+    ASSERT_STR_EQm("the depfile should be expanded", "lexer.d", lexer.depfile);
+    ASSERT_EQm("logged deps should join reqs, without repeats", 3, lexer.reqs_len);
+    ASSERT_EQ(2, lexer.found_len);
+    ASSERT(path_is(&g, lexer.reqs[1], "lexer.h") && path_is(&g, lexer.reqs[2], "prog.h"));
+    uint32_t id;
+    ASSERTm("logged deps should be indexed", graph_path_id(&g, "prog.h", &id) && graph_consumers(&g, id).len == 1);
+    ASSERTm("actions without logged deps should keep their reqs", g.nodes[1].reqs_len == 1 && g.nodes[1].depfile == NULL);
+
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    deps_log_close(log);
+    remove(path);
+    rmdir(dir);
+    PASS();
+}
+
+TEST cycle_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "loop loop + 'x';\n"
+            "[] > a [b] > [];\n"
+            "[] > b [a] > [];\n"
+            "[loop] > c [] > [];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERTm("graph should load", load(&prog, &toks, &ast, &g));
+    ASSERT_FALSEm("graph_resolve should fail on dependency cycles", graph_resolve(&g, "a"));
+    ASSERT_FALSEm("graph_resolve should fail on variables using themselves", graph_resolve(&g, "c"));
+
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST failed_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "['lexer.c'] > lexer ['cc -c lexer.c'] > ['$(missing)/lexer.o'];\n"
+            "['parser.c'] > parser [lexer, 'cc -c parser.c'] > ['parser.o'];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    ASSERT_FALSE(graph_resolve(&g, "parser"));
+    ASSERTm("a failed action should be left empty", g.nodes[0].failed && g.nodes[0].reqs_len == 0 && g.nodes[0].commands_len == 0);
+    uint32_t id;
+    ASSERTm("a failed action shouldn't be indexed", !graph_path_id(&g, "lexer.c", &id) || graph_consumers(&g, id).len == 0);
+    // expanding it again would leak the first try
+    ASSERT_FALSEm("a failed action should fail again", graph_resolve(&g, "lexer"));
+    ASSERT_FALSEm("actions needing a failed one should fail again", graph_resolve(&g, "parser"));
+
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST pattern_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "build_dir 'no_such_dir';\n"
+            "['%.c'] > obj_% ['cc -c %.c -o $(build_dir)/%.o'] > ['$(build_dir)/%.o'];\n"
+            "[] > obj_%_special ['true'] > [];\n"
+            "[] > link [obj_lexer, obj_parser, obj_lexer_special] > [];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERTm("graph should load", load(&prog, &toks, &ast, &g));
+    ASSERT_EQm("patterns shouldn't be instantiated up front", g.actions_len, g.nodes_len);
+
+    ASSERTm("graph_resolve should resolve link", graph_resolve(&g, "link"));
+    ASSERT_EQm("only reached instances should exist", g.actions_len + 3, g.nodes_len);
+    ASSERT_EQm("instances should be resolved before link", 4, g.order_len);
+    GraphNode lexer = g.nodes[g.nodes[0].commands[0].data.action];
+    ASSERT_STR_EQm("% should become the stem", "cc -c lexer.c -o no_such_dir/lexer.o", lexer.commands[0].data.shell);
+    ASSERTm("% should become the stem in reqs", path_is(&g, lexer.reqs[0], "lexer.c"));
+    ASSERTm("% should become the stem in updates", path_is(&g, lexer.updates[0], "no_such_dir/lexer.o"));
+    GraphNode special = g.nodes[g.nodes[0].commands[2].data.action];
+    ASSERT_STR_EQm("the shortest stem should win", "true", special.commands[0].data.shell);
+
+    ASSERTm("graph_resolve should instantiate requested targets", graph_resolve(&g, "obj_graph"));
+    ASSERTm("graph_resolve should reuse instances", graph_resolve(&g, "obj_lexer"));
+    ASSERT_EQm("instances should be reused", g.actions_len + 4, g.nodes_len);
+    ASSERT_FALSEm("stems can't be empty", graph_resolve(&g, "obj_"));
+
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST duplicate_test (void) {
+    Prog prog = (Prog) { .filename = "test", .text = "[] > a [] > [];\n[] > a [] > [];" };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(lex(prog, &toks) && parse(prog, toks, &ast));
+    ASSERT_FALSEm("graph_new should fail on duplicate actions", graph_new(&prog, &ast, 1, &g));
+
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST parse_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "cflags '-Wall';\n"
+            "['%.c'] > obj_% ['cc $(cflags) -c %.c'] > ['%.o'];\n"
+            "[] > link [obj_lexer, 'cc ' + cflags + ' lexer.o'] > [];\n"
+    };
+    Graph g;
+    ASSERTm("graph_parse should load", graph_parse(&prog, &g));
+    ASSERTm("graph_resolve should resolve link", graph_resolve(&g, "link"));
+    ASSERT_EQm("graph_parse should index like graph_new", 2, g.order_len);
+    GraphNode link = g.nodes[0];
+    ASSERT_STR_EQm("streamed statements should keep their strings", "cc -Wall lexer.o", link.commands[1].data.shell);
+    ASSERT_STR_EQm("streamed statements should keep their strings", "cc -Wall -c lexer.c", g.nodes[link.commands[0].data.action].commands[0].data.shell);
+    graph_free(g);
+
+    prog.text = "[] > a [] > [];\n[] > a [] > [];";
+    ASSERT_FALSEm("graph_parse should fail on duplicate actions", graph_parse(&prog, &g));
+    prog.text = "include 'other.bd';\n[] > a [] > [];";
+    ASSERT_FALSEm("graph_parse should fail on includes", graph_parse(&prog, &g));
+    prog.text = "[] > a ['x'] > [];\n[] > b [a 'y'] > [];";
+    ASSERT_FALSEm("graph_parse should fail on syntax errors", graph_parse(&prog, &g));
+    PASS();
+}
+
+TEST shared_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "cflags '-Wall';\n"
+            "[] > a ['cc $(cflags)'] > ['$(cflags).o'];\n"
+            "['$(cflags).o'] > b [a, 'cc $(cflags)'] > [];\n"
+            "[] > c [b, 'cc ' + cflags] > [];\n"
+            "[] > obj_% ['cc %'] > [];\n"
+            "[] > all [c, obj_x, obj_y] > [];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    ASSERT(graph_resolve(&g, "all"));
+    const char *a = g.nodes[0].commands[0].data.shell;
+    ASSERT_EQm("the same expression should expand to one shared string", a, g.nodes[1].commands[1].data.shell);
+    ASSERT_EQm("different expressions expanding the same should share it too", a, g.nodes[2].commands[1].data.shell);
+    ASSERT_EQ(g.nodes[0].updates[0], g.nodes[1].reqs[0]);
+    const GraphNode *all = g.nodes + 3;
+    ASSERT_STR_EQm("instances should expand with their own stem", "cc x", g.nodes[all->commands[1].data.action].commands[0].data.shell);
+    ASSERT_STR_EQm("instances should expand with their own stem", "cc y", g.nodes[all->commands[2].data.action].commands[0].data.shell);
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST rdeps_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "['gen.h', 'lexer.c'] > lexer ['cc -c lexer.c'] > ['lexer.o'];\n"
+            "['gen.h', 'gen.h', 'parser.c'] > parser ['cc -c parser.c'] > ['parser.o'];\n"
+            "['lexer.o', 'parser.o'] > all [lexer, parser, 'cc lexer.o parser.o'] > ['bidet'];\n"
+            "[] > other ['cc -c lexer.c'] > ['lexer.o'];\n"
+            "[] > both [all, other] > [];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    ASSERT(graph_resolve(&g, "all"));
+    uint32_t path;
+    ASSERT(graph_path_id(&g, "gen.h", &path));
+    GraphIds consumers = graph_consumers(&g, path);
+    ASSERT_EQm("every action reading a path should be indexed once", 2, consumers.len);
+    ASSERT_EQ(1, VEC_ITEMS(consumers)[0] + VEC_ITEMS(consumers)[1]);
+    ASSERT_EQ(GRAPH_NO_NODE, graph_producer(&g, path));
+    ASSERT(graph_path_id(&g, "parser.o", &path));
+    ASSERT_EQm("the action updating a path should be indexed", 1, graph_producer(&g, path));
+    ASSERT_EQ(2, VEC_ITEMS(graph_consumers(&g, path))[0]);
+    ASSERT_FALSEm("paths nothing resolved uses shouldn't have ids", graph_path_id(&g, "nothing", &path));
+    ASSERT_FALSEm("two actions updating a path should be an error", graph_resolve(&g, "both"));
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+static bool has_path (const Graph *g, GraphIds paths, const char *path) {
+    uint32_t id;
+    if (!graph_path_id(g, path, &id)) return false;
+    VEC_FOREACH(const uint32_t, p, paths) {
+        if (*p == id) return true;
+    }
+    return false;
+}
+
+TEST needed_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "['gen.py'] > gen ['python gen.py'] > ['gen.h'];\n"
+            "['gen.h', 'lexer.c'] > lexer [gen, 'cc -c lexer.c'] > ['lexer.o'];\n"
+            "['gen.h', 'parser.c'] > parser [gen, 'cc -c parser.c'] > ['parser.o'];\n"
+            "['lexer.o', 'parser.o'] > tests [lexer, parser, 'cc lexer.o parser.o'] > ['tests'];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    ASSERT(graph_resolve(&g, "tests"));
+
+    // everything from the cache, only the target has to be written
+    bool cached[4] = { true, true, true, true };
+    uint32_t target = 3;
+    GraphIds paths = VEC_EMPTY;
+    graph_outputs_needed(&g, cached, &target, 1, &paths);
+    ASSERT_EQm("a cached build should only need its targets' outputs", 1, paths.len);
+    ASSERT(has_path(&g, paths, "tests"));
+    graph_ids_free(paths);
+
+    // parser has to run, so what it reads from the cache has to be there, but lexer.o doesn't
+    cached[2] = false;
+    paths = (GraphIds) VEC_EMPTY;
+    graph_outputs_needed(&g, cached, &target, 1, &paths);
+    ASSERT_EQ(2, paths.len);
+    ASSERTm("outputs actions that run read should be needed", has_path(&g, paths, "gen.h"));
+    ASSERT_FALSEm("outputs only cached actions read shouldn't be", has_path(&g, paths, "lexer.o"));
+    ASSERT_FALSEm("outputs of actions that run aren't materialized", has_path(&g, paths, "parser.o"));
+    graph_ids_free(paths);
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST cutoff_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "['gen.py'] > gen ['python gen.py'] > ['gen.h'];\n"
+            "['gen.h', 'lexer.c'] > lexer [gen, 'cc -c lexer.c'] > ['lexer.o'];\n"
+            "['gen.h', 'parser.c'] > parser [gen, 'cc -c parser.c'] > ['parser.o'];\n"
+            "['lexer.o', 'parser.o'] > tests [lexer, parser, 'cc lexer.o parser.o'] > ['tests'];\n"
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    ASSERT(graph_resolve(&g, "tests"));
+
+    // gen.h came out the same, but parser.c was edited
+    bool *changed = calloc(g.paths.len, sizeof(bool));
+    uint32_t id;
+    ASSERT(graph_path_id(&g, "parser.c", &id));
+    changed[id] = true;
+    GraphIds clean = VEC_EMPTY;
+    graph_cutoff(&g, 0, changed, &clean);
+    ASSERT_EQm("only readers of the unchanged output with nothing else changed should be clean", 1, clean.len);
+    ASSERT_EQ(1, VEC_ITEMS(clean)[0]);
+    graph_ids_free(clean);
+
+    // an output with new contents cuts nothing off
+    ASSERT(graph_path_id(&g, "gen.h", &id));
+    changed[id] = true;
+    clean = (GraphIds) VEC_EMPTY;
+    graph_cutoff(&g, 0, changed, &clean);
+    ASSERT_EQ(0, clean.len);
+    graph_ids_free(clean);
+    free(changed);
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+TEST target_test (void) {
+    int errors = 0;
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "out 'build';\n"
+            "indirect '$(missing)';\n"
+            "loop loop;\n"
+            "['lexer.c'] > lexer ['cc -c lexer.c'] > ['$(out)/lexer.o', '$(missing)/x', '$(indirect)/y', loop];\n"
+            "['parser.c'] > parser ['cc -c parser.c'] > ['$(out)/parser.o'];\n"
+            "[] > parser_test [parser, 'cc parser_test.c'] > [];\n"
+            "[] > % ['true'] > ['%.stamp'];\n", // matches any name, outputs should still come first
+        .report = count_error,
+        .report_ctx = &errors
+    };
+    Tokens toks;
+    ASTProg ast;
+    Graph g;
+    ASSERT(load(&prog, &toks, &ast, &g));
+    ASSERTm("targets should be able to be outputs", graph_resolve(&g, "build/parser.o"));
+    ASSERTm("outputs should resolve the action updating them", g.nodes[1].resolved);
+    ASSERT_FALSE(g.nodes[0].resolved);
+    ASSERT_EQm("outputs that can't expand shouldn't be reported unless they're resolved", 0, errors);
+
+    StringSlice suggestion;
+    ASSERTm("names like an action's should get it suggested", graph_suggest(&g, "parsr", &suggestion));
+    ASSERT(slice_equals_str(suggestion, "parser"));
+    ASSERT(graph_suggest(&g, "parser_tset", &suggestion));
+    ASSERT(slice_equals_str(suggestion, "parser_test"));
+    ASSERT(graph_suggest(&g, "lexr", &suggestion));
+    ASSERT(slice_equals_str(suggestion, "lexer"));
+    ASSERT_FALSEm("names like nothing shouldn't get a suggestion", graph_suggest(&g, "zzzz", &suggestion));
+    graph_free(g);
+    free_prog(ast);
+    free_tokens(toks);
+    PASS();
+}
+
+typedef struct {
+    Graph *g;
+    char order[256]; // "name@actions parsed so far " for each ready action
+    bool resolved;
+    bool refused; // an action that isn't ready yet couldn't be resolved
+} Ready;
+
+static void on_ready (void *ctx, uint32_t idx) {
+    Ready *ready = ctx;
+    StringSlice name = ready->g->actions[idx]->name;
+    sprintf(ready->order + strlen(ready->order), "%.*s@%u ", (int) name.length, name.back + name.start, ready->g->actions_len);
+    char *target = slice_to_str(name);
+    ready->resolved = graph_resolve(ready->g, target) && ready->resolved;
+    // f's obj_x could still become a pattern instance
+    if (strcmp(target, "g") == 0) ready->refused = !graph_resolve(ready->g, "f");
+    free(target);
+}
+
+TEST ready_test (void) {
+    Prog prog = (Prog) {
+        .filename = "test",
+        .text =
+            "cflags '-Wall';\n"
+            "[] > a ['cc $(cflags) a.c'] > [];\n"
+            "[] > b [a, 'x'] > [];\n"
+            "[] > c [later] > [];\n"
+            "[] > d ['$(late)'] > [];\n"
+            "late 'v';\n"
+            "[] > later [] > [];\n"
+            "[] > e [cflags] > [];\n"
+            "[] > f [obj_x] > [];\n"
+            "[] > g [] > [];\n"
+            "[] > obj_% [] > [];\n"
+    };
+    Graph g;
+    Ready ready = { .g = &g, .resolved = true };
+    ASSERTm("graph_parse_ready should load", graph_parse_ready(&prog, &g, on_ready, &ready));
+    ASSERT_STR_EQm("actions should be ready as soon as nothing later can change them", "a@1 b@2 d@4 later@5 c@5 g@8 ", ready.order);
+    ASSERTm("ready actions should resolve while parsing", ready.resolved);
+    ASSERTm("actions that aren't ready shouldn't resolve while parsing", ready.refused);
+    ASSERT_STR_EQm("ready actions should resolve like they would after", "cc -Wall a.c", g.nodes[0].commands[0].data.shell);
+    ASSERTm("held back actions should resolve after", graph_resolve(&g, "e") && graph_resolve(&g, "f"));
+    ASSERT_EQ(9, g.order_len);
+    graph_free(g);
+    PASS();
+}
+
+GREATEST_SUITE(graph_suite) {
+    RUN_TEST(lazy_test);
+    RUN_TEST(stat_test);
+    RUN_TEST(depfile_test);
+    RUN_TEST(cycle_test);
+    RUN_TEST(failed_test);
+    RUN_TEST(pattern_test);
+    RUN_TEST(duplicate_test);
+    RUN_TEST(parse_test);
+    RUN_TEST(shared_test);
+    RUN_TEST(rdeps_test);
+    RUN_TEST(target_test);
+    RUN_TEST(needed_test);
+    RUN_TEST(cutoff_test);
+    RUN_TEST(ready_test);
+}
@@ -0,0 +1,118 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../hash.h"
+#include "greatest/greatest.h"
+
+TEST bytes_test (void) {
+    // reference fnv-1a values
+    ASSERT_EQm("empty input should hash to the offset basis", 0xcbf29ce484222325u, hash_bytes("", 0));
+    ASSERT_EQm("hash_bytes should match fnv-1a", 0xaf63dc4c8601ec8cu, hash_bytes("a", 1));
+    ASSERT_EQm("hashing in pieces should match hashing at once",
+        hash_bytes("foobar", 6),
+        hash_bytes_continue(hash_bytes("foo", 3), "bar", 3));
+    PASS();
+}
+
+TEST content_test (void) {
+    char data[100];
+    for (size_t i = 0; i < sizeof(data); ++i) data[i] = (char) i;
+    HashContent hash = hash_content(data, sizeof(data));
+    ASSERTm("hash_content should be deterministic", hash_content_equal(hash, hash_content(data, sizeof(data))));
+    ASSERTm("the halves should differ", hash.lo != hash.hi);
+    // every length through the stripe and word tails
+    for (size_t len = 0; len < sizeof(data); ++len) {
+        ASSERT_FALSEm("lengths should hash differently", hash_content_equal(hash_content(data, len), hash_content(data, len + 1)));
+    }
+    data[50] ^= 1;
+    ASSERT_FALSEm("a changed byte should change the hash", hash_content_equal(hash, hash_content(data, sizeof(data))));
+    PASS();
+}
+
+TEST content_file_test (void) {
+    char dir[] = "/tmp/bidet_hashXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    sprintf(path, "%s/file", dir);
+    FILE *file = fopen(path, "wb");
+    ASSERT(file != NULL);
+    fputs("cc -c lexer.c", file);
+    fclose(file);
+    HashContent hash;
+    ASSERT(hash_content_file(path, 1, &hash));
+    ASSERTm("small files should hash like their contents", hash_content_equal(hash_content("cc -c lexer.c", 13), hash));
+
+    // a few chunks and a bit
+    size_t len = 2 * HASH_CHUNK + 12345;
+    char *data = malloc(len);
+    for (size_t i = 0; i < len; ++i) data[i] = (char) (i * 7 + i / 4096);
+    file = fopen(path, "wb");
+    ASSERT(file != NULL);
+    fwrite(data, 1, len, file);
+    fclose(file);
+    HashContent one;
+    HashContent many;
+    ASSERT(hash_content_file(path, 1, &one));
+    ASSERT(hash_content_file(path, 8, &many));
+    ASSERTm("the hash shouldn't depend on how many threads did it", hash_content_equal(one, many));
+    ASSERTm("files should hash like their contents in memory", hash_content_equal(one, hash_content_chunks(data, len, 2)));
+    HashContent tree[2][2] = { { hash_content(data, HASH_CHUNK), hash_content(data + HASH_CHUNK, HASH_CHUNK) } };
+    tree[1][0] = hash_content(tree[0], sizeof(tree[0]));
+    tree[1][1] = hash_content(data + 2 * HASH_CHUNK, len - 2 * HASH_CHUNK);
+    ASSERTm("chunks should combine pairwise, the odd one out going up as it is",
+        hash_content_equal(one, hash_content(tree[1], sizeof(tree[1]))));
+
+    data[len - 1] ^= 1;
+    file = fopen(path, "wb");
+    ASSERT(file != NULL);
+    fwrite(data, 1, len, file);
+    fclose(file);
+    ASSERT(hash_content_file(path, 8, &many));
+    ASSERT_FALSEm("a change in the last chunk should change the hash", hash_content_equal(one, many));
+    free(data);
+    remove(path);
+    ASSERT_FALSEm("hash_content_file should fail on missing files", hash_content_file(path, 1, &hash));
+    rmdir(dir);
+    PASS();
+}
+
+typedef struct {
+    const char *data;
+    size_t len;
+    HashContent hash;
+} Hashing;
+
+static void *hash_thread (void *arg) {
+    Hashing *hashing = arg;
+    hashing->hash = hash_content_chunks(hashing->data, hashing->len, 3);
+    return NULL;
+}
+
+TEST shared_pool_test (void) {
+    size_t len = 5 * HASH_CHUNK + 7;
+    char *data = malloc(len);
+    for (size_t i = 0; i < len; ++i) data[i] = (char) (i * 13 + i / 777);
+    HashContent expected = hash_content_chunks(data, len, 1);
+    Hashing hashings[4];
+    pthread_t ids[4];
+    for (int i = 0; i < 4; ++i) {
+        hashings[i] = (Hashing) { data, len, { 0, 0 } };
+        ASSERT_EQ(0, pthread_create(ids + i, NULL, hash_thread, hashings + i));
+    }
+    for (int i = 0; i < 4; ++i) pthread_join(ids[i], NULL);
+    for (int i = 0; i < 4; ++i) {
+        ASSERTm("callers sharing the pool should each get their own hash", hash_content_equal(expected, hashings[i].hash));
+    }
+    free(data);
+    PASS();
+}
+
+GREATEST_SUITE(hash_suite) {
+    RUN_TEST(bytes_test);
+    RUN_TEST(content_test);
+    RUN_TEST(content_file_test);
+    RUN_TEST(shared_pool_test);
+}
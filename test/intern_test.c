@@ -0,0 +1,34 @@
+#include "../intern.h"
+#include "greatest/greatest.h"
+
+TEST intern_test (void) {
+    Interner interner = interner_new();
+    const char *text = "lexer.o parser.o lexer.o";
+
+    uint32_t lexer = interner_add(&interner, str_to_slice(text, 0, 7));
+    uint32_t parser = interner_add(&interner, str_to_slice(text, 8, 8));
+    ASSERT_EQm("ids should be sequential", 0, lexer);
+    ASSERT_EQm("ids should be sequential", 1, parser);
+    ASSERT_EQm("the same string should get the same id", lexer, interner_add(&interner, str_to_slice(text, 17, 7)));
+
+    uint32_t found;
+    ASSERTm("interner_find should find added strings", interner_find(&interner, str_to_slice_raw("parser.o"), &found));
+    ASSERT_EQm("interner_find should give the string's id", parser, found);
+    ASSERT_FALSEm("interner_find shouldn't find missing strings", interner_find(&interner, str_to_slice_raw("tests.o"), &found));
+    ASSERTm("interner_get should give the string back", slice_equals_str(interner_get(&interner, parser), "parser.o"));
+
+    // enough to grow the table a few times
+    char names[1000][8];
+    for (int i = 0; i < 1000; ++i) {
+        sprintf(names[i], "%d.o", i);
+        ASSERT_EQm("new strings should get new ids", (uint32_t) i + 2, interner_add(&interner, str_to_slice_raw(names[i])));
+    }
+    ASSERTm("strings should survive growing", interner_find(&interner, str_to_slice_raw("lexer.o"), &found) && found == lexer);
+
+    interner_free(interner);
+    PASS();
+}
+
+GREATEST_SUITE(intern_suite) {
+    RUN_TEST(intern_test);
+}
@@ -0,0 +1,82 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <unistd.h>
+#include "../jobserver.h"
+#include "greatest/greatest.h"
+
+TEST pipe_server_test (void) {
+    Jobserver js;
+    ASSERTm("jobserver_create should make a pipe jobserver", jobserver_create(JOBSERVER_PIPE, 3, &js));
+
+    // one of the three jobs is our implicit token
+    char tokens[3];
+    ASSERTm("jobserver should have a first token", jobserver_try_acquire(&js, tokens));
+    ASSERTm("jobserver should have a second token", jobserver_try_acquire(&js, tokens + 1));
+    ASSERT_FALSEm("jobserver should be out of tokens", jobserver_try_acquire(&js, tokens + 2));
+
+    ASSERTm("jobserver_release should give a token back", jobserver_release(&js, tokens[1]));
+    ASSERTm("jobserver_acquire should take the released token", jobserver_acquire(&js, tokens + 1));
+    ASSERT_EQm("tokens should come back unchanged", '+', tokens[1]);
+
+    jobserver_free(js);
+    PASS();
+}
+
+TEST fifo_server_test (void) {
+    Jobserver js;
+    ASSERTm("jobserver_create should make a fifo jobserver", jobserver_create(JOBSERVER_FIFO, 2, &js));
+    ASSERTm("fifo should exist", access(js.fifo_path, F_OK) == 0);
+
+    char token;
+    ASSERTm("jobserver should have a token", jobserver_try_acquire(&js, &token));
+    ASSERT_FALSEm("jobserver should be out of tokens", jobserver_try_acquire(&js, &token));
+    ASSERTm("jobserver_release should give a token back", jobserver_release(&js, token));
+
+    char *path = strdup(js.fifo_path);
+    jobserver_free(js);
+    ASSERT_FALSEm("jobserver_free should remove the fifo", access(path, F_OK) == 0);
+    free(path);
+    PASS();
+}
+
+TEST connect_test (void) {
+    JobserverType types[2] = { JOBSERVER_PIPE, JOBSERVER_FIFO };
+    for (size_t i = 0; i < 2; ++i) {
+        Jobserver server;
+        ASSERTm("jobserver_create should succeed", jobserver_create(types[i], 2, &server));
+        char *flags = jobserver_makeflags(&server, 2);
+        // what make puts before ours, e.g. from make -k
+        char *makeflags = malloc(strlen("k -- ") + strlen(flags) + 1);
+        sprintf(makeflags, "k %s --", flags);
+
+        Jobserver client;
+        ASSERTm("jobserver_connect should find the jobserver", jobserver_connect(makeflags, &client));
+        ASSERT_EQm("client should be the same kind of jobserver", types[i], client.type);
+        char token;
+        ASSERTm("client should take the only token", jobserver_try_acquire(&client, &token));
+        ASSERT_FALSEm("server should see the token gone", jobserver_try_acquire(&server, &token));
+        ASSERTm("client should give the token back", jobserver_release(&client, token));
+        ASSERTm("server should get the token", jobserver_try_acquire(&server, &token));
+
+        jobserver_free(client);
+        jobserver_free(server);
+        free(makeflags);
+        free(flags);
+    }
+    PASS();
+}
+
+TEST connect_missing_test (void) {
+    Jobserver js;
+    ASSERT_FALSEm("no MAKEFLAGS means no jobserver", jobserver_connect(NULL, &js));
+    ASSERT_FALSEm("-j alone isn't a jobserver", jobserver_connect("-j4", &js));
+    ASSERT_FALSEm("closed fds aren't a jobserver", jobserver_connect("-j4 --jobserver-auth=1000,1001", &js));
+    PASS();
+}
+
+GREATEST_SUITE(jobserver_suite) {
+    RUN_TEST(pipe_server_test);
+    RUN_TEST(fifo_server_test);
+    RUN_TEST(connect_test);
+    RUN_TEST(connect_missing_test);
+}
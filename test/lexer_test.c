@@ -1,3 +1,7 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../lexer.h"
 #include "type_infos.h"
 #include "greatest/greatest.h"
@@ -15,16 +19,15 @@ TEST symbol_test (void) {
     };
     Prog prog = (Prog) { .filename = "test", .text = ">[],+;" };
     // lex returns an array of tokens, but we only use the first element
-    LList syms;
+    Tokens syms;
     ASSERTm("lex should succeed on symbols", lex(prog, &syms));
-    ASSERT_EQm("lex should lex the right number of symbols", 6, list_len(syms));
+    ASSERT_EQm("lex should lex the right number of symbols", 6, syms.len);
 
     char *message = malloc(sizeof("lex should lex x correctly"));
     char characters[6] = { '>', '[', ']', ',', '+', ';' };
-    LLNode *sym_node = syms.head;
-    for (int i = 0; i < 6; sym_node = sym_node->next, ++i) {
+    for (int i = 0; i < 6; ++i) {
         sprintf(message, "lex should lex %c correctly", characters[i]);
-        ASSERT_EQUAL_Tm(message, answers + i, sym_node->data, &token_type_info, NULL);
+        ASSERT_EQUAL_Tm(message, answers + i, VEC_ITEMS(syms) + i, &token_type_info, NULL);
     }
     free(message);
 
@@ -34,7 +37,7 @@ TEST symbol_test (void) {
 
 TEST ident_test (void) {
     Prog prog = (Prog) { .filename = "test", .text = "a-b_0" };
-    LList ident;
+    Tokens ident;
     ASSERTm("lex should succeed on identifier", lex(prog, &ident));
 
     Token correct_ident = (Token) {
@@ -43,7 +46,7 @@ TEST ident_test (void) {
         .offset = 0,
         .length = strlen("a-b_0")
     };
-    ASSERT_EQUAL_Tm("lex should lex identifier correctly", &correct_ident, ident.head->data, &token_type_info, NULL);
+    ASSERT_EQUAL_Tm("lex should lex identifier correctly", &correct_ident, VEC_ITEMS(ident), &token_type_info, NULL);
 
     free_tokens(ident);
     PASS();
@@ -51,44 +54,100 @@ TEST ident_test (void) {
 
 TEST string_test (void) {
     Prog prog = (Prog) { .filename = "test", .text = "``'bar 'bar`'$(bar) bar'``" };
-    LList str;
+    Tokens str;
     ASSERTm("lex should succeed on string", lex(prog, &str));
 
+    // more parts than fit inline
+    InterpolParts parts = VEC_EMPTY;
+    interpol_parts_append(&parts, (InterpolPart[]) {
+        { .type = INTERPOL_STRING, .data = str_to_slice_raw("bar 'bar`'") },
+        { .type = INTERPOL_IDENT, .data = str_to_slice_raw("bar") },
+        { .type = INTERPOL_STRING, .data = str_to_slice_raw(" bar") }
+    }, 3);
+
     Token correct_str = (Token) {
         .type = STRING,
         .data.string = (InterpolString) {
             .backticks = 2,
-            .parts = node_to_list(&(LLNode) {
-                .data = &(InterpolPart) {
-                    .type = INTERPOL_STRING,
-                    .data = str_to_slice_raw("bar 'bar`'")
-                },
-                .next = &(LLNode) {
-                    .data = &(InterpolPart) {
-                        .type = INTERPOL_IDENT,
-                        .data = str_to_slice_raw("bar")
-                    },
-                    .next = &(LLNode) {
-                        .data = &(InterpolPart) {
-                            .type = INTERPOL_STRING,
-                            .data = str_to_slice_raw(" bar")
-                        },
-                        .next = NULL
-                    }
-                }
-            })
+            .parts = parts
         },
         .offset = 0,
         .length = strlen("``'bar 'bar`'$(bar) bar'``")
     };
-    ASSERT_EQUAL_Tm("lex should lex string correctly", &correct_str, str.head->data, &token_type_info, NULL);
+    ASSERT_EQUAL_Tm("lex should lex string correctly", &correct_str, VEC_ITEMS(str), &token_type_info, NULL);
+
+    interpol_parts_free(parts);
+    free_tokens(str);
+    PASS();
+}
 
+TEST dollar_test (void) {
+    Prog prog = (Prog) { .filename = "test", .text = "'a$b$'" };
+    Tokens str;
+    ASSERTm("lex should succeed on $ without (", lex(prog, &str));
+    InterpolParts parts = VEC_ITEMS(str)->data.string.parts;
+    ASSERTm("$ without ( should be plain text", parts.len == 1 && slice_equals_str(VEC_ITEMS(parts)->data, "a$b$"));
     free_tokens(str);
     PASS();
 }
 
+// lexes text with lex and lex_parallel, which should agree on everything
+static bool lex_both (const char *text, bool *ok, Tokens *serial, Tokens *parallel) {
+    char *serial_errors;
+    char *parallel_errors;
+    size_t serial_len;
+    size_t parallel_len;
+    Prog prog = (Prog) { .filename = "test", .text = text, .errors = open_memstream(&serial_errors, &serial_len) };
+    bool serial_ok = lex(prog, serial);
+    fclose(prog.errors);
+    prog.errors = open_memstream(&parallel_errors, &parallel_len);
+    *ok = lex_parallel(prog, 7, parallel);
+    fclose(prog.errors);
+
+    bool same = *ok == serial_ok && serial_len == parallel_len && memcmp(serial_errors, parallel_errors, serial_len) == 0;
+    free(serial_errors);
+    free(parallel_errors);
+    return same;
+}
+
+TEST parallel_test (void) {
+    // strings with ";\n" in them make some of the guessed chunk starts wrong
+    const char *stmts[3] = {
+        "['a.c'] > a [```'echo a;\n;\n'```] > ['a.o'];\n",
+        "flags 'x';\n",
+        "[] > b ['$(flags)', \n'c;\n'] > [];\n"
+    };
+    size_t text_cap = 3 * LEX_PARALLEL_MIN_LEN;
+    char *text = malloc(text_cap + 64);
+    size_t text_len = 0;
+    for (size_t i = 0; text_len < text_cap; ++i) {
+        strcpy(text + text_len, stmts[i % 3]);
+        text_len += strlen(stmts[i % 3]);
+    }
+
+    for (int bad = 0; bad < 2; ++bad) {
+        // an unexpected character right at a chunk start
+        if (bad) memcpy(strstr(text + text_cap / 2, ";\n") + 2, "@", 1);
+        bool ok;
+        Tokens serial;
+        Tokens parallel;
+        ASSERTm("lex_parallel should report the same as lex", lex_both(text, &ok, &serial, &parallel));
+        ASSERT_EQm("lex_parallel should only fail on bad characters", !bad, ok);
+        ASSERT_EQm("lex_parallel should lex the same tokens", serial.len, parallel.len);
+        for (uint32_t i = 0; i < serial.len; ++i) {
+            ASSERT_EQUAL_Tm("lex_parallel should lex the same tokens", VEC_ITEMS(serial) + i, VEC_ITEMS(parallel) + i, &token_type_info, NULL);
+        }
+        free_tokens(serial);
+        free_tokens(parallel);
+    }
+    free(text);
+    PASS();
+}
+
 GREATEST_SUITE(lexer_suite) {
     RUN_TEST(symbol_test);
     RUN_TEST(ident_test);
     RUN_TEST(string_test);
+    RUN_TEST(dollar_test);
+    RUN_TEST(parallel_test);
 }
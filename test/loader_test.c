@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../graph.h"
+#include "../loader.h"
+#include "greatest/greatest.h"
+
+static void write_file (const char *dir, const char *name, const char *text) {
+    char path[256];
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+static void remove_in (const char *dir, const char *name) {
+    char path[256];
+    sprintf(path, "%s/%s", dir, name);
+    remove(path);
+}
+
+static const BuildFile *nth (BuildFiles files, uint32_t n) {
+    return files.files[files.order[n]];
+}
+
+static bool ends_with (const char *str, const char *suffix) {
+    size_t len = strlen(str);
+    return len >= strlen(suffix) && strcmp(str + len - strlen(suffix), suffix) == 0;
+}
+
+TEST include_test (void) {
+    char dir[] = "/tmp/bidet_loadXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char sub[64];
+    sprintf(sub, "%s/sub", dir);
+    ASSERT(mkdir(sub, 0755) == 0);
+    write_file(dir, "root.bdt", "include 'sub/a.bdt';\ninclude 'b.bdt';\n[] > all [a, b] > [];\n");
+    write_file(dir, "sub/a.bdt", "include '../b.bdt';\n[] > a [] > [];\n");
+    write_file(dir, "b.bdt", "flags '-O2';\n[] > b [] > [];\n");
+
+    char root[64];
+    sprintf(root, "%s/root.bdt", dir);
+    BuildFiles files;
+    ASSERTm("load_build_files should load everything", load_build_files(root, 4, &files));
+    ASSERT_EQm("files included twice should be loaded once", 3, files.files_len);
+    ASSERTm("the order should be depth first", ends_with(nth(files, 0)->path, "/root.bdt"));
+    ASSERTm("the order should be depth first", ends_with(nth(files, 1)->path, "/sub/a.bdt"));
+    ASSERTm("includes should be relative to the including file and normalized", strcmp(nth(files, 2)->path, root) < 0 && ends_with(nth(files, 2)->path, "/b.bdt"));
+
+    Graph g;
+    ASSERTm("graph_new should take every file", graph_new(files.progs, files.asts, files.files_len, &g));
+    ASSERTm("actions should be reachable across files", graph_resolve(&g, "all"));
+    ASSERT_EQ(3, g.order_len);
+    graph_free(g);
+    free_build_files(files);
+
+    remove_in(dir, "root.bdt");
+    remove_in(dir, "sub/a.bdt");
+    remove_in(dir, "b.bdt");
+    remove(sub);
+    remove(dir);
+    PASS();
+}
+
+TEST diagnostics_test (void) {
+    char dir[] = "/tmp/bidet_loadXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    write_file(dir, "root.bdt", "include 'bad.bdt';\ninclude 'missing.bdt';\ninclude '$(dir)/x.bdt';\n");
+    write_file(dir, "bad.bdt", "[] > ;\n");
+
+    char root[64];
+    sprintf(root, "%s/root.bdt", dir);
+    BuildFiles files;
+    ASSERT_FALSEm("load_build_files should fail on bad files", load_build_files(root, 0, &files));
+    ASSERT_EQ(3, files.files_len);
+    ASSERT_FALSEm("include paths can't use variables", nth(files, 0)->ok);
+    ASSERTm("diagnostics should be kept per file", strstr(nth(files, 0)->diagnostics, "plain string") != NULL);
+    ASSERTm("diagnostics should be kept per file", strstr(nth(files, 1)->diagnostics, "bad.bdt at 1,6") != NULL);
+    ASSERTm("missing files should be reported", strstr(nth(files, 2)->diagnostics, "couldn't open") != NULL);
+    free_build_files(files);
+
+    remove_in(dir, "root.bdt");
+    remove_in(dir, "bad.bdt");
+    remove(dir);
+    PASS();
+}
+
+GREATEST_SUITE(loader_suite) {
+    RUN_TEST(include_test);
+    RUN_TEST(diagnostics_test);
+}
@@ -0,0 +1,98 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../materialize.h"
+#include "greatest/greatest.h"
+
+static bool has_contents (const char *path, const char *contents) {
+    char buf[256];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+    size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[len] = '\0';
+    return strcmp(buf, contents) == 0;
+}
+
+static uint64_t total_files (const MaterializeStats *stats) {
+    uint64_t total = 0;
+    for (int i = 0; i < MATERIALIZE_METHODS; ++i) total += stats->files[i];
+    return total;
+}
+
+TEST copy_test (void) {
+    char dir[] = "/tmp/bidet_materializeXXXXXX";
+    ASSERT(mkdtemp(dir) != NULL);
+    char from[64];
+    char to[64];
+    sprintf(from, "%s/cached", dir);
+    sprintf(to, "%s/out", dir);
+    FILE *file = fopen(from, "wb");
+    ASSERT(file != NULL);
+    fputs("linked output", file);
+    fclose(file);
+    ASSERT(chmod(from, 0751) == 0);
+    file = fopen(to, "wb");
+    ASSERT(file != NULL);
+    fputs("stale", file);
+    fclose(file);
+
+    MaterializeStats stats = { 0 };
+    ASSERTm("materialize should replace the output", materialize(from, to, false, &stats));
+    ASSERT(has_contents(to, "linked output"));
+    struct stat from_st;
+    struct stat to_st;
+    ASSERT(stat(from, &from_st) == 0 && stat(to, &to_st) == 0);
+    ASSERT_EQm("materialize should keep the mode", 0751, to_st.st_mode & 07777);
+    ASSERT_FALSEm("outputs that can't be linked shouldn't be", from_st.st_ino == to_st.st_ino);
+    ASSERT_EQ(0, stats.files[MATERIALIZE_HARDLINK]);
+    ASSERT_EQ(1, total_files(&stats));
+
+    // a reflink comes first where there is one, otherwise it should be a hardlink
+    ASSERT(materialize(from, to, true, &stats));
+    ASSERT(has_contents(to, "linked output"));
+    ASSERT(stat(to, &to_st) == 0);
+    ASSERT(stats.files[MATERIALIZE_REFLINK] > 0 || (stats.files[MATERIALIZE_HARDLINK] == 1 && from_st.st_ino == to_st.st_ino));
+    ASSERT_EQ(2, total_files(&stats));
+    uint64_t bytes = 0;
+    for (int i = 0; i < MATERIALIZE_METHODS; ++i) bytes += stats.bytes[i];
+    ASSERT_EQ(2 * strlen("linked output"), bytes);
+
+    char tmp[80];
+    sprintf(tmp, "%s.bidet-tmp", to);
+    ASSERT_FALSEm("materialize shouldn't leave its temporary file", access(tmp, F_OK) == 0);
+    // where it was linked, the second time finds it already in place
+    ASSERT(materialize(from, to, true, &stats));
+    ASSERT(has_contents(to, "linked output"));
+    ASSERT_FALSEm("materializing twice shouldn't leave its temporary file", access(tmp, F_OK) == 0);
+    ASSERT_EQ(3, total_files(&stats));
+    remove(to);
+    remove(from);
+    ASSERT_FALSEm("materialize should fail on missing files", materialize(from, to, true, &stats));
+    ASSERT_FALSE(access(to, F_OK) == 0);
+    rmdir(dir);
+    PASS();
+}
+
+TEST report_test (void) {
+    MaterializeStats stats = { 0 };
+    stats.files[MATERIALIZE_COPY_RANGE] = 2;
+    stats.bytes[MATERIALIZE_COPY_RANGE] = 100;
+    char *report;
+    size_t len;
+    FILE *out = open_memstream(&report, &len);
+    materialize_report(&stats, out);
+    fclose(out);
+    ASSERTm("methods that were used should be reported", strstr(report, "copy_file_range") != NULL);
+    ASSERT_FALSEm("methods that weren't shouldn't be", strstr(report, "hardlink") != NULL);
+    free(report);
+    PASS();
+}
+
+GREATEST_SUITE(materialize_suite) {
+    RUN_TEST(copy_test);
+    RUN_TEST(report_test);
+}
@@ -1,3 +1,7 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../parser.h"
 #include "type_infos.h"
 #include "greatest/greatest.h"
@@ -7,62 +11,181 @@ static greatest_type_info astaction_type_info = { .equal = astaction_equal_cb, .
 TEST action_test (void) {
     Prog prog = (Prog) { .filename = "test", .text = "[foo + bar, barfoo] > foobar [] > [];" };
 
-    LList action_toks;
+    Tokens action_toks;
     // shouldn't really fail because lexer tests should run first
     ASSERTm("lex should succeed on action", lex(prog, &action_toks));
 
-    LList actions;
-    ASSERTm("parse should succeed on action", parse(prog, action_toks, &actions));
-    ASSERT_EQm("parse should only take one action", actions.head->next, NULL);
-    ASTAction *action = actions.head->data;
+    ASTProg ast;
+    ASSERTm("parse should succeed on action", parse(prog, action_toks, &ast));
+    ASSERT_EQm("parse should only take one action", 1, ast.actions.len);
+    ASTAction *action = VEC_ITEMS(ast.actions);
 
+    // more catees than fit inline
+    ASTCatees foo_bar = VEC_EMPTY;
+    ast_catees_append(&foo_bar, (ASTCatee[]) {
+        { .type = CATEE_IDENT, .data.ident = str_to_slice_raw("foo") },
+        { .type = CATEE_IDENT, .data.ident = str_to_slice_raw("bar") }
+    }, 2);
     ASTAction correct_action = (ASTAction) {
        .reqs = (ASTList) {
-           .elems = node_to_list(&(LLNode) {
-                .data = &(ASTConcat) {
-                    .catee = node_to_list(&(LLNode) {
-                        .data = &(ASTCatee) {
-                            .type = CATEE_IDENT,
-                            .data.ident = str_to_slice_raw("foo")
-                        },
-                        .next = &(LLNode) {
-                            .data = &(ASTCatee) {
-                                .type = CATEE_IDENT,
-                                .data.ident = str_to_slice_raw("bar")
-                            },
-                            .next = NULL
-                        }
-                    })
-                },
-                .next = &(LLNode) {
-                    .data = &(ASTConcat) {
-                        .catee = node_to_list(&(LLNode) {
-                            .data = &(ASTCatee) {
-                                .type = CATEE_IDENT,
-                                .data.ident = str_to_slice_raw("barfoo")
-                            },
-                            .next = NULL
-                        }),
-                    },
-                    .next = NULL
-                }
-           })
+           .elems = { .len = 2, .data.small = {
+                { .catee = foo_bar },
+                { .catee = { .len = 1, .data.small = {
+                    { .type = CATEE_IDENT, .data.ident = str_to_slice_raw("barfoo") }
+                } } }
+           } }
        },
        .name = str_to_slice_raw("foobar"),
-       .commands = (ASTList) {
-           .elems = list_new(),
-       },
-       .updates = (ASTList) {
-           .elems = list_new(),
-       }
+       .commands = (ASTList) { .elems = VEC_EMPTY },
+       .updates = (ASTList) { .elems = VEC_EMPTY },
+       .depfile = (ASTConcat) { .catee = VEC_EMPTY }
     };
     ASSERT_EQUAL_Tm("parse should parse action correctly", &correct_action, action, &astaction_type_info, NULL);
-    free_actions(actions);
+    ast_catees_free(foo_bar);
+    free_prog(ast);
+    free_tokens(action_toks);
+
+    PASS();
+}
+
+// a catee of a plain string
+#define STRING_CATEE(str) { .type = CATEE_INTERPOL_STRING, .data.interpol_string = { \
+    .backticks = 0, \
+    .parts = { .len = 1, .data.small = { { .type = INTERPOL_STRING, .data = str_to_slice_raw(str) } } } \
+} }
+
+static void count_error (void *ctx, size_t offset, const char *message) {
+    (void) offset;
+    (void) message;
+    ++*(int *) ctx;
+}
+
+TEST depfile_test (void) {
+    Prog prog = (Prog) { .filename = "test", .text = "[] > foo [] > ['foo.o'] depfile 'foo.d';" };
+
+    Tokens action_toks;
+    ASSERTm("lex should succeed on action with depfile", lex(prog, &action_toks));
+
+    ASTProg ast;
+    ASSERTm("parse should succeed on action with depfile", parse(prog, action_toks, &ast));
+    ASTAction *action = VEC_ITEMS(ast.actions);
+
+    ASTAction correct_action = (ASTAction) {
+        .reqs = (ASTList) { .elems = VEC_EMPTY },
+        .name = str_to_slice_raw("foo"),
+        .commands = (ASTList) { .elems = VEC_EMPTY },
+        .updates = (ASTList) {
+            .elems = { .len = 1, .data.small = {
+                { .catee = { .len = 1, .data.small = { STRING_CATEE("foo.o") } } }
+            } }
+        },
+        .depfile = (ASTConcat) {
+            .catee = { .len = 1, .data.small = { STRING_CATEE("foo.d") } }
+        }
+    };
+    ASSERT_EQUAL_Tm("parse should parse depfile correctly", &correct_action, action, &astaction_type_info, NULL);
+    free_prog(ast);
+    free_tokens(action_toks);
+
+    int errors = 0;
+    Prog bad = (Prog) { .filename = "test", .text = "[] > foo [] > ['foo.o'] depfile ;", .report = count_error, .report_ctx = &errors };
+    ASSERT(lex(bad, &action_toks));
+    ASSERT_FALSEm("parse should fail on a depfile without a path", parse(bad, action_toks, &ast));
+    ASSERT_EQm("a bad depfile should be reported once", 1, errors);
+    free_tokens(action_toks);
+
+    Prog linkable = (Prog) { .filename = "test", .text = "[] > foo [] > ['foo.o'] linkable depfile 'foo.d';" };
+    ASSERT(lex(linkable, &action_toks));
+    ASSERTm("attributes should parse in any order", parse(linkable, action_toks, &ast));
+    action = VEC_ITEMS(ast.actions);
+    correct_action.linkable = true;
+    ASSERT_EQUAL_Tm("parse should parse linkable", &correct_action, action, &astaction_type_info, NULL);
+    free_prog(ast);
     free_tokens(action_toks);
 
     PASS();
 }
 
+TEST var_test (void) {
+    Prog prog = (Prog) { .filename = "test", .text = "build_dir 'build';\n[] > foo [] > [];\nobjs build_dir + '/foo.o';" };
+
+    Tokens toks;
+    ASSERTm("lex should succeed on variables", lex(prog, &toks));
+
+    ASTProg ast;
+    ASSERTm("parse should succeed on variables", parse(prog, toks, &ast));
+    ASSERT_EQm("parse should find both variables", 2, ast.vars.len);
+    ASSERT_EQm("parse should still find the action", 1, ast.actions.len);
+    ASTVar *objs = VEC_ITEMS(ast.vars) + 1;
+    ASSERTm("parse should get the variable's name", slice_equals_str(objs->name, "objs"));
+    ASSERT_EQm("parse should get the variable's value", 2, objs->value.catee.len);
+    free_prog(ast);
+    free_tokens(toks);
+
+    PASS();
+}
+
+static void collect_action (void *ctx, ASTAction action) {
+    *ast_actions_push(&((ASTProg *) ctx)->actions) = action;
+}
+
+static void collect_var (void *ctx, ASTVar var) {
+    *ast_vars_push(&((ASTProg *) ctx)->vars) = var;
+}
+
+static void collect_include (void *ctx, ASTInclude include) {
+    *ast_includes_push(&((ASTProg *) ctx)->includes) = include;
+}
+
+TEST stream_test (void) {
+    const char *text =
+        "cflags '-Wall';\n"
+        "include 'other.bd';\n"
+        "['lexer.c'] > lexer ['cc $(cflags) -c lexer.c -o ' + cflags] > ['lexer.o'] depfile 'lexer.d';\n"
+        "[] > broken ['x' 'y'] > [];\n"
+        "[lexer] > all [] > [];\n"
+        "[] > unfinished";
+    char *full_errors;
+    char *stream_errors;
+    size_t full_len;
+    size_t stream_len;
+    Prog prog = (Prog) { .filename = "test", .text = text, .errors = open_memstream(&full_errors, &full_len) };
+    Tokens toks;
+    ASTProg full;
+    ASSERT(lex(prog, &toks));
+    ASSERT_FALSE(parse(prog, toks, &full));
+    fclose(prog.errors);
+
+    prog.errors = open_memstream(&stream_errors, &stream_len);
+    ASTProg streamed = (ASTProg) { .actions = VEC_EMPTY, .vars = VEC_EMPTY, .includes = VEC_EMPTY };
+    ASSERT_FALSEm("parse_stream should fail like parse", parse_stream(prog, (ParseSink) { collect_action, collect_var, collect_include, &streamed }));
+    fclose(prog.errors);
+    ASSERT_EQm("parse_stream should report the same errors", full_len, stream_len);
+    ASSERT_STR_EQm("parse_stream should report the same errors", full_errors, stream_errors);
+
+    ASSERT_EQm("parse_stream should send every statement that parses", full.actions.len, streamed.actions.len);
+    for (uint32_t i = 0; i < full.actions.len; ++i) {
+        ASSERT_EQUAL_Tm("parse_stream should parse like parse", VEC_ITEMS(full.actions) + i, VEC_ITEMS(streamed.actions) + i, &astaction_type_info, NULL);
+    }
+    ASSERT_EQ(1, streamed.vars.len);
+    ASSERT_EQ(1, streamed.includes.len);
+    ASSERTm("includes should keep their path", slice_equals_str(VEC_ITEMS(streamed.includes)->path, "other.bd"));
+
+    VEC_FOREACH(const ASTAction, action, streamed.actions) free_streamed_action(*action);
+    VEC_FOREACH(const ASTVar, var, streamed.vars) free_streamed_var(*var);
+    streamed.actions.len = 0;
+    streamed.vars.len = 0;
+    free_prog(streamed);
+    free_prog(full);
+    free_tokens(toks);
+    free(full_errors);
+    free(stream_errors);
+    PASS();
+}
+
 GREATEST_SUITE(parser_suite) {
     RUN_TEST(action_test);
+    RUN_TEST(depfile_test);
+    RUN_TEST(var_test);
+    RUN_TEST(stream_test);
 }
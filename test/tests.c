@@ -7,6 +7,19 @@ int main (int argc, char *argv[]) {
 
     RUN_SUITE(lexer_suite);
     RUN_SUITE(parser_suite);
+    RUN_SUITE(jobserver_suite);
+    RUN_SUITE(hash_suite);
+    RUN_SUITE(intern_suite);
+    RUN_SUITE(depfile_suite);
+    RUN_SUITE(deps_log_suite);
+    RUN_SUITE(build_log_suite);
+    RUN_SUITE(dir_cache_suite);
+    RUN_SUITE(graph_suite);
+    RUN_SUITE(loader_suite);
+    RUN_SUITE(graph_cache_suite);
+    RUN_SUITE(document_suite);
+    RUN_SUITE(alloc_suite);
+    RUN_SUITE(materialize_suite);
 
     GREATEST_MAIN_END();
 }
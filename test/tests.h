@@ -2,3 +2,16 @@
 
 GREATEST_SUITE_EXTERN(lexer_suite);
 GREATEST_SUITE_EXTERN(parser_suite);
+GREATEST_SUITE_EXTERN(jobserver_suite);
+GREATEST_SUITE_EXTERN(hash_suite);
+GREATEST_SUITE_EXTERN(intern_suite);
+GREATEST_SUITE_EXTERN(depfile_suite);
+GREATEST_SUITE_EXTERN(deps_log_suite);
+GREATEST_SUITE_EXTERN(build_log_suite);
+GREATEST_SUITE_EXTERN(dir_cache_suite);
+GREATEST_SUITE_EXTERN(graph_suite);
+GREATEST_SUITE_EXTERN(loader_suite);
+GREATEST_SUITE_EXTERN(graph_cache_suite);
+GREATEST_SUITE_EXTERN(document_suite);
+GREATEST_SUITE_EXTERN(alloc_suite);
+GREATEST_SUITE_EXTERN(materialize_suite);
@@ -21,15 +21,14 @@ int slice_equal (StringSlice expd, StringSlice got) {
 
 int interpolstring_equal (InterpolString expd, InterpolString got) {
     TRYBOOL(expd.backticks == got.backticks);
-    LLNode *expdn = expd.parts.head;
-    LLNode *gotn = got.parts.head;
-    for (; expdn != NULL && gotn != NULL; expdn = expdn->next, gotn = gotn->next) {
-        InterpolPart expdnp = *(InterpolPart *) expdn->data;
-        InterpolPart gotnp = *(InterpolPart *) gotn->data;
+    TRYBOOL(expd.parts.len == got.parts.len);
+    for (uint32_t i = 0; i < expd.parts.len; ++i) {
+        InterpolPart expdnp = VEC_ITEMS(expd.parts)[i];
+        InterpolPart gotnp = VEC_ITEMS(got.parts)[i];
         TRYBOOL(expdnp.type == gotnp.type);
         TRYBOOL(slice_equal(expdnp.data, gotnp.data));
     }
-    return expdn == NULL && gotn == NULL;
+    return true;
 }
 
 int token_equal_cb (const void *expd_v, const void *got_v, void *udata) {
@@ -75,11 +74,11 @@ static char *type_to_string (TokenType type) {
 // TODO make printfs use a string instead of TRYPOS and printing
 int interpolstring_printf (InterpolString t) {
     for (size_t i = 0; i < t.backticks; ++i) TRYPOS(printf("`"));
-    FOREACH(InterpolPart, part, t.parts) {
-        if (part.type == INTERPOL_IDENT) {
-            TRYPOS(printf("$(%s)", slice_to_str(part.data)));
+    VEC_FOREACH(const InterpolPart, part, t.parts) {
+        if (part->type == INTERPOL_IDENT) {
+            TRYPOS(printf("$(%s)", slice_to_str(part->data)));
         } else {
-            TRYPOS(printf("%s", slice_to_str(part.data)))
+            TRYPOS(printf("%s", slice_to_str(part->data)))
         }
     }
     for (size_t i = 0; i < t.backticks; ++i) TRYPOS(printf("`"));
@@ -104,11 +103,10 @@ int token_printf_cb (const void *t_v, void *udata) {
 }
 
 int astconcat_equal (ASTConcat expd, ASTConcat got) {
-    LLNode *expdn = expd.catee.head;
-    LLNode *gotn = got.catee.head;
-    for (; expdn != NULL && gotn != NULL; expdn = expdn->next, gotn = gotn->next) {
-        ASTCatee expdnc = *(ASTCatee *) expdn->data;
-        ASTCatee gotnc = *(ASTCatee *) gotn->data;
+    TRYBOOL(expd.catee.len == got.catee.len);
+    for (uint32_t i = 0; i < expd.catee.len; ++i) {
+        ASTCatee expdnc = VEC_ITEMS(expd.catee)[i];
+        ASTCatee gotnc = VEC_ITEMS(got.catee)[i];
         TRYBOOL(expdnc.type == gotnc.type);
         if (expdnc.type == CATEE_IDENT) {
             TRYBOOL(slice_equal(expdnc.data.ident, gotnc.data.ident));
@@ -116,18 +114,15 @@ int astconcat_equal (ASTConcat expd, ASTConcat got) {
             TRYBOOL(interpolstring_equal(expdnc.data.interpol_string, gotnc.data.interpol_string));
         }
     }
-    return expdn == NULL && gotn == NULL;
+    return true;
 }
 
 int astlist_equal (ASTList expd, ASTList got) {
-    LLNode *expdn = expd.elems.head;
-    LLNode *gotn = got.elems.head;
-    for (; expdn != NULL && gotn != NULL; expdn = expdn->next, gotn = gotn->next) {
-        ASTConcat expdnc = *(ASTConcat *) expdn->data;
-        ASTConcat gotnc = *(ASTConcat *) gotn->data;
-        TRYBOOL(astconcat_equal(expdnc, gotnc));
+    TRYBOOL(expd.elems.len == got.elems.len);
+    for (uint32_t i = 0; i < expd.elems.len; ++i) {
+        TRYBOOL(astconcat_equal(VEC_ITEMS(expd.elems)[i], VEC_ITEMS(got.elems)[i]));
     }
-    return expdn == NULL && gotn == NULL;
+    return true;
 }
 
 int astaction_equal_cb (const void *expd_v, const void *got_v, void *udata) {
@@ -140,30 +135,37 @@ int astaction_equal_cb (const void *expd_v, const void *got_v, void *udata) {
     TRYBOOL(astlist_equal(expd->commands, got->commands));
     TRYBOOL(slice_equal(expd->name, got->name));
     TRYBOOL(astlist_equal(expd->updates, got->updates));
+    TRYBOOL(astconcat_equal(expd->depfile, got->depfile));
+    TRYBOOL(expd->linkable == got->linkable);
+
+    return true;
+}
 
+int astconcat_printf (ASTConcat t) {
+    bool first = true;
+    VEC_FOREACH(const ASTCatee, catee, t.catee) {
+        if (!first) {
+            TRYPOS(printf(" + "));
+        }
+        first = false;
+        if (catee->type == CATEE_IDENT) {
+            TRYPOS(printf("%s", slice_to_str(catee->data.ident)));
+        } else {
+            TRYPOS(interpolstring_printf(catee->data.interpol_string));
+        }
+    }
     return true;
 }
 
 int astlist_printf (ASTList t) {
     TRYPOS(printf("["));
     bool first = true;
-    FOREACH(ASTConcat, concat, t.elems) {
+    VEC_FOREACH(const ASTConcat, concat, t.elems) {
         if (!first) {
             TRYPOS(printf(", "));
         }
         first = false;
-        bool cfirst = true;
-        FOREACH(ASTCatee, catee, concat.catee) {
-            if (!cfirst) {
-                TRYPOS(printf(" + "));
-            }
-            cfirst = false;
-            if (catee.type == CATEE_IDENT) {
-                TRYPOS(printf("%s", slice_to_str(catee.data.ident)));
-            } else {
-                TRYPOS(interpolstring_printf(catee.data.interpol_string));
-            }
-        }
+        TRYPOS(astconcat_printf(*concat));
     }
     return printf("]");
 }
@@ -177,5 +179,11 @@ int astaction_printf_cb (const void *t_v, void *udata) {
     TRYPOS(printf(" > %s ", slice_to_str(t->name)));
     TRYPOS(astlist_printf(t->commands));
     TRYPOS(printf(" > "));
-    return astlist_printf(t->updates);
+    TRYPOS(astlist_printf(t->updates));
+    if (t->depfile.catee.len > 0) {
+        TRYPOS(printf(" depfile "));
+        TRYPOS(astconcat_printf(t->depfile));
+    }
+    if (t->linkable) TRYPOS(printf(" linkable"));
+    return true;
 }
@@ -0,0 +1,70 @@
+// typed growable arrays, the first small_len elements are stored inline so short ones never allocate
+// VEC_DECLARE goes in a header, VEC_DEFINE with the same arguments in one .c file
+// small_len can be 0 for ones that are usually long
+// a vec's fine to copy by value, but a copy shares the heap elements, like copying an LList did
+
+#ifndef VEC_H
+#define VEC_H
+
+#include <stdint.h>
+#include <string.h>
+
+// heap storage starts at this many elements
+#define VEC_MIN_CAP 8
+
+#define VEC_DECLARE(name, prefix, type, small_len) \
+    typedef struct { \
+        uint32_t len; \
+        uint32_t cap; /* 0 while the elements are inline */ \
+        union { \
+            type *heap; \
+            type small[(small_len) > 0 ? (small_len) : 1]; \
+        } data; \
+    } name; \
+    type *prefix##_push (name *); \
+    void prefix##_append (name *, const type *, uint32_t); \
+    void prefix##_free (name);
+
+// needs alloc.h, the allocations count towards the defining file's subsystem
+#define VEC_DEFINE(name, prefix, type, small_len) \
+    /* makes room for len more elements */ \
+    static void prefix##_reserve (name *vec, uint32_t len) { \
+        uint32_t want = vec->len + len; \
+        if (want <= (vec->cap == 0 ? (uint32_t) (small_len) : vec->cap)) return; \
+        uint32_t cap = vec->cap == 0 ? VEC_MIN_CAP : vec->cap; \
+        while (cap < want) cap *= 2; \
+        if (vec->cap == 0) { \
+            type *heap = alloc_bytes(cap * sizeof(type)); \
+            memcpy(heap, vec->data.small, vec->len * sizeof(type)); \
+            vec->data.heap = heap; \
+        } else { \
+            vec->data.heap = alloc_resize(vec->data.heap, cap * sizeof(type)); \
+        } \
+        vec->cap = cap; \
+    } \
+    /* the new element is uninitialized */ \
+    type *prefix##_push (name *vec) { \
+        prefix##_reserve(vec, 1); \
+        return VEC_ITEMS(*vec) + vec->len++; \
+    } \
+    void prefix##_append (name *vec, const type *items, uint32_t len) { \
+        if (len == 0) return; \
+        prefix##_reserve(vec, len); \
+        memcpy(VEC_ITEMS(*vec) + vec->len, items, len * sizeof(type)); \
+        vec->len += len; \
+    } \
+    /* just the vec's own storage, like list_free without the data */ \
+    void prefix##_free (name vec) { \
+        if (vec.cap != 0) alloc_free(vec.data.heap); \
+    }
+
+// zero initialized is empty
+#define VEC_EMPTY { .len = 0, .cap = 0 }
+
+#define VEC_ITEMS(vec) ((vec).cap == 0 ? (vec).data.small : (vec).data.heap)
+
+// var points at each element in turn
+#define VEC_FOREACH(type, var, vec) \
+    for (type *var = (type *) VEC_ITEMS(vec), *var##_end = var + (vec).len; var != var##_end; ++var)
+
+#endif
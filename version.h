@@ -0,0 +1,7 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+// bump with anything that changes what a build file means, caches made by other versions are ignored
+#define BIDET_VERSION "bidet 0.1"
+
+#endif